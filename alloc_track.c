@@ -0,0 +1,201 @@
+// Counts heap allocations.
+//
+// Author: Johannes Stüttgen (johannes.stuettgen@gmail.com)
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <errno.h>
+#include <link.h>
+#include <malloc.h>
+#include <sys/auxv.h>
+
+#include "alloc_track.h"
+
+// The allocator of glibc, which stays reachable under these names when
+// malloc() and friends are replaced.
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t count, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+extern void *__libc_memalign(size_t alignment, size_t size);
+extern void *__libc_valloc(size_t size);
+extern void *__libc_pvalloc(size_t size);
+extern void __libc_free(void *ptr);
+
+static bool installed = false;
+static bool tracking = false;
+static ALLOC_STATS stats;
+// Code of the dynamic linker, whose allocations aren't counted.
+static uintptr_t loader_start = 0;
+static uintptr_t loader_end = 0;
+
+// Checks if the program replaced the allocator with ALLOC_TRACK_INTERPOSE().
+bool alloc_track_installed(void) {
+  return installed;
+}
+
+// Finds the loaded segments of the dynamic linker.
+static int alloc_track_find_loader(struct dl_phdr_info *info,
+                                   size_t size __attribute__((unused)),
+                                   void *base) {
+  if (info->dlpi_addr != *(uintptr_t *)base) {
+    return 0;
+  }
+  for (size_t i = 0; i < info->dlpi_phnum; ++i) {
+    const ElfW(Phdr) *phdr = &info->dlpi_phdr[i];
+    if (phdr->p_type != PT_LOAD) {
+      continue;
+    }
+    uintptr_t start = info->dlpi_addr + phdr->p_vaddr;
+    uintptr_t end = start + phdr->p_memsz;
+    if (!loader_start || start < loader_start) {
+      loader_start = start;
+    }
+    if (end > loader_end) {
+      loader_end = end;
+    }
+  }
+  return 1;
+}
+
+// The dynamic linker allocates the TLS of every new thread, which glibc
+// caches with the thread stack after the thread exited and only frees when
+// the cache is full. Calls from the dynamic linker are left out, so a test
+// starting threads doesn't look like it leaked.
+void alloc_track_install(void) {
+  uintptr_t base = getauxval(AT_BASE);
+  if (base) {
+    dl_iterate_phdr(alloc_track_find_loader, &base);
+  }
+  installed = true;
+}
+
+// Start counting allocations of all threads.
+void alloc_track_start(void) {
+  __atomic_store_n(&tracking, true, __ATOMIC_RELAXED);
+}
+
+void alloc_track_stop(void) {
+  __atomic_store_n(&tracking, false, __ATOMIC_RELAXED);
+}
+
+bool alloc_track_started(void) {
+  return __atomic_load_n(&tracking, __ATOMIC_RELAXED);
+}
+
+// Takes a snapshot of the counters, subtract two of them to get the
+// allocations in between.
+void alloc_track_stats(ALLOC_STATS *snapshot) {
+  snapshot->allocations = __atomic_load_n(&stats.allocations, __ATOMIC_RELAXED);
+  snapshot->frees = __atomic_load_n(&stats.frees, __ATOMIC_RELAXED);
+  snapshot->bytes = __atomic_load_n(&stats.bytes, __ATOMIC_RELAXED);
+  snapshot->live_bytes = __atomic_load_n(&stats.live_bytes, __ATOMIC_RELAXED);
+  snapshot->peak_bytes = __atomic_load_n(&stats.peak_bytes, __ATOMIC_RELAXED);
+}
+
+// Start looking for a new peak from the bytes live right now.
+void alloc_track_reset_peak(void) {
+  __atomic_store_n(&stats.peak_bytes,
+                   __atomic_load_n(&stats.live_bytes, __ATOMIC_RELAXED),
+                   __ATOMIC_RELAXED);
+}
+
+static void alloc_track_count(size_t allocated, size_t released,
+                              int64_t live_change) {
+  if (allocated) {
+    __atomic_add_fetch(&stats.allocations, 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&stats.bytes, allocated, __ATOMIC_RELAXED);
+  }
+  if (released) {
+    __atomic_add_fetch(&stats.frees, 1, __ATOMIC_RELAXED);
+  }
+  int64_t live = __atomic_add_fetch(&stats.live_bytes, live_change,
+                                    __ATOMIC_RELAXED);
+  int64_t peak = __atomic_load_n(&stats.peak_bytes, __ATOMIC_RELAXED);
+  while (live > peak &&
+         !__atomic_compare_exchange_n(&stats.peak_bytes, &peak, live, true,
+                                      __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {}
+}
+
+// Checks if a call made from caller should be counted.
+static bool alloc_track_counted(const void *caller) {
+  return __atomic_load_n(&tracking, __ATOMIC_RELAXED) &&
+         ((uintptr_t)caller < loader_start || (uintptr_t)caller >= loader_end);
+}
+
+// Counts a new block, if tracking is started.
+static void *alloc_track_new(void *ptr, const void *caller) {
+  if (ptr && alloc_track_counted(caller)) {
+    size_t size = malloc_usable_size(ptr);
+    alloc_track_count(size, 0, size);
+  }
+  return ptr;
+}
+
+void *alloc_track_malloc(size_t size, const void *caller) {
+  return alloc_track_new(__libc_malloc(size), caller);
+}
+
+void *alloc_track_calloc(size_t count, size_t size, const void *caller) {
+  return alloc_track_new(__libc_calloc(count, size), caller);
+}
+
+void *alloc_track_memalign(size_t alignment, size_t size,
+                           const void *caller) {
+  return alloc_track_new(__libc_memalign(alignment, size), caller);
+}
+
+void *alloc_track_valloc(size_t size, const void *caller) {
+  return alloc_track_new(__libc_valloc(size), caller);
+}
+
+void *alloc_track_pvalloc(size_t size, const void *caller) {
+  return alloc_track_new(__libc_pvalloc(size), caller);
+}
+
+int alloc_track_posix_memalign(void **ptr, size_t alignment, size_t size,
+                               const void *caller) {
+  if (alignment % sizeof(void *) || alignment & (alignment - 1)) {
+    return EINVAL;
+  }
+  void *block = alloc_track_memalign(alignment, size, caller);
+  if (!block) {
+    return ENOMEM;
+  }
+  *ptr = block;
+  return 0;
+}
+
+// A realloc() counts as releasing the old block and allocating a new one,
+// even if the block only grew in place.
+void *alloc_track_realloc(void *ptr, size_t size, const void *caller) {
+  if (!ptr || !alloc_track_counted(caller)) {
+    return alloc_track_new(__libc_realloc(ptr, size), caller);
+  }
+  size_t old_size = malloc_usable_size(ptr);
+  void *block = __libc_realloc(ptr, size);
+  if (block) {
+    size_t new_size = malloc_usable_size(block);
+    alloc_track_count(new_size, old_size, (int64_t)new_size - old_size);
+  } else if (size == 0) {
+    alloc_track_count(0, old_size, -(int64_t)old_size);
+  }
+  return block;
+}
+
+void alloc_track_free(void *ptr, const void *caller) {
+  if (ptr && alloc_track_counted(caller)) {
+    size_t size = malloc_usable_size(ptr);
+    alloc_track_count(0, size, -(int64_t)size);
+  }
+  __libc_free(ptr);
+}
@@ -0,0 +1,126 @@
+// Counts heap allocations, so tests can check for leaks and allocation
+// budgets and benchmarks can report allocations per operation.
+//
+// USAGE: Put ALLOC_TRACK_INTERPOSE() at file scope into exactly one source
+// file of the program, e.g. next to main(). It defines malloc(), free() and
+// the rest of the family, which replace the ones of the C library for the
+// whole program, including allocations made inside libc. They forward to
+// the glibc allocator (__libc_malloc() and friends) and, while tracking is
+// started, count every call.
+//
+//   ALLOC_TRACK_INTERPOSE()
+//
+//   ALLOC_STATS before, after;
+//   alloc_track_stats(&before);
+//   alloc_track_start();
+//   ...
+//   alloc_track_stop();
+//   alloc_track_stats(&after);
+//
+// test.c does this around every test and fails tests which leak or exceed
+// the budget set with test_alloc_budget(). bench.c counts the allocations of
+// one extra sample of every benchmark. Programs without the hooks get zero
+// counts and never fail those checks.
+//
+// Sizes are the usable sizes of the blocks reported by malloc_usable_size(),
+// which can be a bit larger than the sizes asked for. The counters are
+// global, so allocations of other threads count as well. Calls from the
+// dynamic linker are not counted, it allocates the TLS of new threads and
+// glibc keeps that cached long after the threads are gone.
+//
+// Author: Johannes Stüttgen (johannes.stuettgen@gmail.com)
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef CUTIL_ALLOC_TRACK_H
+#define CUTIL_ALLOC_TRACK_H
+
+#include <stdlib.h>
+
+#include "types.h"
+
+typedef struct ALLOC_STATS_ {
+  uint64_t allocations;  // Blocks allocated, a realloc() counts as one
+  uint64_t frees;        // Blocks released, a realloc() counts as one
+  uint64_t bytes;        // Total size of the blocks allocated
+  int64_t live_bytes;    // Size of the blocks allocated minus released
+  int64_t peak_bytes;    // Most live_bytes since alloc_track_reset_peak()
+} ALLOC_STATS;
+
+bool alloc_track_installed(void);
+void alloc_track_start(void);
+void alloc_track_stop(void);
+bool alloc_track_started(void);
+void alloc_track_stats(ALLOC_STATS *stats);
+void alloc_track_reset_peak(void);
+
+// Used by ALLOC_TRACK_INTERPOSE(), caller is the return address of the
+// replaced function.
+void alloc_track_install(void);
+void *alloc_track_malloc(size_t size, const void *caller);
+void *alloc_track_calloc(size_t count, size_t size, const void *caller);
+void *alloc_track_realloc(void *ptr, size_t size, const void *caller);
+void *alloc_track_memalign(size_t alignment, size_t size,
+                           const void *caller);
+void *alloc_track_valloc(size_t size, const void *caller);
+void *alloc_track_pvalloc(size_t size, const void *caller);
+int alloc_track_posix_memalign(void **ptr, size_t alignment, size_t size,
+                               const void *caller);
+void alloc_track_free(void *ptr, const void *caller);
+
+#define ALLOC_TRACK_CALLER __builtin_return_address(0)
+
+// Replaces the allocator of the C library, see above.
+#define ALLOC_TRACK_INTERPOSE() \
+void *malloc(size_t size) { \
+  return alloc_track_malloc(size, ALLOC_TRACK_CALLER); \
+} \
+\
+void *calloc(size_t count, size_t size) { \
+  return alloc_track_calloc(count, size, ALLOC_TRACK_CALLER); \
+} \
+\
+void *realloc(void *ptr, size_t size) { \
+  return alloc_track_realloc(ptr, size, ALLOC_TRACK_CALLER); \
+} \
+\
+void free(void *ptr) { \
+  alloc_track_free(ptr, ALLOC_TRACK_CALLER); \
+} \
+\
+int posix_memalign(void **ptr, size_t alignment, size_t size) { \
+  return alloc_track_posix_memalign(ptr, alignment, size, \
+                                    ALLOC_TRACK_CALLER); \
+} \
+\
+void *aligned_alloc(size_t alignment, size_t size) { \
+  return alloc_track_memalign(alignment, size, ALLOC_TRACK_CALLER); \
+} \
+\
+void *memalign(size_t alignment, size_t size) { \
+  return alloc_track_memalign(alignment, size, ALLOC_TRACK_CALLER); \
+} \
+\
+void *valloc(size_t size) { \
+  return alloc_track_valloc(size, ALLOC_TRACK_CALLER); \
+} \
+\
+void *pvalloc(size_t size) { \
+  return alloc_track_pvalloc(size, ALLOC_TRACK_CALLER); \
+} \
+\
+static void __attribute__((constructor)) alloc_track_constructor_(void) { \
+  alloc_track_install(); \
+}
+
+#endif  // CUTIL_ALLOC_TRACK_H
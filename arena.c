@@ -0,0 +1,157 @@
+// A region allocator for lots of short lived allocations. Memory is handed
+// out by bumping a pointer through large chunks, and is only released all
+// at once, either by destroying the arena or by rewinding it to a mark.
+// This turns the malloc()/free() pair for every temporary string or vector
+// into a few pointer increments.
+//
+// Author: Johannes Stüttgen (johannes.stuettgen@gmail.com)
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <string.h>
+
+#include "arena.h"
+
+// Allocate a new chunk with room for at least size bytes and make it the
+// current one.
+static ERROR arena_add_chunk(ARENA *arena, size_t size) {
+  if (size < arena->chunk_size) {
+    size = arena->chunk_size;
+  }
+  if (size > SIZE_MAX - sizeof(ARENA_CHUNK)) {
+    return FAILURE;
+  }
+  ARENA_CHUNK *chunk = malloc(sizeof(ARENA_CHUNK) + size);
+  if (!chunk) {
+    return FAILURE;
+  }
+  chunk->prev = arena->chunk;
+  chunk->size = size;
+  chunk->used = 0;
+  arena->chunk = chunk;
+  return SUCCESS;
+}
+
+// Create a new arena and allocate its first chunk.
+//
+// Args:
+//  arena: pointer to the arena to initialize
+//  chunk_size: size of the chunks the arena allocates from the heap,
+//              use ARENA_DEFAULT_CHUNK_SIZE if unsure.
+ERROR arena_init(ARENA *arena, size_t chunk_size) {
+  arena->chunk = NULL;
+  arena->chunk_size = chunk_size;
+  return arena_add_chunk(arena, chunk_size);
+}
+
+// Release all memory the arena holds, this invalidates every allocation.
+void arena_destroy(ARENA *arena) {
+  while (arena->chunk) {
+    ARENA_CHUNK *prev = arena->chunk->prev;
+    free(arena->chunk);
+    arena->chunk = prev;
+  }
+}
+
+// Offset of the next free address with the given alignment in a chunk.
+static size_t arena_aligned_offset(const ARENA_CHUNK *chunk,
+                                   size_t alignment) {
+  uintptr_t next = (uintptr_t)(chunk->data + chunk->used);
+  uintptr_t aligned = (next + alignment - 1) & ~(uintptr_t)(alignment - 1);
+  return chunk->used + (aligned - next);
+}
+
+// Allocate size bytes with an alignment, which must be a power of two.
+// If the current chunk is full, the arena starts a new one which is big
+// enough for the allocation. Returns NULL if that fails.
+void *arena_alloc_aligned(ARENA *arena, size_t size, size_t alignment) {
+  if (alignment == 0 || (alignment & (alignment - 1))) {
+    return NULL;
+  }
+  ARENA_CHUNK *chunk = arena->chunk;
+  if (!chunk || arena_aligned_offset(chunk, alignment) > chunk->size ||
+      size > chunk->size - arena_aligned_offset(chunk, alignment)) {
+    if (size > SIZE_MAX - alignment ||
+        arena_add_chunk(arena, size + alignment) != SUCCESS) {
+      return NULL;
+    }
+    chunk = arena->chunk;
+  }
+  size_t offset = arena_aligned_offset(chunk, alignment);
+  chunk->used = offset + size;
+  return chunk->data + offset;
+}
+
+// Allocate size bytes aligned for any type.
+void *arena_alloc(ARENA *arena, size_t size) {
+  return arena_alloc_aligned(arena, size, ARENA_ALIGNMENT);
+}
+
+// Resize an allocation of old_size bytes. If it is the most recent allocation
+// and still fits into its chunk it is resized in place, otherwise the data is
+// copied into a new allocation. Shrinking never moves anything.
+void *arena_realloc(ARENA *arena, void *ptr, size_t old_size, size_t size) {
+  ARENA_CHUNK *chunk = arena->chunk;
+  uint8_t *data = ptr;
+  if (!ptr) {
+    return arena_alloc(arena, size);
+  }
+  if (chunk && data + old_size == chunk->data + chunk->used &&
+      size <= chunk->size - (data - chunk->data)) {
+    chunk->used = (data - chunk->data) + size;
+    return ptr;
+  }
+  if (size <= old_size) {
+    return ptr;
+  }
+  void *new_ptr = arena_alloc(arena, size);
+  if (new_ptr) {
+    memcpy(new_ptr, ptr, old_size);
+  }
+  return new_ptr;
+}
+
+// Copy a string into the arena.
+char *arena_strdup(ARENA *arena, const char * const string) {
+  size_t size = strlen(string) + 1;
+  char *copy = arena_alloc_aligned(arena, size, 1);
+  if (copy) {
+    memcpy(copy, string, size);
+  }
+  return copy;
+}
+
+// Remember how far the arena is filled, so you can release everything
+// allocated after this point with arena_rewind().
+ARENA_MARK arena_mark(ARENA *arena) {
+  ARENA_MARK mark = {
+    .arena = arena,
+    .chunk = arena->chunk,
+    .used = arena->chunk ? arena->chunk->used : 0
+  };
+  return mark;
+}
+
+// Release everything allocated since the mark was taken. Chunks started after
+// the mark are freed, the marked chunk is reused.
+void arena_rewind(ARENA_MARK *mark) {
+  ARENA *arena = mark->arena;
+  while (arena->chunk && arena->chunk != mark->chunk) {
+    ARENA_CHUNK *prev = arena->chunk->prev;
+    free(arena->chunk);
+    arena->chunk = prev;
+  }
+  if (arena->chunk) {
+    arena->chunk->used = mark->used;
+  }
+}
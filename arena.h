@@ -0,0 +1,77 @@
+// A region allocator for lots of short lived allocations. Memory is handed
+// out by bumping a pointer through large chunks, and is only released all
+// at once, either by destroying the arena or by rewinding it to a mark.
+// This turns the malloc()/free() pair for every temporary string or vector
+// into a few pointer increments.
+//
+// USAGE: Declare the arena with LOCAL_ARENA to release everything it
+// allocated when it goes out of scope, or take a LOCAL_ARENA_MARK inside a
+// loop to give back everything allocated in one iteration:
+//
+//   LOCAL_ARENA ARENA arena;
+//   arena_init(&arena, ARENA_DEFAULT_CHUNK_SIZE);
+//   for (...) {
+//     LOCAL_ARENA_MARK ARENA_MARK mark = arena_mark(&arena);
+//     char *name = arena_strdup(&arena, "temporary");
+//   }
+//
+// Author: Johannes Stüttgen (johannes.stuettgen@gmail.com)
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef CUTIL_ARENA_H
+#define CUTIL_ARENA_H
+
+#include "raii.h"
+#include "types.h"
+
+// Release all memory of an arena when it goes out of scope.
+#define LOCAL_ARENA LOCAL_DESTRUCTOR(arena_destroy)
+
+// Rewind the arena to a mark when the mark goes out of scope.
+#define LOCAL_ARENA_MARK LOCAL_DESTRUCTOR(arena_rewind)
+
+typedef struct ARENA_CHUNK_ {
+  struct ARENA_CHUNK_ *prev;
+  size_t size;
+  size_t used;
+  uint8_t data[];
+} ARENA_CHUNK;
+
+typedef struct ARENA_ {
+  ARENA_CHUNK *chunk;  // The chunk we currently allocate from
+  size_t chunk_size;
+} ARENA;
+
+// Remembers the fill level of an arena, see arena_mark().
+typedef struct ARENA_MARK_ {
+  ARENA *arena;
+  ARENA_CHUNK *chunk;
+  size_t used;
+} ARENA_MARK;
+
+static const size_t ARENA_DEFAULT_CHUNK_SIZE = 64 * 1024;
+
+// Allocations without an explicit alignment are aligned for any type.
+static const size_t ARENA_ALIGNMENT = 16;
+
+ERROR arena_init(ARENA *arena, size_t chunk_size);
+void arena_destroy(ARENA *arena);
+void *arena_alloc(ARENA *arena, size_t size);
+void *arena_alloc_aligned(ARENA *arena, size_t size, size_t alignment);
+void *arena_realloc(ARENA *arena, void *ptr, size_t old_size, size_t size);
+char *arena_strdup(ARENA *arena, const char * const string);
+ARENA_MARK arena_mark(ARENA *arena);
+void arena_rewind(ARENA_MARK *mark);
+
+#endif  // CUTIL_ARENA_H
@@ -0,0 +1,382 @@
+// A small microbenchmark runner.
+//
+// Author: Johannes Stüttgen (johannes.stuettgen@gmail.com)
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "alloc_track.h"
+#include "bench.h"
+#include "cpu.h"
+#include "log.h"
+
+typedef struct BENCHES_ {
+  BENCH functions[MAX_BENCHES];
+  const char *names[MAX_BENCHES];
+  size_t size;
+  size_t max_size;
+} BENCHES;
+
+// The timer of the running benchmark. Time spent paused is subtracted from
+// the sample.
+typedef struct BENCH_TIMER_ {
+  bool paused;
+  uint64_t paused_at;
+  uint64_t paused_cycles_at;
+  uint64_t paused_ns;
+  uint64_t paused_cycles;
+} BENCH_TIMER;
+
+static BENCHES benches = {
+  .functions = {0},
+  .names = {0},
+  .size = 0,
+  .max_size = MAX_BENCHES
+};
+static BENCH_TIMER timer;
+// Allocations are counted in the running sample, except while it is paused.
+static bool counting = false;
+
+static uint64_t bench_clock(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// Reads the time stamp counter, which ticks at a constant rate on all recent
+// x86 CPUs. Returns 0 elsewhere.
+static uint64_t bench_cycles(void) {
+#ifdef CUTIL_X86
+  return __rdtsc();
+#else
+  return 0;
+#endif
+}
+
+void bench_pause(void) {
+  if (!timer.paused) {
+    timer.paused_at = bench_clock();
+    timer.paused_cycles_at = bench_cycles();
+    timer.paused = true;
+    if (counting) {
+      alloc_track_stop();
+    }
+  }
+}
+
+void bench_resume(void) {
+  if (timer.paused) {
+    if (counting) {
+      alloc_track_start();
+    }
+    timer.paused_ns += bench_clock() - timer.paused_at;
+    timer.paused_cycles += bench_cycles() - timer.paused_cycles_at;
+    timer.paused = false;
+  }
+}
+
+// Runs the benchmark once and returns the time it took without the time it
+// was paused. A benchmark which ends paused is timed up to the pause.
+static uint64_t bench_sample(BENCH bench_function, size_t iterations,
+                             uint64_t *cycles) {
+  memset(&timer, 0, sizeof(timer));
+  uint64_t start_cycles = bench_cycles();
+  uint64_t start = bench_clock();
+  bench_function(iterations);
+  uint64_t end = bench_clock();
+  uint64_t end_cycles = bench_cycles();
+  if (timer.paused) {
+    end = timer.paused_at;
+    end_cycles = timer.paused_cycles_at;
+  }
+  *cycles = end_cycles - start_cycles - timer.paused_cycles;
+  return end - start - timer.paused_ns;
+}
+
+// Runs the benchmark once more and counts its allocations per iteration.
+// Tracking is left as it was, so a test running benchmarks keeps counting
+// its own allocations.
+static double bench_count_allocations(BENCH bench_function,
+                                      size_t iterations) {
+  ALLOC_STATS before, after;
+  uint64_t cycles;
+  bool started = alloc_track_started();
+  alloc_track_stats(&before);
+  counting = true;
+  alloc_track_start();
+  bench_sample(bench_function, iterations, &cycles);
+  if (!started) {
+    alloc_track_stop();
+  }
+  counting = false;
+  alloc_track_stats(&after);
+  return (double)(after.allocations - before.allocations) / iterations;
+}
+
+// Find the number of iterations one sample needs to take BENCH_SAMPLE_NS.
+static size_t bench_calibrate(BENCH bench_function) {
+  size_t iterations = 1;
+  uint64_t cycles;
+  while (iterations < SIZE_MAX / 10) {
+    uint64_t ns = bench_sample(bench_function, iterations, &cycles);
+    if (ns >= BENCH_SAMPLE_NS) {
+      break;
+    }
+    // Aim a bit higher than needed, but don't trust short runs too much.
+    double scale = ns ? 1.2 * BENCH_SAMPLE_NS / ns : 10;
+    if (scale > 10) {
+      scale = 10;
+    } else if (scale < 2) {
+      scale = 2;
+    }
+    iterations *= scale;
+  }
+  return iterations;
+}
+
+static int bench_compare_doubles(const void *a, const void *b) {
+  double x = *(const double *)a;
+  double y = *(const double *)b;
+  return (x > y) - (x < y);
+}
+
+// Computes the statistics of a number of samples in ns per iteration, which
+// are sorted in place. Only the iteration count and cycles of the result are
+// left alone.
+//
+// Args:
+//  samples: the samples in ns per iteration
+//  count: the number of samples, at least 1
+//  result: receives median, p99, mean, stddev and ops_per_second
+void bench_statistics(double *samples, size_t count, BENCH_RESULT *result) {
+  qsort(samples, count, sizeof(double), bench_compare_doubles);
+  result->median = count % 2 ? samples[count / 2] :
+                   (samples[count / 2 - 1] + samples[count / 2]) / 2;
+  // Nearest rank, the smallest sample at least 99% of the samples are <=.
+  result->p99 = samples[(size_t)ceil(count * 0.99) - 1];
+  double sum = 0;
+  for (size_t i = 0; i < count; ++i) {
+    sum += samples[i];
+  }
+  result->mean = sum / count;
+  double squares = 0;
+  for (size_t i = 0; i < count; ++i) {
+    squares += (samples[i] - result->mean) * (samples[i] - result->mean);
+  }
+  result->stddev = count > 1 ? sqrt(squares / (count - 1)) : 0;
+  result->ops_per_second = result->median > 0 ? 1e9 / result->median : 0;
+}
+
+// Calibrates, warms up and samples a benchmark.
+static void bench_run(BENCH bench_function, BENCH_RESULT *result) {
+  double samples[BENCH_SAMPLES];
+  double cycles[BENCH_SAMPLES];
+  uint64_t sample_cycles;
+
+  size_t iterations = bench_calibrate(bench_function);
+  uint64_t warmup_start = bench_clock();
+  while (bench_clock() - warmup_start < BENCH_WARMUP_NS) {
+    bench_sample(bench_function, iterations, &sample_cycles);
+  }
+  for (size_t i = 0; i < BENCH_SAMPLES; ++i) {
+    uint64_t ns = bench_sample(bench_function, iterations, &sample_cycles);
+    samples[i] = (double)ns / iterations;
+    cycles[i] = (double)sample_cycles / iterations;
+  }
+  bench_statistics(samples, BENCH_SAMPLES, result);
+  qsort(cycles, BENCH_SAMPLES, sizeof(double), bench_compare_doubles);
+  result->cycles = cycles[BENCH_SAMPLES / 2];
+  result->iterations = iterations;
+  result->allocations = 0;
+  if (alloc_track_installed()) {
+    result->allocations = bench_count_allocations(bench_function, iterations);
+  }
+}
+
+// Writes a string as a JSON string literal.
+static void bench_json_string(FILE *fp, const char *str) {
+  fputc('"', fp);
+  for (; *str; ++str) {
+    if (*str == '"' || *str == '\\') {
+      fprintf(fp, "\\%c", *str);
+    } else if ((unsigned char)*str < 0x20) {
+      fprintf(fp, "\\u%04x", *str);
+    } else {
+      fputc(*str, fp);
+    }
+  }
+  fputc('"', fp);
+}
+
+// Writes results as JSON, with one benchmark per line so the files diff
+// nicely.
+//
+// Args:
+//  fp: the file to write to
+//  names: the names of the benchmarks
+//  results: the results of the benchmarks
+//  count: the number of benchmarks
+ERROR bench_write_json(FILE *fp, const char * const *names,
+                       const BENCH_RESULT *results, size_t count) {
+  fprintf(fp, "{\n  \"benchmarks\": [\n");
+  for (size_t i = 0; i < count; ++i) {
+    fprintf(fp, "    {\"name\": ");
+    bench_json_string(fp, names[i]);
+    fprintf(fp, ", \"iterations\": %zu, \"median_ns\": %.3f, "
+            "\"p99_ns\": %.3f, \"mean_ns\": %.3f, \"stddev_ns\": %.3f, "
+            "\"ops_per_second\": %.0f, \"cycles\": %.3f, "
+            "\"allocations\": %.3f}%s\n",
+            results[i].iterations, results[i].median, results[i].p99,
+            results[i].mean, results[i].stddev, results[i].ops_per_second,
+            results[i].cycles, results[i].allocations,
+            i + 1 < count ? "," : "");
+  }
+  fprintf(fp, "  ]\n}\n");
+  return ferror(fp) ? FAILURE : SUCCESS;
+}
+
+// Checks if a line written by bench_write_json() is about the benchmark.
+static bool bench_json_name_is(const char *line, const char *name) {
+  const char *str = strstr(line, "\"name\": \"");
+  if (!str) {
+    return false;
+  }
+  for (str += strlen("\"name\": \""); *str != '"'; ++str, ++name) {
+    if (*str == '\\') {
+      ++str;
+      if (*str == 'u') {
+        char code[5] = {0};
+        strncpy(code, str + 1, 4);
+        if (strtol(code, NULL, 16) != (unsigned char)*name) {
+          return false;
+        }
+        str += 4;
+        continue;
+      }
+    }
+    if (*str == '\0' || *str != *name) {
+      return false;
+    }
+  }
+  return *name == '\0';
+}
+
+// Finds the median of a benchmark in a file written by bench_write_json().
+// Returns FAILURE if the file has no result for the benchmark.
+ERROR bench_read_median(FILE *fp, const char * const name, double *median) {
+  char *line = NULL;
+  size_t size = 0;
+  ERROR result = FAILURE;
+
+  rewind(fp);
+  while (getline(&line, &size, fp) >= 0) {
+    const char *value = strstr(line, "\"median_ns\": ");
+    if (value && bench_json_name_is(line, name)) {
+      *median = strtod(value + strlen("\"median_ns\": "), NULL);
+      result = SUCCESS;
+      break;
+    }
+  }
+  free(line);
+  return result;
+}
+
+// Adds a benchmark to the queue to be run when benches_run() is called.
+ERROR bench_add(BENCH bench_function, const char * const bench_name) {
+  if (benches.size < benches.max_size) {
+    benches.functions[benches.size] = bench_function;
+    benches.names[benches.size] = bench_name;
+    ++benches.size;
+    return SUCCESS;
+  }
+  return FAILURE;
+}
+
+// Runs the queued benchmarks and prints their results.
+//
+// Args:
+//  options: what to run and where to write the results, NULL runs all
+//           benchmarks and only prints the results to stdout
+ERROR benches_run(const BENCH_OPTIONS * const options) {
+  static BENCH_RESULT results[MAX_BENCHES];
+  static const char *names[MAX_BENCHES];
+  BENCH_OPTIONS defaults = { .threshold = BENCH_DEFAULT_THRESHOLD };
+  const BENCH_OPTIONS *opts = options ? options : &defaults;
+  FILE *out = opts->output ? opts->output : stdout;
+  FILE *baseline = NULL;
+  size_t regressions = 0;
+  size_t count = 0;
+  ERROR status = SUCCESS;
+
+  if (opts->baseline_path) {
+    baseline = fopen(opts->baseline_path, "r");
+    if (!baseline) {
+      log_print(LL_ERR, "Can't open baseline %s", opts->baseline_path);
+      return FAILURE;
+    }
+  }
+  for (size_t i = 0; i < benches.size; ++i) {
+    if (opts->filter && !strstr(benches.names[i], opts->filter)) {
+      continue;
+    }
+    fprintf(out, "[BENCH %zu] %-40s ", i, benches.names[i]);
+    fflush(out);
+    bench_run(benches.functions[i], &results[count]);
+    BENCH_RESULT *result = &results[count];
+    fprintf(out, "%9.2f ns/op p99 %9.2f sd %8.2f %12.0f ops/s",
+            result->median, result->p99, result->stddev,
+            result->ops_per_second);
+    if (result->cycles) {
+      fprintf(out, " %9.2f cyc/op", result->cycles);
+    }
+    if (alloc_track_installed()) {
+      fprintf(out, " %7.2f allocs/op", result->allocations);
+    }
+    double old_median;
+    if (baseline &&
+        bench_read_median(baseline, benches.names[i], &old_median) ==
+        SUCCESS && old_median > 0) {
+      double change = (result->median - old_median) * 100 / old_median;
+      fprintf(out, " %+7.1f%%", change);
+      if (change > opts->threshold) {
+        fprintf(out, " [REGRESSION]");
+        ++regressions;
+      }
+    }
+    fprintf(out, "\n");
+    names[count++] = benches.names[i];
+  }
+  if (baseline) {
+    fclose(baseline);
+  }
+  if (opts->json_path) {
+    FILE *fp = fopen(opts->json_path, "w");
+    if (!fp || bench_write_json(fp, names, results, count) != SUCCESS) {
+      log_print(LL_ERR, "Can't write results to %s", opts->json_path);
+      status = FAILURE;
+    }
+    if (fp && fclose(fp) != 0) {
+      status = FAILURE;
+    }
+  }
+  if (regressions) {
+    fprintf(out, "%zu BENCHMARKS REGRESSED\n", regressions);
+    return FAILURE;
+  }
+  fprintf(out, "%zu BENCHMARKS DONE\n", count);
+  return status;
+}
@@ -0,0 +1,125 @@
+// A small microbenchmark runner, registered and run like the unit tests in
+// test.h.
+//
+// USAGE:
+//
+//   static void bench_vector_push(size_t iterations) {
+//     VECTOR vec;
+//     bench_pause();
+//     vector_init(&vec, sizeof(size_t), VECTOR_DEFAULT_SIZE);
+//     bench_resume();
+//     for (size_t i = 0; i < iterations; ++i) {
+//       BENCH_DO_NOT_OPTIMIZE(vector_push(&vec, &i, sizeof(i)));
+//     }
+//     bench_pause();
+//     vector_destroy(&vec);
+//   }
+//
+//   BENCH_ADD(bench_vector_push);
+//   benches_run(NULL);
+//
+// A benchmark runs the measured operation 'iterations' times. The runner
+// calls it with growing iteration counts until one call takes at least
+// BENCH_SAMPLE_NS, runs it for BENCH_WARMUP_NS more to warm up caches and
+// branch predictors, and then times BENCH_SAMPLES calls with the calibrated
+// count. Setup and cleanup between bench_pause() and bench_resume() is not
+// counted, the timer is always running when the function is called.
+//
+// Every benchmark reports the median, 99th percentile and standard deviation
+// of the samples in ns per iteration, the operations per second at the
+// median and, on x86, the median in TSC cycles per iteration. Programs which
+// use ALLOC_TRACK_INTERPOSE() also get the heap allocations per iteration,
+// counted in one more sample after the timed ones. The results can be
+// written to a JSON file and compared to the file of an earlier run, which
+// flags every benchmark whose median got slower by more than a threshold.
+//
+// Author: Johannes Stüttgen (johannes.stuettgen@gmail.com)
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef CUTIL_BENCH_H
+#define CUTIL_BENCH_H
+
+#include <stdio.h>
+
+#include "types.h"
+
+// Same as MAX_TESTS in test.h.
+#define MAX_BENCHES 4096
+
+// Number of timed samples per benchmark, odd so there is a true median.
+#define BENCH_SAMPLES 101
+
+// Shortest time of a single sample, the iteration count is calibrated to it.
+#define BENCH_SAMPLE_NS 1000000
+
+// Time spent running a benchmark before the samples are taken.
+#define BENCH_WARMUP_NS 20000000
+
+// Benchmarks regressed by more than this are flagged by default.
+#define BENCH_DEFAULT_THRESHOLD 10.0
+
+// Functions for benchmarks run the measured operation 'iterations' times.
+typedef void (*BENCH)(size_t iterations);
+
+typedef struct BENCH_OPTIONS_ {
+  const char *filter;        // Only run benchmarks with this in their name
+  const char *json_path;     // Write the results to this file
+  const char *baseline_path; // Compare to the results of an earlier run
+  double threshold;          // Flag medians slower by more than this percent
+  FILE *output;              // Print the results here, stdout if NULL
+} BENCH_OPTIONS;
+
+// The statistics of one benchmark, in ns per iteration.
+typedef struct BENCH_RESULT_ {
+  size_t iterations;  // Per sample
+  double median;
+  double p99;
+  double mean;
+  double stddev;
+  double ops_per_second;
+  double cycles;      // Median TSC cycles per iteration, 0 without a TSC
+  double allocations; // Heap allocations per iteration, see alloc_track.h
+} BENCH_RESULT;
+
+// Adds a benchmark to the queue to be run when benches_run() is called.
+ERROR bench_add(BENCH bench_function, const char * const bench_name);
+
+// Adds a benchmark named like its function.
+#define BENCH_ADD(function) bench_add(function, #function)
+
+// Runs the queued benchmarks and prints their results. Returns FAILURE if a
+// result can't be written or a benchmark regressed against the baseline.
+ERROR benches_run(const BENCH_OPTIONS * const options);
+
+// Stop and restart the timer of the running benchmark, to exclude setup.
+void bench_pause(void);
+void bench_resume(void);
+
+// Used by benches_run(), exposed for the tests.
+void bench_statistics(double *samples, size_t count, BENCH_RESULT *result);
+ERROR bench_write_json(FILE *fp, const char * const *names,
+                       const BENCH_RESULT *results, size_t count);
+ERROR bench_read_median(FILE *fp, const char * const name, double *median);
+
+// Makes the compiler believe the value is used, so computing it can't be
+// optimized away. Works for scalars and pointers, pass a pointer to anything
+// larger.
+#define BENCH_DO_NOT_OPTIMIZE(value) \
+  __asm__ volatile("" : : "r,m"(value) : "memory")
+
+// Makes the compiler believe all memory was read and written, so stores to
+// it can't be optimized away.
+#define BENCH_CLOBBER() __asm__ volatile("" : : : "memory")
+
+#endif  // CUTIL_BENCH_H
@@ -0,0 +1,1652 @@
+// Entry point for the libcutil benchmarks.
+//
+// Author: Johannes Stüttgen (johannes.stuettgen@gmail.com)
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <inttypes.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "alloc_track.h"
+#include "arena.h"
+#include "bench.h"
+#include "binlog.h"
+#include "bitset.h"
+#include "buffer.h"
+#include "cvector.h"
+#include "hashmap.h"
+#include "log.h"
+#include "pool.h"
+#include "pqueue.h"
+#include "ringbuffer.h"
+#include "segvector.h"
+#include "vector.h"
+#include "vector_find.h"
+#include "vector_sort.h"
+
+// Count heap allocations, benches_run() reports them per operation.
+ALLOC_TRACK_INTERPOSE()
+
+// Number of items used by the vector benchmarks.
+static const size_t bench_items = 10000000;
+
+// Number of single byte items used by the huge vector benchmarks.
+static const size_t bench_huge_items = 1000000000;
+
+// Returns a timestamp from the monotonic clock in nanoseconds.
+static double bench_now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void bench_report(const char * const name, size_t ops, double ns) {
+  printf("[BENCH] %-50s %10.2f ns/op %10.2f ms\n", name, ns / ops, ns / 1e6);
+}
+
+// Alternate push and pop right at a resize boundary and count how often the
+// vector has to realloc its storage.
+static void bench_vector_policy(const char * const name, VECTOR_POLICY policy) {
+  size_t boundary = 1 << 20;
+  size_t reallocs = 0;
+  size_t total_bytes;
+  VECTOR vec;
+
+  vector_init_policy(&vec, sizeof(size_t), VECTOR_DEFAULT_SIZE, policy);
+  for (size_t i = 0; i < boundary; ++i) {
+    vector_push(&vec, &i, sizeof(i));
+  }
+  vector_shrink_to_fit(&vec);
+  total_bytes = vec.total_bytes;
+  double start = bench_now();
+  for (size_t i = 0; i < bench_items; ++i) {
+    vector_push(&vec, &i, sizeof(i));
+    reallocs += vec.total_bytes != total_bytes;
+    total_bytes = vec.total_bytes;
+    vector_pop(&vec);
+    reallocs += vec.total_bytes != total_bytes;
+    total_bytes = vec.total_bytes;
+  }
+  bench_report(name, 2 * bench_items, bench_now() - start);
+  printf("        %zu reallocs for %zu push/pop pairs\n", reallocs,
+         bench_items);
+  vector_destroy(&vec);
+}
+
+// Create, fill and destroy lots of short lived vectors with a few items.
+static void bench_vector_small(void) {
+  size_t vectors = bench_items / 4;
+  double start = bench_now();
+  for (size_t i = 0; i < vectors; ++i) {
+    VECTOR vec;
+    vector_init(&vec, sizeof(size_t), VECTOR_DEFAULT_SIZE);
+    for (size_t j = 0; j < i % 8; ++j) {
+      vector_push(&vec, &j, sizeof(j));
+    }
+    vector_destroy(&vec);
+  }
+  bench_report("VECTOR create/push 0-7/destroy", vectors, bench_now() - start);
+
+  start = bench_now();
+  for (size_t i = 0; i < vectors; ++i) {
+    SMALL_VECTOR(size_t, 8) svec;
+    SMALL_VECTOR_INIT(&svec);
+    for (size_t j = 0; j < i % 8; ++j) {
+      vector_push(&svec.vec, &j, sizeof(j));
+    }
+    vector_destroy(&svec.vec);
+  }
+  bench_report("SMALL_VECTOR(8) create/push 0-7/destroy", vectors,
+               bench_now() - start);
+}
+
+// Simulate request handling, where every request allocates a few temporary
+// strings and a small vector which are all released when it is done.
+static void bench_arena(void) {
+  static const char * const header = "Content-Type: application/json";
+  size_t requests = bench_items / 10;
+  double start = bench_now();
+  for (size_t i = 0; i < requests; ++i) {
+    char *strings[16];
+    for (size_t j = 0; j < ARRAYSIZE(strings); ++j) {
+      strings[j] = strdup(header);
+    }
+    VECTOR vec;
+    vector_init(&vec, sizeof(size_t), 4);
+    for (size_t j = 0; j < 32; ++j) {
+      vector_push(&vec, &j, sizeof(j));
+    }
+    vector_destroy(&vec);
+    for (size_t j = 0; j < ARRAYSIZE(strings); ++j) {
+      free(strings[j]);
+    }
+  }
+  bench_report("request temporaries, malloc/free", requests,
+               bench_now() - start);
+
+  ARENA arena;
+  arena_init(&arena, ARENA_DEFAULT_CHUNK_SIZE);
+  start = bench_now();
+  for (size_t i = 0; i < requests; ++i) {
+    LOCAL_ARENA_MARK ARENA_MARK mark = arena_mark(&arena);
+    char *strings[16];
+    for (size_t j = 0; j < ARRAYSIZE(strings); ++j) {
+      strings[j] = arena_strdup(&arena, header);
+    }
+    VECTOR vec;
+    vector_init_arena(&vec, sizeof(size_t), 4, &arena);
+    for (size_t j = 0; j < 32; ++j) {
+      vector_push(&vec, &j, sizeof(j));
+    }
+    vector_destroy(&vec);
+    (void)strings;
+  }
+  bench_report("request temporaries, arena mark/rewind", requests,
+               bench_now() - start);
+  arena_destroy(&arena);
+}
+
+// Number of fragments in the response built by bench_buffer(), about 100
+// bytes each.
+#define BENCH_FRAGMENTS 10000
+
+static void bench_buffer(void) {
+  static const char * const payload =
+      "the quick brown fox jumps over the lazy dog, "
+      "the quick brown fox jumps over the lazy dog";
+  size_t response_size = BENCH_FRAGMENTS * 128;
+  size_t rounds = 100;
+  size_t length = 0;
+  LOCAL_FD int fd = open("/dev/null", O_WRONLY);
+
+  // snprintf() each fragment and strcat() it, which rescans the response.
+  char *response = malloc(response_size);
+  double start = bench_now();
+  for (size_t round = 0; round < 2; ++round) {
+    response[0] = 0;
+    for (size_t i = 0; i < BENCH_FRAGMENTS; ++i) {
+      char fragment[128];
+      snprintf(fragment, sizeof(fragment), "<item id=\"%zu\">%s</item>\n", i,
+               payload);
+      strcat(response, fragment);
+    }
+    length = strlen(response);
+    if (write(fd, response, length) < 0) {
+      break;
+    }
+  }
+  bench_report("1MB response, snprintf/strcat/write", 2 * BENCH_FRAGMENTS,
+               bench_now() - start);
+  free(response);
+  printf("[BENCH] response size: %zu bytes\n", length);
+
+  start = bench_now();
+  for (size_t round = 0; round < rounds; ++round) {
+    BUFFER buf;
+    buf_init(&buf, 0);
+    for (size_t i = 0; i < BENCH_FRAGMENTS; ++i) {
+      buf_printf(&buf, "<item id=\"%zu\">%s</item>\n", i, payload);
+    }
+    buf_write(&buf, fd);
+    buf_destroy(&buf);
+  }
+  bench_report("1MB response, buf_printf/write", rounds * BENCH_FRAGMENTS,
+               bench_now() - start);
+
+  start = bench_now();
+  for (size_t round = 0; round < rounds; ++round) {
+    BUFFER_CHAIN chain;
+    buf_chain_init(&chain, BUFFER_CHAIN_CHUNK_SIZE);
+    for (size_t i = 0; i < BENCH_FRAGMENTS; ++i) {
+      buf_chain_printf(&chain, "<item id=\"%zu\">", i);
+      buf_chain_append_ref(&chain, payload, strlen(payload));
+      buf_chain_append(&chain, "</item>\n", 8);
+    }
+    buf_chain_write(&chain, fd);
+    buf_chain_destroy(&chain);
+  }
+  bench_report("1MB response, buf_chain_printf/ref/writev",
+               rounds * BENCH_FRAGMENTS, bench_now() - start);
+}
+
+static void bench_segvector(void) {
+  size_t sum = 0;
+  SEGVECTOR vec;
+
+  segvector_init(&vec, sizeof(size_t), SEGVECTOR_DEFAULT_CHUNK_SHIFT);
+  double start = bench_now();
+  for (size_t i = 0; i < bench_items; ++i) {
+    segvector_push(&vec, &i, sizeof(i));
+  }
+  bench_report("segvector_push() loop", bench_items, bench_now() - start);
+  start = bench_now();
+  for (size_t i = 0; i < bench_items; ++i) {
+    sum += *(size_t *)segvector_get(&vec, (i * 7919) % bench_items);
+  }
+  bench_report("segvector_get() strided", bench_items, bench_now() - start);
+  segvector_destroy(&vec);
+
+  VECTOR flat;
+  vector_init(&flat, sizeof(size_t), VECTOR_DEFAULT_SIZE);
+  for (size_t i = 0; i < bench_items; ++i) {
+    vector_push(&flat, &i, sizeof(i));
+  }
+  start = bench_now();
+  for (size_t i = 0; i < bench_items; ++i) {
+    sum += *(size_t *)vector_get(&flat, (i * 7919) % bench_items);
+  }
+  bench_report("vector_get() strided", bench_items, bench_now() - start);
+  vector_destroy(&flat);
+  printf("        checksum %zu\n", sum);
+}
+
+// Fill a huge vector in 1 MiB blocks and measure how long the slowest
+// growth step takes and how many page faults the whole fill causes.
+static void bench_vector_huge(const char * const name, VECTOR *vec) {
+  static uint8_t block[1 << 20];
+  struct rusage before;
+  struct rusage after;
+  double max_grow_ns = 0;
+
+  getrusage(RUSAGE_SELF, &before);
+  double start = bench_now();
+  for (size_t i = 0; i < bench_huge_items; i += sizeof(block)) {
+    size_t total_bytes = vec->total_bytes;
+    double push_start = bench_now();
+    vector_push_n(vec, block, sizeof(block), 1);
+    double push_ns = bench_now() - push_start;
+    if (vec->total_bytes != total_bytes && push_ns > max_grow_ns) {
+      max_grow_ns = push_ns;
+    }
+  }
+  bench_report(name, bench_huge_items, bench_now() - start);
+  getrusage(RUSAGE_SELF, &after);
+  printf("        slowest grow %.2f ms, %ld minor / %ld major page faults\n",
+         max_grow_ns / 1e6, after.ru_minflt - before.ru_minflt,
+         after.ru_majflt - before.ru_majflt);
+  vector_destroy(vec);
+}
+
+static int bench_compare(const void *a, const void *b) {
+  uint64_t lhs = *(const uint64_t *)a;
+  uint64_t rhs = *(const uint64_t *)b;
+  return (lhs > rhs) - (lhs < rhs);
+}
+
+#define BENCH_LESS(a, b, ctx) (*(a) < *(b))
+VECTOR_SORT_DEFINE(bench_sort_u64, uint64_t, BENCH_LESS)
+
+// Fill the vector with count pseudo random keys from a xorshift generator.
+static void bench_random_fill(VECTOR *vec, size_t count) {
+  uint64_t state = 88172645463325252ull;
+  vec->used_bytes = 0;
+  for (size_t i = 0; i < count; ++i) {
+    state ^= state << 13;
+    state ^= state >> 7;
+    state ^= state << 17;
+    vector_push(vec, &state, sizeof(state));
+  }
+}
+
+// Sort random 64 bit keys with qsort() and all the vector sorts.
+static void bench_vector_sort(size_t count) {
+  char name[64];
+  VECTOR vec;
+
+  vector_init(&vec, sizeof(uint64_t), count);
+  bench_random_fill(&vec, count);
+  double start = bench_now();
+  qsort(vec.data, count, sizeof(uint64_t), bench_compare);
+  snprintf(name, sizeof(name), "qsort() %zu items", count);
+  bench_report(name, count, bench_now() - start);
+
+  bench_random_fill(&vec, count);
+  start = bench_now();
+  vector_sort(&vec, bench_compare);
+  snprintf(name, sizeof(name), "vector_sort() %zu items", count);
+  bench_report(name, count, bench_now() - start);
+
+  bench_random_fill(&vec, count);
+  start = bench_now();
+  bench_sort_u64(&vec, NULL);
+  snprintf(name, sizeof(name), "VECTOR_SORT_DEFINE() %zu items", count);
+  bench_report(name, count, bench_now() - start);
+
+  bench_random_fill(&vec, count);
+  start = bench_now();
+  vector_radix_sort(&vec, 0, sizeof(uint64_t));
+  snprintf(name, sizeof(name), "vector_radix_sort() %zu items", count);
+  bench_report(name, count, bench_now() - start);
+  vector_destroy(&vec);
+}
+
+#define BENCH_U64_HASH(key) hashmap_hash_u64(*(key))
+#define BENCH_U64_EQUAL(a, b) (*(a) == *(b))
+HASHMAP_DEFINE(bench_u64_map, uint64_t, uint64_t, BENCH_U64_HASH,
+               BENCH_U64_EQUAL)
+
+// The separately chained map everyone writes, for comparison.
+typedef struct BENCH_CHAIN_NODE_ {
+  uint64_t key;
+  uint64_t value;
+  struct BENCH_CHAIN_NODE_ *next;
+} BENCH_CHAIN_NODE;
+
+typedef struct BENCH_CHAINED_MAP_ {
+  BENCH_CHAIN_NODE **buckets;
+  size_t mask;
+} BENCH_CHAINED_MAP;
+
+static uint64_t *bench_chained_get(BENCH_CHAINED_MAP *map, uint64_t key) {
+  BENCH_CHAIN_NODE *node = map->buckets[hashmap_hash_u64(key) & map->mask];
+  for (; node; node = node->next) {
+    if (node->key == key) {
+      return &node->value;
+    }
+  }
+  return NULL;
+}
+
+static void bench_chained_put(BENCH_CHAINED_MAP *map, uint64_t key,
+                              uint64_t value) {
+  uint64_t *stored = bench_chained_get(map, key);
+  if (stored) {
+    *stored = value;
+    return;
+  }
+  BENCH_CHAIN_NODE **bucket = &map->buckets[hashmap_hash_u64(key) & map->mask];
+  BENCH_CHAIN_NODE *node = malloc(sizeof(*node));
+  node->key = key;
+  node->value = value;
+  node->next = *bucket;
+  *bucket = node;
+}
+
+// Insert, hit and miss random keys in a map with 2^20 slots, filled to a load
+// factor of load_permille / 1000. The chained map gets as many buckets.
+static void bench_hashmap(size_t load_permille) {
+  size_t capacity = 1 << 20;
+  size_t count = capacity * load_permille / 1000;
+  bench_u64_map map;
+  BENCH_CHAINED_MAP chained;
+  VECTOR keys;
+  char name[64];
+  size_t checksum = 0;
+
+  vector_init(&keys, sizeof(uint64_t), 2 * count);
+  bench_random_fill(&keys, 2 * count);
+  uint64_t *inserted = (uint64_t *)keys.data;
+  uint64_t *missing = inserted + count;
+
+  bench_u64_map_init(&map);
+  hashmap_reserve(&map.map, capacity - capacity / 8);
+  double start = bench_now();
+  for (size_t i = 0; i < count; ++i) {
+    bench_u64_map_put(&map, inserted[i], i);
+  }
+  snprintf(name, sizeof(name), "hashmap insert, load %.3f",
+           load_permille / 1000.0);
+  bench_report(name, count, bench_now() - start);
+  start = bench_now();
+  for (size_t i = 0; i < count; ++i) {
+    checksum += *bench_u64_map_get(&map, inserted[i]);
+  }
+  snprintf(name, sizeof(name), "hashmap hit, load %.3f",
+           load_permille / 1000.0);
+  bench_report(name, count, bench_now() - start);
+  start = bench_now();
+  for (size_t i = 0; i < count; ++i) {
+    checksum += bench_u64_map_get(&map, missing[i]) != NULL;
+  }
+  snprintf(name, sizeof(name), "hashmap miss, load %.3f",
+           load_permille / 1000.0);
+  bench_report(name, count, bench_now() - start);
+  start = bench_now();
+  for (size_t i = 0; i < count; ++i) {
+    checksum += *(uint64_t *)hashmap_get(&map.map, &inserted[i]);
+  }
+  snprintf(name, sizeof(name), "hashmap hit (generic), load %.3f",
+           load_permille / 1000.0);
+  bench_report(name, count, bench_now() - start);
+  bench_u64_map_destroy(&map);
+
+  chained.buckets = calloc(capacity, sizeof(*chained.buckets));
+  chained.mask = capacity - 1;
+  start = bench_now();
+  for (size_t i = 0; i < count; ++i) {
+    bench_chained_put(&chained, inserted[i], i);
+  }
+  snprintf(name, sizeof(name), "chained insert, load %.3f",
+           load_permille / 1000.0);
+  bench_report(name, count, bench_now() - start);
+  start = bench_now();
+  for (size_t i = 0; i < count; ++i) {
+    checksum += *bench_chained_get(&chained, inserted[i]);
+  }
+  snprintf(name, sizeof(name), "chained hit, load %.3f",
+           load_permille / 1000.0);
+  bench_report(name, count, bench_now() - start);
+  start = bench_now();
+  for (size_t i = 0; i < count; ++i) {
+    checksum += bench_chained_get(&chained, missing[i]) != NULL;
+  }
+  snprintf(name, sizeof(name), "chained miss, load %.3f",
+           load_permille / 1000.0);
+  bench_report(name, count, bench_now() - start);
+  for (size_t i = 0; i < capacity; ++i) {
+    while (chained.buckets[i]) {
+      BENCH_CHAIN_NODE *next = chained.buckets[i]->next;
+      free(chained.buckets[i]);
+      chained.buckets[i] = next;
+    }
+  }
+  free(chained.buckets);
+  vector_destroy(&keys);
+  printf("        checksum %zu\n", checksum);
+}
+
+// Load bench_items records from a file, by reading and pushing each record
+// or by mapping the file as a view, and sum one field of every record.
+static void bench_vector_view(void) {
+  char path[] = "/tmp/cutil_bench_XXXXXX";
+  uint64_t record[2];
+  size_t checksum = 0;
+  VECTOR vec;
+
+  close(mkstemp(path));
+  vector_init(&vec, sizeof(record), bench_items);
+  for (size_t i = 0; i < bench_items; ++i) {
+    record[0] = i;
+    record[1] = i * 2;
+    vector_push(&vec, record, sizeof(record));
+  }
+  vector_save(&vec, path);
+  vector_destroy(&vec);
+
+  double start = bench_now();
+  FILE *fp = fopen(path, "r");
+  VECTOR_FILE_HEADER header;
+  vector_init(&vec, sizeof(record), VECTOR_DEFAULT_SIZE);
+  if (fread(&header, sizeof(header), 1, fp) == 1) {
+    while (fread(record, sizeof(record), 1, fp) == 1) {
+      vector_push(&vec, record, sizeof(record));
+    }
+  }
+  fclose(fp);
+  for (size_t i = 0; i < bench_items; ++i) {
+    checksum += ((uint64_t *)vector_get(&vec, i))[1];
+  }
+  bench_report("load records with fread() + vector_push()", bench_items,
+               bench_now() - start);
+  vector_destroy(&vec);
+
+  start = bench_now();
+  {
+    LOCAL_MMAP MMAP_REGION region;
+    mmap_file(&region, path, false);
+    mmap_advise(&region, MMAP_SEQUENTIAL);
+    vector_init_view(&vec, sizeof(record), &region);
+    for (size_t i = 0; i < bench_items; ++i) {
+      checksum += ((uint64_t *)vector_get(&vec, i))[1];
+    }
+    vector_destroy(&vec);
+  }
+  bench_report("load records with mmap_file() + vector_init_view()",
+               bench_items, bench_now() - start);
+  unlink(path);
+  printf("        checksum %zu\n", checksum);
+}
+
+// Build two filters of bench_huge_items flags, intersect them and count the
+// result, with VECTORs of bool and with bitsets.
+static void bench_bitset(void) {
+  size_t count = bench_huge_items;
+  size_t result = 0;
+  VECTOR flags[2];
+
+  for (size_t i = 0; i < 2; ++i) {
+    vector_init(&flags[i], sizeof(bool), count);
+    memset(flags[i].data, 0, count);
+    flags[i].used_bytes = count;
+  }
+  double start = bench_now();
+  for (size_t i = 0; i < count; i += 2) {
+    ((bool *)flags[0].data)[i] = true;
+  }
+  for (size_t i = 0; i < count; i += 3) {
+    ((bool *)flags[1].data)[i] = true;
+  }
+  bench_report("1e9 flags, bool vector set", count / 2 + count / 3,
+               bench_now() - start);
+  start = bench_now();
+  for (size_t i = 0; i < count; ++i) {
+    ((bool *)flags[0].data)[i] &= ((bool *)flags[1].data)[i];
+  }
+  bench_report("1e9 flags, bool vector and", count, bench_now() - start);
+  start = bench_now();
+  for (size_t i = 0; i < count; ++i) {
+    result += ((bool *)flags[0].data)[i];
+  }
+  bench_report("1e9 flags, bool vector count", count, bench_now() - start);
+  vector_destroy(&flags[0]);
+  vector_destroy(&flags[1]);
+
+  BITSET bits[2];
+  bitset_init(&bits[0], count);
+  bitset_init(&bits[1], count);
+  start = bench_now();
+  for (size_t i = 0; i < count; i += 2) {
+    bitset_set(&bits[0], i);
+  }
+  for (size_t i = 0; i < count; i += 3) {
+    bitset_set(&bits[1], i);
+  }
+  bench_report("1e9 flags, bitset set", count / 2 + count / 3,
+               bench_now() - start);
+  start = bench_now();
+  bitset_and(&bits[0], &bits[1]);
+  bench_report("1e9 flags, bitset and", count, bench_now() - start);
+  start = bench_now();
+  result += bitset_count(&bits[0]);
+  bench_report("1e9 flags, bitset count", count, bench_now() - start);
+  start = bench_now();
+  bitset_build_index(&bits[0]);
+  bench_report("1e9 flags, bitset build rank/select index", count,
+               bench_now() - start);
+  start = bench_now();
+  for (size_t i = 0; i < bench_items; ++i) {
+    result += bitset_select(&bits[0], i * 16);
+  }
+  bench_report("1e9 flags, bitset select", bench_items, bench_now() - start);
+  bitset_destroy(&bits[0]);
+  bitset_destroy(&bits[1]);
+  printf("        checksum %zu\n", result);
+}
+
+// Search a vector of 4000 items for a key which isn't in it, with the
+// usual vector_get() + memcmp() loop and with vector_find().
+static void bench_vector_find(size_t item_size) {
+  size_t count = 4000;
+  size_t searches = bench_items / 100;
+  size_t checksum = 0;
+  uint8_t key[8];
+  char name[64];
+  VECTOR vec;
+
+  memset(key, 0xff, sizeof(key));
+  vector_init(&vec, item_size, count);
+  for (size_t i = 0; i < count; ++i) {
+    uint64_t item = i % 251;
+    vector_push(&vec, &item, item_size);
+  }
+  double start = bench_now();
+  for (size_t i = 0; i < searches; ++i) {
+    size_t j = 0;
+    for (; j < count; ++j) {
+      if (memcmp(vector_get(&vec, j), key, item_size) == 0) {
+        break;
+      }
+    }
+    checksum += j;
+  }
+  snprintf(name, sizeof(name), "vector_get() + memcmp() scan, %zu byte items",
+           item_size);
+  bench_report(name, searches * count, bench_now() - start);
+  start = bench_now();
+  for (size_t i = 0; i < searches; ++i) {
+    checksum += vector_find(&vec, key, 0);
+  }
+  snprintf(name, sizeof(name), "vector_find(), %zu byte items", item_size);
+  bench_report(name, searches * count, bench_now() - start);
+  start = bench_now();
+  for (size_t i = 0; i < searches; ++i) {
+    checksum += vector_count(&vec, key);
+  }
+  snprintf(name, sizeof(name), "vector_count(), %zu byte items", item_size);
+  bench_report(name, searches * count, bench_now() - start);
+  vector_destroy(&vec);
+  printf("        checksum %zu\n", checksum);
+}
+
+PQUEUE_DEFINE(bench_heap_2, uint64_t, 2, BENCH_LESS)
+PQUEUE_DEFINE(bench_heap_4, uint64_t, 4, BENCH_LESS)
+PQUEUE_DEFINE(bench_heap_8, uint64_t, 8, BENCH_LESS)
+
+// Heapify count random keys and pop all of them, with the generic PQUEUE and
+// the typed heaps, for binary, 4-ary and 8-ary heaps.
+static void bench_pqueue(size_t count) {
+  char name[64];
+  uint64_t checksum = 0;
+  uint64_t value;
+  VECTOR vec;
+  PQUEUE pq;
+
+  for (size_t arity = 2; arity <= 8; arity *= 2) {
+    vector_init(&vec, sizeof(uint64_t), count);
+    bench_random_fill(&vec, count);
+    pqueue_heapify(&pq, &vec, arity, bench_compare);
+    double start = bench_now();
+    while (pqueue_pop(&pq, &value) == SUCCESS) {
+      checksum += value;
+    }
+    snprintf(name, sizeof(name), "pqueue_pop(), %zu-ary, %zu items", arity,
+             count);
+    bench_report(name, count, bench_now() - start);
+    pqueue_destroy(&pq);
+  }
+
+  vector_init(&vec, sizeof(uint64_t), count);
+  for (size_t arity = 2; arity <= 8; arity *= 2) {
+    bench_random_fill(&vec, count);
+    double start = bench_now();
+    switch (arity) {
+      case 2:
+        bench_heap_2_heapify(&vec, NULL);
+        while (bench_heap_2_pop(&vec, &value, NULL) == SUCCESS) {
+          checksum += value;
+        }
+        break;
+      case 4:
+        bench_heap_4_heapify(&vec, NULL);
+        while (bench_heap_4_pop(&vec, &value, NULL) == SUCCESS) {
+          checksum += value;
+        }
+        break;
+      default:
+        bench_heap_8_heapify(&vec, NULL);
+        while (bench_heap_8_pop(&vec, &value, NULL) == SUCCESS) {
+          checksum += value;
+        }
+    }
+    snprintf(name, sizeof(name), "PQUEUE_DEFINE() pop, %zu-ary, %zu items",
+             arity, count);
+    bench_report(name, count, bench_now() - start);
+  }
+  vector_destroy(&vec);
+  printf("        checksum %zu\n", (size_t)checksum);
+}
+
+typedef struct BENCH_INGEST_ {
+  CVECTOR cvec;
+  VECTOR vec;
+  pthread_mutex_t lock;
+  size_t items_per_thread;
+} BENCH_INGEST;
+
+static void *bench_ingest_locked(void *arg) {
+  BENCH_INGEST *ingest = arg;
+  for (size_t i = 0; i < ingest->items_per_thread; ++i) {
+    pthread_mutex_lock(&ingest->lock);
+    vector_push(&ingest->vec, &i, sizeof(i));
+    pthread_mutex_unlock(&ingest->lock);
+  }
+  return NULL;
+}
+
+static void *bench_ingest_lockfree(void *arg) {
+  BENCH_INGEST *ingest = arg;
+  for (size_t i = 0; i < ingest->items_per_thread; ++i) {
+    cvector_push(&ingest->cvec, &i, sizeof(i));
+  }
+  return NULL;
+}
+
+// Push bench_items from a number of threads into a mutex protected VECTOR
+// or a CVECTOR.
+static void bench_ingest(size_t num_threads, bool lockfree) {
+  pthread_t threads[64];
+  BENCH_INGEST ingest;
+  char name[64];
+
+  ingest.items_per_thread = bench_items / num_threads;
+  pthread_mutex_init(&ingest.lock, NULL);
+  vector_init(&ingest.vec, sizeof(size_t), VECTOR_DEFAULT_SIZE);
+  cvector_init(&ingest.cvec, sizeof(size_t), VECTOR_DEFAULT_SIZE);
+  double start = bench_now();
+  for (size_t i = 0; i < num_threads; ++i) {
+    pthread_create(&threads[i], NULL,
+                   lockfree ? bench_ingest_lockfree : bench_ingest_locked,
+                   &ingest);
+  }
+  for (size_t i = 0; i < num_threads; ++i) {
+    pthread_join(threads[i], NULL);
+  }
+  snprintf(name, sizeof(name), "%s push, %zu threads",
+           lockfree ? "cvector" : "mutex + vector", num_threads);
+  bench_report(name, ingest.items_per_thread * num_threads,
+               bench_now() - start);
+  cvector_destroy(&ingest.cvec);
+  vector_destroy(&ingest.vec);
+  pthread_mutex_destroy(&ingest.lock);
+}
+
+// Hot path cost and log volume of binary logging compared to formatting
+// every message.
+static void bench_binlog(void) {
+  size_t count = bench_items / 10;
+  char path[] = "/tmp/cutil_bench_XXXXXX";
+  LOCAL_FD int fd = mkstemp(path);
+  char line[LOG_RECORD_SIZE];
+  size_t text_size = 0;
+
+  double start = bench_now();
+  for (size_t i = 0; i < count; ++i) {
+    text_size += snprintf(line, sizeof(line),
+                          "[+] request %zu served in %d us from %s\n", i, 42,
+                          "10.0.0.1");
+  }
+  bench_report("snprintf() of a log message", count, bench_now() - start);
+
+  binlog_open(path);
+  start = bench_now();
+  for (size_t i = 0; i < count; ++i) {
+    BINLOG(LL_LOG, "request %zu served in %d us from %s", i, 42, "10.0.0.1");
+  }
+  binlog_close();
+  bench_report("BINLOG() of a log message, to a file", count,
+               bench_now() - start);
+
+  struct stat info;
+  fstat(fd, &info);
+  printf("        %zu bytes binary, %zu bytes text\n", (size_t)info.st_size,
+         text_size);
+  unlink(path);
+}
+
+// An error in a tight loop, logged without limits, rate limited and
+// sampled. Messages go to /dev/null in async mode.
+static void bench_log_flood(void) {
+  size_t count = bench_items / 10;
+  LOCAL_FD int null_fd = open("/dev/null", O_WRONLY);
+
+  log_async_start(null_fd, 0, LOG_BLOCK);
+  double start = bench_now();
+  for (size_t i = 0; i < count; ++i) {
+    log_print(LL_LOG, "connection %zu refused", i);
+  }
+  log_flush();
+  bench_report("error flood, log_print()", count, bench_now() - start);
+
+  start = bench_now();
+  for (size_t i = 0; i < bench_items; ++i) {
+    LOG_RATELIMITED(LL_LOG, 10, "connection %zu refused", i);
+  }
+  log_flush();
+  bench_report("error flood, LOG_RATELIMITED() 10/s", bench_items,
+               bench_now() - start);
+
+  start = bench_now();
+  for (size_t i = 0; i < bench_items; ++i) {
+    LOG_SAMPLED(LL_LOG, 1000, "connection %zu refused", i);
+  }
+  log_flush();
+  bench_report("error flood, LOG_SAMPLED() 1 in 1000", bench_items,
+               bench_now() - start);
+  log_async_stop();
+}
+
+// Cost of debug messages while log_level is LL_LOG.
+static void bench_log_disabled(void) {
+  size_t sum = 0;
+  double start = bench_now();
+  for (size_t i = 0; i < bench_items; ++i) {
+    log_print(LL_DBG, "item %zu of %zu, sum %zu", i, bench_items, sum);
+    sum += i;
+  }
+  bench_report("disabled log_print(LL_DBG)", bench_items,
+               bench_now() - start);
+
+  start = bench_now();
+  for (size_t i = 0; i < bench_items; ++i) {
+    LOG_DBG("item %zu of %zu, sum %zu", i, bench_items, sum);
+    sum += i;
+  }
+  bench_report("disabled LOG_DBG()", bench_items, bench_now() - start);
+  printf("        checksum %zu\n", sum);
+}
+
+#define BENCH_LOG_THREADS 4
+#define BENCH_LOG_MESSAGES 100000
+
+// Logs messages and records how long every log_print() call took.
+static void *bench_log_thread(void *arg) {
+  uint64_t *latencies = arg;
+  for (size_t i = 0; i < BENCH_LOG_MESSAGES; ++i) {
+    double start = bench_now();
+    log_print(LL_LOG, "request %zu served in %d us from %s", i, 42,
+              "10.0.0.1");
+    latencies[i] = bench_now() - start;
+  }
+  return NULL;
+}
+
+// Latency of log_print() calls from several threads, written to /dev/null
+// either through line buffered stdout or in async mode.
+static void bench_log(bool async) {
+  pthread_t threads[BENCH_LOG_THREADS];
+  size_t count = BENCH_LOG_THREADS * BENCH_LOG_MESSAGES;
+  uint64_t *latencies = malloc(count * sizeof(uint64_t));
+  LOCAL_FD int null_fd = open("/dev/null", O_WRONLY);
+  char name[64];
+
+  fflush(stdout);
+  LOCAL_FD int stdout_fd = dup(STDOUT_FILENO);
+  if (async) {
+    log_async_start(null_fd, 0, LOG_BLOCK);
+  } else {
+    dup2(null_fd, STDOUT_FILENO);
+    setvbuf(stdout, NULL, _IOLBF, BUFSIZ);
+  }
+  double start = bench_now();
+  for (size_t i = 0; i < BENCH_LOG_THREADS; ++i) {
+    pthread_create(&threads[i], NULL, bench_log_thread,
+                   latencies + i * BENCH_LOG_MESSAGES);
+  }
+  for (size_t i = 0; i < BENCH_LOG_THREADS; ++i) {
+    pthread_join(threads[i], NULL);
+  }
+  log_flush();
+  double elapsed = bench_now() - start;
+  if (async) {
+    log_async_stop();
+  } else {
+    dup2(stdout_fd, STDOUT_FILENO);
+    setvbuf(stdout, NULL, _IOFBF, BUFSIZ);
+  }
+
+  snprintf(name, sizeof(name), "log_print(), %zu threads, %s",
+           (size_t)BENCH_LOG_THREADS, async ? "async" : "stdout");
+  bench_report(name, count, elapsed);
+  qsort(latencies, count, sizeof(uint64_t), bench_compare);
+  printf("        p50 %" PRIu64 " ns, p99 %" PRIu64 " ns, p99.9 %" PRIu64
+         " ns, max %" PRIu64 " ns\n", latencies[count / 2],
+         latencies[count * 99 / 100], latencies[count * 999 / 1000],
+         latencies[count - 1]);
+  free(latencies);
+}
+
+typedef struct BENCH_NODES_ {
+  POOL pool;
+  bool use_pool;
+  size_t rounds;
+} BENCH_NODES;
+
+// Allocate and free 100 list nodes at a time, like a thread building and
+// tearing down small linked structures.
+static void *bench_nodes_thread(void *arg) {
+  BENCH_NODES *nodes = arg;
+  void *objects[100];
+  for (size_t round = 0; round < nodes->rounds; ++round) {
+    for (size_t i = 0; i < ARRAYSIZE(objects); ++i) {
+      objects[i] = nodes->use_pool ? pool_alloc(&nodes->pool) : malloc(48);
+      *(size_t *)objects[i] = i;
+    }
+    for (size_t i = 0; i < ARRAYSIZE(objects); ++i) {
+      if (nodes->use_pool) {
+        pool_free(&nodes->pool, objects[i]);
+      } else {
+        free(objects[i]);
+      }
+    }
+  }
+  return NULL;
+}
+
+// Allocate and free 48 byte objects from a number of threads with malloc()
+// or a POOL.
+static void bench_pool(size_t num_threads, bool use_pool) {
+  pthread_t threads[64];
+  BENCH_NODES nodes;
+  char name[64];
+
+  nodes.use_pool = use_pool;
+  nodes.rounds = bench_items / 100 / num_threads;
+  pool_init(&nodes.pool, 48);
+  double start = bench_now();
+  for (size_t i = 0; i < num_threads; ++i) {
+    pthread_create(&threads[i], NULL, bench_nodes_thread, &nodes);
+  }
+  for (size_t i = 0; i < num_threads; ++i) {
+    pthread_join(threads[i], NULL);
+  }
+  snprintf(name, sizeof(name), "%s alloc/free, %zu threads",
+           use_pool ? "pool" : "malloc", num_threads);
+  bench_report(name, 2 * 100 * nodes.rounds * num_threads,
+               bench_now() - start);
+  pool_destroy(&nodes.pool);
+}
+
+typedef struct BENCH_HANDOFF_ {
+  SPSC_RING spsc[2];
+  MPMC_RING mpmc[2];
+  bool use_mpmc;
+  size_t batch;
+} BENCH_HANDOFF;
+
+// Push count items from a contiguous array, yielding while the ring is full.
+static void bench_ring_push(BENCH_HANDOFF *handoff, size_t ring,
+                            const size_t *values, size_t count) {
+  while (count) {
+    size_t pushed = handoff->use_mpmc ?
+        mpmc_ring_push_n(&handoff->mpmc[ring], values, count, sizeof(size_t)) :
+        spsc_ring_push_n(&handoff->spsc[ring], values, count, sizeof(size_t));
+    if (pushed == 0) {
+      sched_yield();
+    }
+    values += pushed;
+    count -= pushed;
+  }
+}
+
+static void bench_ring_pop(BENCH_HANDOFF *handoff, size_t ring,
+                           size_t *values, size_t count) {
+  while (count) {
+    size_t popped = handoff->use_mpmc ?
+        mpmc_ring_pop_n(&handoff->mpmc[ring], values, count) :
+        spsc_ring_pop_n(&handoff->spsc[ring], values, count);
+    if (popped == 0) {
+      sched_yield();
+    }
+    values += popped;
+    count -= popped;
+  }
+}
+
+static void *bench_handoff_consumer(void *arg) {
+  BENCH_HANDOFF *handoff = arg;
+  size_t values[64];
+  for (size_t i = 0; i < bench_items; i += handoff->batch) {
+    bench_ring_pop(handoff, 0, values, handoff->batch);
+  }
+  return NULL;
+}
+
+// Echo every item from the first ring back through the second one.
+static void *bench_handoff_echo(void *arg) {
+  BENCH_HANDOFF *handoff = arg;
+  size_t value;
+  for (size_t i = 0; i < bench_items / 100; ++i) {
+    bench_ring_pop(handoff, 0, &value, 1);
+    bench_ring_push(handoff, 1, &value, 1);
+  }
+  return NULL;
+}
+
+// Measure the throughput of handing items to another thread in batches,
+// and the latency as half of the round trip through two rings.
+static void bench_handoff(bool use_mpmc, size_t batch) {
+  BENCH_HANDOFF handoff = {.use_mpmc = use_mpmc, .batch = batch};
+  size_t values[64] = {0};
+  pthread_t thread;
+  char name[64];
+
+  for (size_t i = 0; i < 2; ++i) {
+    spsc_ring_init(&handoff.spsc[i], sizeof(size_t), 1024);
+    mpmc_ring_init(&handoff.mpmc[i], sizeof(size_t), 1024);
+  }
+  pthread_create(&thread, NULL, bench_handoff_consumer, &handoff);
+  double start = bench_now();
+  for (size_t i = 0; i < bench_items; i += batch) {
+    bench_ring_push(&handoff, 0, values, batch);
+  }
+  pthread_join(thread, NULL);
+  snprintf(name, sizeof(name), "%s handoff, batches of %zu",
+           use_mpmc ? "mpmc_ring" : "spsc_ring", batch);
+  bench_report(name, bench_items, bench_now() - start);
+
+  if (batch == 1) {
+    pthread_create(&thread, NULL, bench_handoff_echo, &handoff);
+    start = bench_now();
+    for (size_t i = 0; i < bench_items / 100; ++i) {
+      bench_ring_push(&handoff, 0, values, 1);
+      bench_ring_pop(&handoff, 1, values, 1);
+    }
+    pthread_join(thread, NULL);
+    snprintf(name, sizeof(name), "%s one way latency",
+             use_mpmc ? "mpmc_ring" : "spsc_ring");
+    bench_report(name, 2 * (bench_items / 100), bench_now() - start);
+  }
+  for (size_t i = 0; i < 2; ++i) {
+    spsc_ring_destroy(&handoff.spsc[i]);
+    mpmc_ring_destroy(&handoff.mpmc[i]);
+  }
+}
+
+// Number of items in the vectors of the benchmarks below which work on a
+// vector of a fixed size.
+static const size_t bench_vector_size = 1024;
+
+// Fill the vector with the numbers 0 to count - 1.
+static void bench_fill(VECTOR *vec, size_t count) {
+  vec->used_bytes = 0;
+  for (size_t i = 0; i < count; ++i) {
+    vector_push(vec, &i, sizeof(i));
+  }
+}
+
+static void bench_vector_init_destroy(size_t iterations) {
+  for (size_t i = 0; i < iterations; ++i) {
+    VECTOR vec;
+    vector_init(&vec, sizeof(size_t), VECTOR_DEFAULT_SIZE);
+    BENCH_DO_NOT_OPTIMIZE(vec.data);
+    vector_destroy(&vec);
+  }
+}
+
+// The per-element loop from vector_test_lots_ints().
+static void bench_vector_push(size_t iterations) {
+  VECTOR vec;
+
+  bench_pause();
+  vector_init(&vec, sizeof(size_t), VECTOR_DEFAULT_SIZE);
+  bench_resume();
+  for (size_t i = 0; i < iterations; ++i) {
+    BENCH_DO_NOT_OPTIMIZE(vector_push(&vec, &i, sizeof(i)));
+  }
+  bench_pause();
+  vector_destroy(&vec);
+}
+
+static void bench_vector_reserve_push(size_t iterations) {
+  VECTOR vec;
+
+  bench_pause();
+  vector_init(&vec, sizeof(size_t), VECTOR_DEFAULT_SIZE);
+  bench_resume();
+  vector_reserve(&vec, iterations);
+  for (size_t i = 0; i < iterations; ++i) {
+    BENCH_DO_NOT_OPTIMIZE(vector_push(&vec, &i, sizeof(i)));
+  }
+  bench_pause();
+  vector_destroy(&vec);
+}
+
+static void bench_vector_push_new(size_t iterations) {
+  VECTOR vec;
+
+  bench_pause();
+  vector_init(&vec, sizeof(size_t), VECTOR_DEFAULT_SIZE);
+  bench_resume();
+  for (size_t i = 0; i < iterations; ++i) {
+    *(size_t *)vector_push_new(&vec, sizeof(size_t)) = i;
+  }
+  bench_pause();
+  vector_destroy(&vec);
+}
+
+// Append blocks of 64 items.
+static void bench_vector_push_n(size_t iterations) {
+  size_t values[64];
+  VECTOR vec;
+
+  bench_pause();
+  for (size_t i = 0; i < ARRAYSIZE(values); ++i) {
+    values[i] = i;
+  }
+  vector_init(&vec, sizeof(size_t), VECTOR_DEFAULT_SIZE);
+  bench_resume();
+  for (size_t i = 0; i < iterations; ++i) {
+    BENCH_DO_NOT_OPTIMIZE(vector_push_n(&vec, values, ARRAYSIZE(values),
+                                        sizeof(size_t)));
+  }
+  bench_pause();
+  vector_destroy(&vec);
+}
+
+// Append a vector of 64 items.
+static void bench_vector_extend(size_t iterations) {
+  VECTOR vec, other;
+
+  bench_pause();
+  vector_init(&vec, sizeof(size_t), VECTOR_DEFAULT_SIZE);
+  vector_init(&other, sizeof(size_t), VECTOR_DEFAULT_SIZE);
+  bench_fill(&other, 64);
+  bench_resume();
+  for (size_t i = 0; i < iterations; ++i) {
+    vector_extend(&vec, &other);
+  }
+  bench_pause();
+  vector_destroy(&vec);
+  vector_destroy(&other);
+}
+
+// Insert an item into the middle of a vector of bench_vector_size items and
+// pop the last one, so the size stays the same.
+static void bench_vector_insert_n(size_t iterations) {
+  VECTOR vec;
+
+  bench_pause();
+  vector_init(&vec, sizeof(size_t), bench_vector_size + 1);
+  bench_fill(&vec, bench_vector_size);
+  bench_resume();
+  for (size_t i = 0; i < iterations; ++i) {
+    vector_insert_n(&vec, bench_vector_size / 2, &i, 1, sizeof(i));
+    vector_pop(&vec);
+  }
+  bench_pause();
+  vector_destroy(&vec);
+}
+
+static void bench_vector_pop(size_t iterations) {
+  VECTOR vec;
+
+  bench_pause();
+  vector_init(&vec, sizeof(size_t), VECTOR_DEFAULT_SIZE);
+  bench_fill(&vec, iterations);
+  bench_resume();
+  for (size_t i = 0; i < iterations; ++i) {
+    vector_pop(&vec);
+  }
+  bench_pause();
+  vector_destroy(&vec);
+}
+
+static void bench_vector_pop_copy(size_t iterations) {
+  VECTOR vec;
+
+  bench_pause();
+  vector_init(&vec, sizeof(size_t), VECTOR_DEFAULT_SIZE);
+  bench_fill(&vec, iterations);
+  bench_resume();
+  for (size_t i = 0; i < iterations; ++i) {
+    free(vector_pop_copy(&vec));
+  }
+  bench_pause();
+  vector_destroy(&vec);
+}
+
+// Delete an item from the middle of a vector of bench_vector_size items and
+// push a new one, so the size stays the same.
+static void bench_vector_del(size_t iterations) {
+  VECTOR vec;
+
+  bench_pause();
+  vector_init(&vec, sizeof(size_t), bench_vector_size);
+  bench_fill(&vec, bench_vector_size);
+  bench_resume();
+  for (size_t i = 0; i < iterations; ++i) {
+    vector_del(&vec, bench_vector_size / 2);
+    vector_push(&vec, &i, sizeof(i));
+  }
+  bench_pause();
+  vector_destroy(&vec);
+}
+
+static void bench_vector_del_copy(size_t iterations) {
+  VECTOR vec;
+
+  bench_pause();
+  vector_init(&vec, sizeof(size_t), bench_vector_size);
+  bench_fill(&vec, bench_vector_size);
+  bench_resume();
+  for (size_t i = 0; i < iterations; ++i) {
+    free(vector_del_copy(&vec, bench_vector_size / 2));
+    vector_push(&vec, &i, sizeof(i));
+  }
+  bench_pause();
+  vector_destroy(&vec);
+}
+
+static void bench_vector_swap_remove(size_t iterations) {
+  VECTOR vec;
+
+  bench_pause();
+  vector_init(&vec, sizeof(size_t), VECTOR_DEFAULT_SIZE);
+  bench_fill(&vec, iterations);
+  bench_resume();
+  for (size_t i = 0; i < iterations; ++i) {
+    vector_swap_remove(&vec, 0);
+  }
+  bench_pause();
+  vector_destroy(&vec);
+}
+
+static bool bench_is_odd(const void *element, void *ctx) {
+  (void)ctx;
+  return *(const size_t *)element & 1;
+}
+
+// Remove every other item from a vector of bench_vector_size items.
+static void bench_vector_remove_if(size_t iterations) {
+  VECTOR vec;
+
+  bench_pause();
+  vector_init(&vec, sizeof(size_t), bench_vector_size);
+  for (size_t i = 0; i < iterations; ++i) {
+    bench_fill(&vec, bench_vector_size);
+    bench_resume();
+    vector_remove_if(&vec, bench_is_odd, NULL);
+    bench_pause();
+  }
+  vector_destroy(&vec);
+}
+
+// Give back the unused half of a vector of bench_vector_size items.
+static void bench_vector_shrink_to_fit(size_t iterations) {
+  VECTOR vec;
+
+  bench_pause();
+  vector_init_policy(&vec, sizeof(size_t), VECTOR_DEFAULT_SIZE,
+                     VECTOR_POLICY_NEVER_SHRINK);
+  bench_fill(&vec, bench_vector_size);
+  for (size_t i = 0; i < iterations; ++i) {
+    vector_reserve(&vec, 2 * bench_vector_size);
+    bench_resume();
+    vector_shrink_to_fit(&vec);
+    bench_pause();
+  }
+  vector_destroy(&vec);
+}
+
+// Read items of a vector of bench_vector_size items in a strided order.
+static void bench_vector_get(size_t iterations) {
+  size_t sum = 0;
+  VECTOR vec;
+
+  bench_pause();
+  vector_init(&vec, sizeof(size_t), bench_vector_size);
+  bench_fill(&vec, bench_vector_size);
+  bench_resume();
+  for (size_t i = 0; i < iterations; ++i) {
+    sum += *(size_t *)vector_get(&vec, (i * 7919) % bench_vector_size);
+  }
+  bench_pause();
+  BENCH_DO_NOT_OPTIMIZE(sum);
+  vector_destroy(&vec);
+}
+
+static void bench_vector_ptr(size_t iterations) {
+  size_t sum = 0;
+  VECTOR vec;
+
+  bench_pause();
+  vector_init(&vec, sizeof(size_t), bench_vector_size);
+  bench_fill(&vec, bench_vector_size);
+  bench_resume();
+  for (size_t i = 0; i < iterations; ++i) {
+    sum += *(size_t *)vector_ptr(&vec, (i * 7919) % bench_vector_size);
+  }
+  bench_pause();
+  BENCH_DO_NOT_OPTIMIZE(sum);
+  vector_destroy(&vec);
+}
+
+// Sort bench_vector_size random keys with the given sort.
+static void bench_sort(size_t iterations, void (*sort)(VECTOR *vec)) {
+  VECTOR vec;
+
+  bench_pause();
+  vector_init(&vec, sizeof(uint64_t), bench_vector_size);
+  for (size_t i = 0; i < iterations; ++i) {
+    bench_random_fill(&vec, bench_vector_size);
+    bench_resume();
+    sort(&vec);
+    bench_pause();
+  }
+  vector_destroy(&vec);
+}
+
+static void bench_sort_comparator(VECTOR *vec) {
+  vector_sort(vec, bench_compare);
+}
+
+static void bench_sort_typed(VECTOR *vec) {
+  bench_sort_u64(vec, NULL);
+}
+
+static void bench_sort_radix(VECTOR *vec) {
+  vector_radix_sort(vec, 0, sizeof(uint64_t));
+}
+
+static void bench_vector_sort_1k(size_t iterations) {
+  bench_sort(iterations, bench_sort_comparator);
+}
+
+static void bench_vector_sort_define_1k(size_t iterations) {
+  bench_sort(iterations, bench_sort_typed);
+}
+
+static void bench_vector_radix_sort_1k(size_t iterations) {
+  bench_sort(iterations, bench_sort_radix);
+}
+
+// Look up keys in a sorted vector of bench_vector_size items.
+static void bench_vector_lower_bound(size_t iterations) {
+  size_t sum = 0;
+  VECTOR vec;
+
+  bench_pause();
+  vector_init(&vec, sizeof(uint64_t), bench_vector_size);
+  bench_fill(&vec, bench_vector_size);
+  bench_resume();
+  for (size_t i = 0; i < iterations; ++i) {
+    uint64_t key = (i * 7919) % bench_vector_size;
+    sum += vector_lower_bound(&vec, &key, bench_compare);
+  }
+  bench_pause();
+  BENCH_DO_NOT_OPTIMIZE(sum);
+  vector_destroy(&vec);
+}
+
+static void bench_vector_bsearch(size_t iterations) {
+  VECTOR vec;
+
+  bench_pause();
+  vector_init(&vec, sizeof(uint64_t), bench_vector_size);
+  bench_fill(&vec, bench_vector_size);
+  bench_resume();
+  for (size_t i = 0; i < iterations; ++i) {
+    uint64_t key = (i * 7919) % bench_vector_size;
+    BENCH_DO_NOT_OPTIMIZE(vector_bsearch(&vec, &key, bench_compare));
+  }
+  bench_pause();
+  vector_destroy(&vec);
+}
+
+// Scan a vector of bench_vector_size 4 byte items for a key which is in it
+// once, at the end, with vector_find() (kind 0), vector_count() (kind 1) or
+// vector_find_all() (kind 2).
+static void bench_scan(size_t iterations, int kind) {
+  uint32_t key = bench_vector_size;
+  VECTOR indices;
+  VECTOR vec;
+
+  bench_pause();
+  vector_init(&vec, sizeof(uint32_t), bench_vector_size);
+  vector_init(&indices, sizeof(size_t), VECTOR_DEFAULT_SIZE);
+  for (uint32_t i = 1; i <= bench_vector_size; ++i) {
+    vector_push(&vec, &i, sizeof(i));
+  }
+  bench_resume();
+  for (size_t i = 0; i < iterations; ++i) {
+    if (kind == 0) {
+      BENCH_DO_NOT_OPTIMIZE(vector_find(&vec, &key, 0));
+    } else if (kind == 1) {
+      BENCH_DO_NOT_OPTIMIZE(vector_count(&vec, &key));
+    } else {
+      indices.used_bytes = 0;
+      vector_find_all(&vec, &key, &indices);
+    }
+  }
+  bench_pause();
+  vector_destroy(&indices);
+  vector_destroy(&vec);
+}
+
+static void bench_vector_find_1k(size_t iterations) {
+  bench_scan(iterations, 0);
+}
+
+static void bench_vector_count_1k(size_t iterations) {
+  bench_scan(iterations, 1);
+}
+
+static void bench_vector_find_all_1k(size_t iterations) {
+  bench_scan(iterations, 2);
+}
+
+VECTOR_DEFINE(bench_u64_vec, uint64_t)
+
+static void bench_typed_push(size_t iterations) {
+  bench_u64_vec vec;
+
+  bench_pause();
+  bench_u64_vec_init(&vec, VECTOR_DEFAULT_SIZE);
+  bench_resume();
+  for (size_t i = 0; i < iterations; ++i) {
+    BENCH_DO_NOT_OPTIMIZE(bench_u64_vec_push(&vec, i));
+  }
+  bench_pause();
+  bench_u64_vec_destroy(&vec);
+}
+
+static void bench_typed_get(size_t iterations) {
+  uint64_t sum = 0;
+  bench_u64_vec vec;
+
+  bench_pause();
+  bench_u64_vec_init(&vec, bench_vector_size);
+  bench_fill(&vec.vec, bench_vector_size);
+  bench_resume();
+  for (size_t i = 0; i < iterations; ++i) {
+    sum += *bench_u64_vec_get(&vec, (i * 7919) % bench_vector_size);
+  }
+  bench_pause();
+  BENCH_DO_NOT_OPTIMIZE(sum);
+  bench_u64_vec_destroy(&vec);
+}
+
+static void bench_typed_pop(size_t iterations) {
+  uint64_t sum = 0;
+  uint64_t value = 0;
+  bench_u64_vec vec;
+
+  bench_pause();
+  bench_u64_vec_init(&vec, VECTOR_DEFAULT_SIZE);
+  bench_fill(&vec.vec, iterations);
+  bench_resume();
+  for (size_t i = 0; i < iterations; ++i) {
+    if (bench_u64_vec_pop(&vec, &value) == SUCCESS) {
+      sum += value;
+    }
+  }
+  bench_pause();
+  BENCH_DO_NOT_OPTIMIZE(sum);
+  bench_u64_vec_destroy(&vec);
+}
+
+// Create a vector, push 8 items and destroy it.
+static void bench_small_vector_8(size_t iterations) {
+  for (size_t i = 0; i < iterations; ++i) {
+    SMALL_VECTOR(size_t, 8) svec;
+    SMALL_VECTOR_INIT(&svec);
+    for (size_t j = 0; j < 8; ++j) {
+      vector_push(&svec.vec, &j, sizeof(j));
+    }
+    BENCH_DO_NOT_OPTIMIZE(svec.vec.data);
+    vector_destroy(&svec.vec);
+  }
+}
+
+static void bench_vector_arena_8(size_t iterations) {
+  ARENA arena;
+
+  bench_pause();
+  arena_init(&arena, ARENA_DEFAULT_CHUNK_SIZE);
+  bench_resume();
+  for (size_t i = 0; i < iterations; ++i) {
+    ARENA_MARK mark = arena_mark(&arena);
+    VECTOR vec;
+    vector_init_arena(&vec, sizeof(size_t), VECTOR_DEFAULT_SIZE, &arena);
+    for (size_t j = 0; j < 8; ++j) {
+      vector_push(&vec, &j, sizeof(j));
+    }
+    BENCH_DO_NOT_OPTIMIZE(vec.data);
+    vector_destroy(&vec);
+    arena_rewind(&mark);
+  }
+  bench_pause();
+  arena_destroy(&arena);
+}
+
+static void bench_vector_mmap_push(size_t iterations) {
+  VECTOR vec;
+
+  bench_pause();
+  vector_init_mmap(&vec, sizeof(size_t), VECTOR_DEFAULT_SIZE, false);
+  bench_resume();
+  for (size_t i = 0; i < iterations; ++i) {
+    BENCH_DO_NOT_OPTIMIZE(vector_push(&vec, &i, sizeof(i)));
+  }
+  bench_pause();
+  vector_destroy(&vec);
+}
+
+// Save a vector of bench_vector_size items and map it again as a view.
+static void bench_vector_save_view(size_t iterations) {
+  char path[] = "/tmp/cutil_bench_XXXXXX";
+  VECTOR vec;
+
+  bench_pause();
+  close(mkstemp(path));
+  vector_init(&vec, sizeof(size_t), bench_vector_size);
+  bench_fill(&vec, bench_vector_size);
+  bench_resume();
+  for (size_t i = 0; i < iterations; ++i) {
+    VECTOR view;
+    vector_save(&vec, path);
+    LOCAL_MMAP MMAP_REGION region;
+    mmap_file(&region, path, false);
+    vector_init_view(&view, sizeof(size_t), &region);
+    BENCH_DO_NOT_OPTIMIZE(*(size_t *)vector_get(&view, 0));
+    vector_destroy(&view);
+  }
+  bench_pause();
+  vector_destroy(&vec);
+  unlink(path);
+}
+
+// Benchmarks for every VECTOR operation, run by benches_run().
+static void bench_vector_add_all(void) {
+  BENCH_ADD(bench_vector_init_destroy);
+  BENCH_ADD(bench_vector_push);
+  BENCH_ADD(bench_vector_reserve_push);
+  BENCH_ADD(bench_vector_push_new);
+  BENCH_ADD(bench_vector_push_n);
+  BENCH_ADD(bench_vector_extend);
+  BENCH_ADD(bench_vector_insert_n);
+  BENCH_ADD(bench_vector_pop);
+  BENCH_ADD(bench_vector_pop_copy);
+  BENCH_ADD(bench_vector_del);
+  BENCH_ADD(bench_vector_del_copy);
+  BENCH_ADD(bench_vector_swap_remove);
+  BENCH_ADD(bench_vector_remove_if);
+  BENCH_ADD(bench_vector_shrink_to_fit);
+  BENCH_ADD(bench_vector_get);
+  BENCH_ADD(bench_vector_ptr);
+  BENCH_ADD(bench_vector_sort_1k);
+  BENCH_ADD(bench_vector_sort_define_1k);
+  BENCH_ADD(bench_vector_radix_sort_1k);
+  BENCH_ADD(bench_vector_lower_bound);
+  BENCH_ADD(bench_vector_bsearch);
+  BENCH_ADD(bench_vector_find_1k);
+  BENCH_ADD(bench_vector_count_1k);
+  BENCH_ADD(bench_vector_find_all_1k);
+  BENCH_ADD(bench_typed_push);
+  BENCH_ADD(bench_typed_get);
+  BENCH_ADD(bench_typed_pop);
+  BENCH_ADD(bench_small_vector_8);
+  BENCH_ADD(bench_vector_arena_8);
+  BENCH_ADD(bench_vector_mmap_push);
+  BENCH_ADD(bench_vector_save_view);
+}
+
+int main(int argc, char **argv) {
+  BENCH_OPTIONS options = { .threshold = BENCH_DEFAULT_THRESHOLD };
+  bool workloads = true;
+
+  for (int i = 1; i < argc; ++i) {
+    if (strcmp(argv[i], "-m") == 0) {
+      workloads = false;
+    } else if (strcmp(argv[i], "-f") == 0 && i + 1 < argc) {
+      options.filter = argv[++i];
+      workloads = false;
+    } else if (strcmp(argv[i], "-j") == 0 && i + 1 < argc) {
+      options.json_path = argv[++i];
+    } else if (strcmp(argv[i], "-b") == 0 && i + 1 < argc) {
+      options.baseline_path = argv[++i];
+    } else if (strcmp(argv[i], "-t") == 0 && i + 1 < argc) {
+      options.threshold = strtod(argv[++i], NULL);
+    } else {
+      fprintf(stderr, "Usage: %s [-m] [-f filter] [-j results.json] "
+              "[-b baseline.json] [-t percent]\n", argv[0]);
+      return 1;
+    }
+  }
+
+  // Microbenchmarks, -f only runs the ones with the filter in their name,
+  // -j writes the results to a file and -b compares them with an earlier one.
+  bench_vector_add_all();
+  ERROR result = benches_run(&options);
+  // The workloads below compare whole implementations and print their own
+  // results, -m or -f skip them.
+  if (!workloads) {
+    return result == SUCCESS ? 0 : 1;
+  }
+
+  bench_vector_policy("push/pop at boundary, VECTOR_POLICY_DEFAULT",
+                      VECTOR_POLICY_DEFAULT);
+  bench_vector_policy("push/pop at boundary, VECTOR_POLICY_COMPACT",
+                      VECTOR_POLICY_COMPACT);
+  bench_vector_policy("push/pop at boundary, VECTOR_POLICY_NEVER_SHRINK",
+                      VECTOR_POLICY_NEVER_SHRINK);
+  bench_vector_small();
+  bench_arena();
+  bench_buffer();
+  bench_segvector();
+
+  VECTOR vec;
+  vector_init(&vec, 1, VECTOR_DEFAULT_SIZE);
+  bench_vector_huge("1e9 bytes, malloc backing", &vec);
+  vector_init_mmap(&vec, 1, VECTOR_DEFAULT_SIZE, false);
+  bench_vector_huge("1e9 bytes, mmap backing", &vec);
+  vector_init_mmap(&vec, 1, VECTOR_DEFAULT_SIZE, true);
+  bench_vector_huge("1e9 bytes, mmap backing with huge pages", &vec);
+
+  bench_vector_view();
+  for (size_t item_size = 1; item_size <= 8; item_size *= 2) {
+    bench_vector_find(item_size);
+  }
+  bench_bitset();
+
+  bench_pqueue(10000000);
+
+  bench_vector_sort(1000000);
+  bench_vector_sort(10000000);
+  bench_vector_sort(100000000);
+
+  for (size_t load_permille = 500; load_permille <= 875;
+       load_permille += 125) {
+    bench_hashmap(load_permille);
+  }
+
+  for (size_t threads = 1; threads <= 64; threads *= 2) {
+    bench_ingest(threads, false);
+    bench_ingest(threads, true);
+  }
+
+  for (size_t threads = 1; threads <= 16; threads *= 2) {
+    bench_pool(threads, false);
+    bench_pool(threads, true);
+  }
+
+  bench_log_disabled();
+  bench_binlog();
+  bench_log_flood();
+  bench_log(false);
+  bench_log(true);
+
+  bench_handoff(false, 1);
+  bench_handoff(false, 32);
+  bench_handoff(true, 1);
+  bench_handoff(true, 32);
+
+  return result == SUCCESS ? 0 : 1;
+}
@@ -0,0 +1,737 @@
+// Binary logging with deferred formatting.
+//
+// Author: Johannes Stüttgen (johannes.stuettgen@gmail.com)
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/uio.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "binlog.h"
+#include "buffer.h"
+#include "vector.h"
+
+// Size of the fixed part of a message record.
+#define BINLOG_MESSAGE_HEADER (1 + 4 + 8 + 4)
+
+// Upper bound of the fixed size parts of a message record, strings are
+// appended separately.
+#define BINLOG_MESSAGE_MAX (BINLOG_MESSAGE_HEADER + 16 * BINLOG_MAX_ARGS)
+
+// Size of the fixed part of a site record.
+#define BINLOG_SITE_HEADER (1 + 4 + 1 + 4)
+
+// Precision of a string argument taken from the preceding '*' argument.
+#define BINLOG_PRECISION_ARG -2
+
+// The buffer of one thread.
+typedef struct BINLOG_THREAD_ {
+  BUFFER buf;
+  struct BINLOG_THREAD_ *next;
+} BINLOG_THREAD;
+
+// The open log. The lock protects everything but generation, which is
+// written with the lock held but read without it.
+typedef struct BINLOG_ {
+  int fd;
+  size_t generation;  // Changes with every binlog_open(), 0 while closed
+  size_t opened;      // Number of binlog_open() calls so far
+  uint32_t next_id;
+  BINLOG_THREAD *threads;
+  pthread_key_t key;
+  pthread_mutex_t lock;
+} BINLOG;
+
+static BINLOG binlog = {
+  .fd = -1,
+  .lock = PTHREAD_MUTEX_INITIALIZER
+};
+
+// The buffer of the calling thread, if binlog_thread_generation is current.
+static __thread BINLOG_THREAD *binlog_thread;
+static __thread size_t binlog_thread_generation;
+
+// Write size bytes, retrying on partial writes.
+static ERROR binlog_write_all(int fd, const void *data, size_t size) {
+  const uint8_t *bytes = data;
+  while (size) {
+    ssize_t written = write(fd, bytes, size);
+    if (written < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return FAILURE;
+    }
+    bytes += written;
+    size -= written;
+  }
+  return SUCCESS;
+}
+
+// Add an argument of a conversion to the list of arguments.
+static bool binlog_add_arg(uint8_t *args, int *precision, size_t *count,
+                           BINLOG_ARG arg, int arg_precision) {
+  if (*count >= BINLOG_MAX_ARGS) {
+    return false;
+  }
+  args[*count] = arg;
+  precision[*count] = arg_precision;
+  (*count)++;
+  return true;
+}
+
+// Parse the conversion specification fmt points to, which starts with '%'.
+// The arguments it takes are added to args, precision and count. Returns a
+// pointer behind the conversion, or NULL if it is not supported.
+const char *binlog_conversion(const char *fmt, uint8_t *args,
+                              int *precision, size_t *count) {
+  const char *p = fmt + 1;
+  if (*p == '%') {
+    return p + 1;
+  }
+  while (*p && strchr("-+ #0'", *p)) {
+    p++;
+  }
+  if (*p == '*') {
+    if (!binlog_add_arg(args, precision, count, BINLOG_INT, -1)) {
+      return NULL;
+    }
+    p++;
+  } else {
+    while (*p >= '0' && *p <= '9') {
+      p++;
+    }
+    // Positional arguments like %1$s
+    if (*p == '$') {
+      return NULL;
+    }
+  }
+  int string_precision = -1;
+  if (*p == '.') {
+    p++;
+    if (*p == '*') {
+      if (!binlog_add_arg(args, precision, count, BINLOG_INT, -1)) {
+        return NULL;
+      }
+      string_precision = BINLOG_PRECISION_ARG;
+      p++;
+    } else {
+      string_precision = 0;
+      while (*p >= '0' && *p <= '9') {
+        if (string_precision < BINLOG_MAX_STRING) {
+          string_precision = string_precision * 10 + (*p - '0');
+        }
+        p++;
+      }
+    }
+  }
+  bool is_long = false;
+  bool is_long_double = false;
+  while (*p && strchr("hlLqjzt", *p)) {
+    if (*p == 'L') {
+      is_long_double = true;
+    } else if (*p != 'h') {
+      is_long = true;
+    }
+    p++;
+  }
+  BINLOG_ARG arg;
+  switch (*p) {
+    case 'c':
+      if (is_long) {
+        return NULL;
+      }
+      arg = BINLOG_INT;
+      break;
+
+    case 'd':
+    case 'i':
+    case 'o':
+    case 'u':
+    case 'x':
+    case 'X':
+      arg = is_long ? BINLOG_LONG : BINLOG_INT;
+      break;
+
+    case 'e':
+    case 'E':
+    case 'f':
+    case 'F':
+    case 'g':
+    case 'G':
+    case 'a':
+    case 'A':
+      arg = is_long_double ? BINLOG_LONG_DOUBLE : BINLOG_DOUBLE;
+      break;
+
+    case 'p':
+      arg = BINLOG_POINTER;
+      break;
+
+    case 's':
+      if (is_long) {
+        return NULL;
+      }
+      arg = BINLOG_STRING;
+      break;
+
+    default:
+      return NULL;
+  }
+  if (!binlog_add_arg(args, precision, count, arg,
+                      arg == BINLOG_STRING ? string_precision : -1)) {
+    return NULL;
+  }
+  return p + 1;
+}
+
+// Get the arguments a format string takes. Fails if the format string
+// isn't supported.
+ERROR binlog_parse(const char *fmt, uint8_t *args, int *precision,
+                   size_t *count) {
+  *count = 0;
+  while (*fmt) {
+    if (*fmt != '%') {
+      fmt++;
+      continue;
+    }
+    fmt = binlog_conversion(fmt, args, precision, count);
+    if (!fmt) {
+      return FAILURE;
+    }
+  }
+  return SUCCESS;
+}
+
+// Destructor of the thread specific key, writes and releases the buffer of
+// a thread when it exits.
+static void binlog_thread_exit(void *arg) {
+  binlog_thread_generation = 0;
+  pthread_mutex_lock(&binlog.lock);
+  for (BINLOG_THREAD **link = &binlog.threads; *link;
+       link = &(*link)->next) {
+    if (*link == arg) {
+      BINLOG_THREAD *thread = *link;
+      *link = thread->next;
+      buf_write(&thread->buf, binlog.fd);
+      buf_destroy(&thread->buf);
+      free(thread);
+      break;
+    }
+  }
+  pthread_mutex_unlock(&binlog.lock);
+}
+
+// Get the buffer of the calling thread, creating it when the thread logs
+// for the first time.
+static BINLOG_THREAD *binlog_thread_get(size_t generation) {
+  if (binlog_thread_generation == generation) {
+    return binlog_thread;
+  }
+  BINLOG_THREAD *thread = malloc(sizeof(*thread));
+  if (!thread) {
+    return NULL;
+  }
+  if (buf_init(&thread->buf, BINLOG_BUFFER_SIZE + BINLOG_MESSAGE_MAX) !=
+      SUCCESS) {
+    free(thread);
+    return NULL;
+  }
+  pthread_mutex_lock(&binlog.lock);
+  if (binlog.generation != generation) {
+    pthread_mutex_unlock(&binlog.lock);
+    buf_destroy(&thread->buf);
+    free(thread);
+    return NULL;
+  }
+  thread->next = binlog.threads;
+  binlog.threads = thread;
+  pthread_setspecific(binlog.key, thread);
+  pthread_mutex_unlock(&binlog.lock);
+  binlog_thread = thread;
+  binlog_thread_generation = generation;
+  return thread;
+}
+
+// Give a site an id in the open log and write its format string to the
+// file. The site record is written directly instead of through a thread
+// buffer, so it is in the file before any message which uses it.
+static ERROR binlog_register(BINLOG_SITE *site, size_t generation) {
+  ERROR result = SUCCESS;
+  pthread_mutex_lock(&binlog.lock);
+  if (binlog.generation != generation) {
+    result = FAILURE;
+  } else if (site->generation != generation) {
+    site->valid = binlog_parse(site->fmt, site->args, site->precision,
+                               &site->arg_count) == SUCCESS;
+    // Only sites in the file get an id, so the ids in the file have no
+    // gaps.
+    site->id = binlog.next_id + 1;
+    if (site->valid) {
+      uint8_t header[BINLOG_SITE_HEADER];
+      uint32_t length = strlen(site->fmt);
+      uint8_t level = site->level;
+      header[0] = BINLOG_RECORD_SITE;
+      memcpy(header + 1, &site->id, sizeof(site->id));
+      memcpy(header + 5, &level, sizeof(level));
+      memcpy(header + 6, &length, sizeof(length));
+      struct iovec iov[2] = {
+        { .iov_base = header, .iov_len = sizeof(header) },
+        { .iov_base = (void *)site->fmt, .iov_len = length }
+      };
+      // O_APPEND makes every writev() a single append.
+      if (writev(binlog.fd, iov, 2) == (ssize_t)(sizeof(header) + length)) {
+        binlog.next_id++;
+      } else {
+        site->valid = false;
+      }
+    }
+    __atomic_store_n(&site->generation, generation, __ATOMIC_RELEASE);
+  }
+  pthread_mutex_unlock(&binlog.lock);
+  return result;
+}
+
+// Create a new binary log and make BINLOG() write to it. An existing file
+// is replaced. Fails if a log is already open.
+ERROR binlog_open(const char * const path) {
+  static bool flush_at_exit = false;
+  BINLOG_FILE_HEADER header = {
+    .magic = BINLOG_FILE_MAGIC,
+    .version = BINLOG_FILE_VERSION
+  };
+
+  pthread_mutex_lock(&binlog.lock);
+  if (binlog.generation) {
+    pthread_mutex_unlock(&binlog.lock);
+    return FAILURE;
+  }
+  binlog.fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND | O_CLOEXEC,
+                   S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+  if (binlog.fd < 0 ||
+      binlog_write_all(binlog.fd, &header, sizeof(header)) != SUCCESS ||
+      pthread_key_create(&binlog.key, binlog_thread_exit) != 0) {
+    if (binlog.fd >= 0) {
+      close(binlog.fd);
+    }
+    binlog.fd = -1;
+    pthread_mutex_unlock(&binlog.lock);
+    return FAILURE;
+  }
+  binlog.next_id = 0;
+  binlog.threads = NULL;
+  __atomic_store_n(&binlog.generation, ++binlog.opened, __ATOMIC_RELEASE);
+  // Other threads write their buffers when they exit, the main thread
+  // doesn't run the destructor.
+  if (!flush_at_exit) {
+    atexit(binlog_flush);
+    flush_at_exit = true;
+  }
+  pthread_mutex_unlock(&binlog.lock);
+  return SUCCESS;
+}
+
+// Write the buffers of all threads and close the log.
+//
+// NOTE: No other thread may log while this runs.
+void binlog_close(void) {
+  pthread_mutex_lock(&binlog.lock);
+  if (!binlog.generation) {
+    pthread_mutex_unlock(&binlog.lock);
+    return;
+  }
+  __atomic_store_n(&binlog.generation, 0, __ATOMIC_RELEASE);
+  while (binlog.threads) {
+    BINLOG_THREAD *thread = binlog.threads;
+    binlog.threads = thread->next;
+    buf_write(&thread->buf, binlog.fd);
+    buf_destroy(&thread->buf);
+    free(thread);
+  }
+  pthread_key_delete(binlog.key);
+  close(binlog.fd);
+  binlog.fd = -1;
+  pthread_mutex_unlock(&binlog.lock);
+}
+
+// Write the buffer of the calling thread to the file.
+void binlog_flush(void) {
+  size_t generation = __atomic_load_n(&binlog.generation, __ATOMIC_ACQUIRE);
+  if (generation && binlog_thread_generation == generation &&
+      buf_write(&binlog_thread->buf, binlog.fd) != SUCCESS) {
+    buf_clear(&binlog_thread->buf);
+  }
+}
+
+// Append a message record to the buffer of the calling thread, use BINLOG()
+// instead of calling this directly. fmt is only there so the compiler
+// checks the arguments, the format string of the site is used.
+void binlog_write(BINLOG_SITE *site, const char *fmt, ...) {
+  (void)fmt;
+  size_t generation = __atomic_load_n(&binlog.generation, __ATOMIC_ACQUIRE);
+  if (!generation) {
+    return;
+  }
+  if (__atomic_load_n(&site->generation, __ATOMIC_ACQUIRE) != generation &&
+      binlog_register(site, generation) != SUCCESS) {
+    return;
+  }
+  BINLOG_THREAD *thread = binlog_thread_get(generation);
+  if (!site->valid || !thread) {
+    return;
+  }
+  BUFFER *buf = &thread->buf;
+  size_t start = buf_size(buf);
+  uint8_t *record = buf_reserve(buf, BINLOG_MESSAGE_MAX);
+  if (!record) {
+    return;
+  }
+
+  struct timespec now;
+  clock_gettime(CLOCK_REALTIME, &now);
+  uint64_t timestamp = now.tv_sec * 1000000000ULL + now.tv_nsec;
+  uint8_t *p = record;
+  *p++ = BINLOG_RECORD_MESSAGE;
+  memcpy(p, &site->id, sizeof(site->id));
+  memcpy(p + 4, &timestamp, sizeof(timestamp));
+  p += 4 + 8 + 4;
+
+  va_list args;
+  va_start(args, fmt);
+  int last_int = -1;
+  for (size_t i = 0; i < site->arg_count; ++i) {
+    switch (site->args[i]) {
+      case BINLOG_INT: {
+        last_int = va_arg(args, int);
+        memcpy(p, &last_int, sizeof(last_int));
+        p += sizeof(last_int);
+        break;
+      }
+
+      case BINLOG_LONG: {
+        uint64_t value = va_arg(args, uint64_t);
+        memcpy(p, &value, sizeof(value));
+        p += sizeof(value);
+        break;
+      }
+
+      case BINLOG_POINTER: {
+        uint64_t value = (uintptr_t)va_arg(args, void *);
+        memcpy(p, &value, sizeof(value));
+        p += sizeof(value);
+        break;
+      }
+
+      case BINLOG_DOUBLE: {
+        double value = va_arg(args, double);
+        memcpy(p, &value, sizeof(value));
+        p += sizeof(value);
+        break;
+      }
+
+      case BINLOG_LONG_DOUBLE: {
+        long double value = va_arg(args, long double);
+        memcpy(p, &value, sizeof(value));
+        p += sizeof(value);
+        break;
+      }
+
+      case BINLOG_STRING: {
+        const char *string = va_arg(args, const char *);
+        size_t limit = BINLOG_MAX_STRING;
+        if (site->precision[i] >= 0 && (size_t)site->precision[i] < limit) {
+          limit = site->precision[i];
+        } else if (site->precision[i] == BINLOG_PRECISION_ARG &&
+                   last_int >= 0 && (size_t)last_int < limit) {
+          limit = last_int;
+        }
+        if (!string) {
+          string = "(null)";
+        }
+        uint32_t length = strnlen(string, limit);
+        memcpy(p, &length, sizeof(length));
+        p += sizeof(length);
+        // Strings go behind the fixed size part, the buffer may move.
+        buf_commit(buf, p - record);
+        if (buf_append(buf, string, length) != SUCCESS) {
+          record = NULL;
+        } else {
+          record = buf_reserve(buf, BINLOG_MESSAGE_MAX);
+        }
+        if (!record) {
+          // Drop the partial record.
+          buf->write = buf->read + start;
+          va_end(args);
+          return;
+        }
+        p = record;
+        break;
+      }
+    }
+  }
+  va_end(args);
+  buf_commit(buf, p - record);
+
+  uint32_t length = buf_size(buf) - start - BINLOG_MESSAGE_HEADER;
+  memcpy(buf_data(buf) + start + 1 + 4 + 8, &length, sizeof(length));
+  if (buf_size(buf) >= BINLOG_BUFFER_SIZE &&
+      buf_write(buf, binlog.fd) != SUCCESS) {
+    buf_clear(buf);
+  }
+}
+
+// Read exactly size bytes, fails at the end of the file.
+static ERROR binlog_read(FILE *in, void *data, size_t size) {
+  return fread(data, 1, size, in) == size ? SUCCESS : FAILURE;
+}
+
+// Takes arguments out of the arguments of a message record.
+typedef struct BINLOG_READER_ {
+  const uint8_t *p;
+  const uint8_t *end;
+} BINLOG_READER;
+
+static ERROR binlog_take(BINLOG_READER *reader, void *value, size_t size) {
+  if ((size_t)(reader->end - reader->p) < size) {
+    return FAILURE;
+  }
+  memcpy(value, reader->p, size);
+  reader->p += size;
+  return SUCCESS;
+}
+
+// Print one argument with the conversion specification it came with,
+// passing 0, 1 or 2 '*' arguments in front of it.
+#define BINLOG_PRINT(out, spec, stars, star_count, value) \
+  (star_count == 0 ? fprintf(out, spec, value) : \
+   star_count == 1 ? fprintf(out, spec, stars[0], value) : \
+   fprintf(out, spec, stars[0], stars[1], value))
+
+// Print a single conversion of a message.
+static ERROR binlog_print_conversion(FILE *out, const char *spec,
+                                     const uint8_t *args, size_t count,
+                                     BINLOG_READER *reader) {
+  int stars[2];
+  size_t star_count = count - 1;
+  for (size_t i = 0; i < star_count; ++i) {
+    if (binlog_take(reader, &stars[i], sizeof(int)) != SUCCESS) {
+      return FAILURE;
+    }
+  }
+  switch (args[star_count]) {
+    case BINLOG_INT: {
+      int value;
+      if (binlog_take(reader, &value, sizeof(value)) != SUCCESS) {
+        return FAILURE;
+      }
+      BINLOG_PRINT(out, spec, stars, star_count, value);
+      break;
+    }
+
+    case BINLOG_LONG: {
+      uint64_t value;
+      if (binlog_take(reader, &value, sizeof(value)) != SUCCESS) {
+        return FAILURE;
+      }
+      BINLOG_PRINT(out, spec, stars, star_count, value);
+      break;
+    }
+
+    case BINLOG_POINTER: {
+      uint64_t value;
+      if (binlog_take(reader, &value, sizeof(value)) != SUCCESS) {
+        return FAILURE;
+      }
+      BINLOG_PRINT(out, spec, stars, star_count, (void *)(uintptr_t)value);
+      break;
+    }
+
+    case BINLOG_DOUBLE: {
+      double value;
+      if (binlog_take(reader, &value, sizeof(value)) != SUCCESS) {
+        return FAILURE;
+      }
+      BINLOG_PRINT(out, spec, stars, star_count, value);
+      break;
+    }
+
+    case BINLOG_LONG_DOUBLE: {
+      long double value;
+      if (binlog_take(reader, &value, sizeof(value)) != SUCCESS) {
+        return FAILURE;
+      }
+      BINLOG_PRINT(out, spec, stars, star_count, value);
+      break;
+    }
+
+    case BINLOG_STRING: {
+      uint32_t length;
+      if (binlog_take(reader, &length, sizeof(length)) != SUCCESS ||
+          (size_t)(reader->end - reader->p) < length) {
+        return FAILURE;
+      }
+      char *string = strndup((const char *)reader->p, length);
+      if (!string) {
+        return FAILURE;
+      }
+      reader->p += length;
+      BINLOG_PRINT(out, spec, stars, star_count, string);
+      free(string);
+      break;
+    }
+  }
+  return SUCCESS;
+}
+
+// Print a message like log_print() would have.
+static ERROR binlog_print_message(FILE *out, const BINLOG_SITE *site,
+                                  uint64_t timestamp, BINLOG_READER *reader,
+                                  bool timestamps) {
+  if (timestamps) {
+    time_t seconds = timestamp / 1000000000ULL;
+    struct tm tm;
+    char date[32];
+    localtime_r(&seconds, &tm);
+    strftime(date, sizeof(date), "%Y-%m-%d %H:%M:%S", &tm);
+    fprintf(out, "%s.%09u ", date, (unsigned)(timestamp % 1000000000ULL));
+  }
+  if (site->level == LL_ERR) {
+    fputs("[-] ", out);
+  } else if (site->level != LL_MSG) {
+    fputs("[+] ", out);
+  }
+  const char *p = site->fmt;
+  while (*p) {
+    const char *literal = p;
+    while (*p && *p != '%') {
+      p++;
+    }
+    fwrite(literal, 1, p - literal, out);
+    if (!*p) {
+      break;
+    }
+    uint8_t args[BINLOG_MAX_ARGS];
+    int precision[BINLOG_MAX_ARGS];
+    size_t count = 0;
+    const char *end = binlog_conversion(p, args, precision, &count);
+    char spec[64];
+    if (!end || (size_t)(end - p) >= sizeof(spec)) {
+      return FAILURE;
+    }
+    if (count == 0) {
+      fputc('%', out);
+    } else {
+      memcpy(spec, p, end - p);
+      spec[end - p] = 0;
+      if (binlog_print_conversion(out, spec, args, count, reader) !=
+          SUCCESS) {
+        return FAILURE;
+      }
+    }
+    p = end;
+  }
+  if (site->level != LL_NNL) {
+    fputc('\n', out);
+  }
+  return SUCCESS;
+}
+
+// Render a binary log as text. Stops at the first damaged record, which
+// is usually a record cut off because the process died while writing it.
+//
+// Args:
+//  in: the binary log
+//  out: where the text goes
+//  timestamps: prefix every message with the time it was logged at
+ERROR binlog_decode(FILE *in, FILE *out, bool timestamps) {
+  BINLOG_FILE_HEADER header;
+  if (binlog_read(in, &header, sizeof(header)) != SUCCESS ||
+      memcmp(header.magic, BINLOG_FILE_MAGIC, sizeof(header.magic)) != 0 ||
+      header.version != BINLOG_FILE_VERSION) {
+    return FAILURE;
+  }
+  VECTOR sites;
+  BUFFER args;
+  if (vector_init(&sites, sizeof(BINLOG_SITE), VECTOR_DEFAULT_SIZE) !=
+      SUCCESS) {
+    return FAILURE;
+  }
+  if (buf_init(&args, 0) != SUCCESS) {
+    vector_destroy(&sites);
+    return FAILURE;
+  }
+
+  ERROR result = SUCCESS;
+  uint8_t type;
+  while (result == SUCCESS && fread(&type, 1, 1, in) == 1) {
+    uint32_t id;
+    uint32_t length;
+    result = binlog_read(in, &id, sizeof(id));
+    if (result == SUCCESS && type == BINLOG_RECORD_SITE) {
+      uint8_t level;
+      BINLOG_SITE site = { .id = id };
+      char *fmt = NULL;
+      if (binlog_read(in, &level, sizeof(level)) != SUCCESS ||
+          binlog_read(in, &length, sizeof(length)) != SUCCESS ||
+          !(fmt = calloc(1, (size_t)length + 1)) ||
+          binlog_read(in, fmt, length) != SUCCESS ||
+          binlog_parse(fmt, site.args, site.precision,
+                       &site.arg_count) != SUCCESS ||
+          // Sites are numbered in the order they are written.
+          id != sites.used_bytes / sizeof(BINLOG_SITE) + 1) {
+        free(fmt);
+        result = FAILURE;
+        continue;
+      }
+      site.fmt = fmt;
+      site.level = level;
+      site.valid = true;
+      if (!vector_push(&sites, &site, sizeof(site))) {
+        free(fmt);
+        result = FAILURE;
+      }
+    } else if (result == SUCCESS && type == BINLOG_RECORD_MESSAGE) {
+      uint64_t timestamp;
+      uint8_t *data;
+      BINLOG_SITE *site = vector_get(&sites, (size_t)id - 1);
+      buf_clear(&args);
+      if (!site ||
+          binlog_read(in, &timestamp, sizeof(timestamp)) != SUCCESS ||
+          binlog_read(in, &length, sizeof(length)) != SUCCESS ||
+          !(data = buf_reserve(&args, length)) ||
+          binlog_read(in, data, length) != SUCCESS) {
+        result = FAILURE;
+        continue;
+      }
+      BINLOG_READER reader = { .p = data, .end = data + length };
+      result = binlog_print_message(out, site, timestamp, &reader,
+                                    timestamps);
+    } else {
+      result = FAILURE;
+    }
+  }
+
+  for (size_t i = 0; i < sites.used_bytes / sizeof(BINLOG_SITE); ++i) {
+    free((char *)((BINLOG_SITE *)vector_get(&sites, i))->fmt);
+  }
+  vector_destroy(&sites);
+  buf_destroy(&args);
+  return result;
+}
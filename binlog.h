@@ -0,0 +1,124 @@
+// Binary logging with deferred formatting.
+//
+// BINLOG() doesn't format its message. It appends a compact record with the
+// id of its call site, a timestamp and the raw bytes of its arguments to a
+// buffer owned by the calling thread, which is written to the log file once
+// it fills up. The format string of every call site is written to the file
+// once, the first time the site logs. tools/binlog_decode renders the file
+// as text later, with the same prefixes as log_print().
+//
+// USAGE:
+//
+//   binlog_open("/var/log/audit.blog");
+//   BINLOG(LL_LOG, "user %s read %zu bytes", user, size);
+//   ...
+//   binlog_close();
+//
+// BINLOG() filters by log_level and CUTIL_LOG_MIN_LEVEL just like the LOG_*
+// macros in log.h. Format strings must be literals. They may use all
+// conversions of printf() except %n and wide characters (%lc, %ls), with at
+// most BINLOG_MAX_ARGS arguments. Messages of sites with other format
+// strings are dropped.
+// Strings are copied up to their precision, but at most BINLOG_MAX_STRING
+// bytes.
+//
+// Every thread writes its buffer to the file on its own, so messages of one
+// thread are in order, but messages of different threads are not. Sort by
+// the timestamps if that matters. binlog_flush() writes the buffer of the
+// calling thread, binlog_close() writes the buffers of all threads, which
+// must not log while it runs.
+//
+// Author: Johannes Stüttgen (johannes.stuettgen@gmail.com)
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef CUTIL_BINLOG_H
+#define CUTIL_BINLOG_H
+
+#include <stdio.h>
+
+#include "log.h"
+#include "types.h"
+
+#define BINLOG_FILE_MAGIC "CUTILBLG"
+#define BINLOG_FILE_VERSION 1
+
+// Most arguments a format string may take, including '*' widths.
+#define BINLOG_MAX_ARGS 16
+
+// Longest string argument stored in a record.
+#define BINLOG_MAX_STRING 4096
+
+// Size of the buffer of every thread, it is written when it is full.
+#define BINLOG_BUFFER_SIZE (64 * 1024)
+
+// How an argument is stored in a record.
+typedef enum BINLOG_ARG_ {
+  BINLOG_INT = 1,      // int and everything promoted to it
+  BINLOG_LONG,         // long, long long, size_t, intmax_t, ptrdiff_t
+  BINLOG_POINTER,
+  BINLOG_DOUBLE,
+  BINLOG_LONG_DOUBLE,
+  BINLOG_STRING        // uint32_t length followed by the bytes
+} BINLOG_ARG;
+
+// The types of records following the file header. Every record starts with
+// its type byte.
+typedef enum BINLOG_RECORD_ {
+  // uint32_t id, uint8_t level, uint32_t length, format string
+  BINLOG_RECORD_SITE = 1,
+  // uint32_t id, uint64_t timestamp, uint32_t length, arguments
+  BINLOG_RECORD_MESSAGE
+} BINLOG_RECORD;
+
+typedef struct BINLOG_FILE_HEADER_ {
+  char magic[8];
+  uint32_t version;
+  uint32_t reserved;
+} BINLOG_FILE_HEADER;
+
+// A call site of BINLOG(), registered with the open log on first use.
+typedef struct BINLOG_SITE_ {
+  const char *fmt;
+  LOGLEVEL level;
+  size_t generation;  // The log the site is registered with, 0 for none
+  uint32_t id;
+  bool valid;         // The format string is supported
+  size_t arg_count;
+  uint8_t args[BINLOG_MAX_ARGS];
+  int precision[BINLOG_MAX_ARGS];  // Of string arguments, -1 for none
+} BINLOG_SITE;
+
+ERROR binlog_open(const char * const path);
+void binlog_close(void);
+void binlog_flush(void);
+void binlog_write(BINLOG_SITE *site, const char *fmt, ...)
+    __attribute__((format(printf, 2, 3)));
+ERROR binlog_decode(FILE *in, FILE *out, bool timestamps);
+
+// Used by the decoder, see binlog.c.
+ERROR binlog_parse(const char *fmt, uint8_t *args, int *precision,
+                   size_t *count);
+const char *binlog_conversion(const char *fmt, uint8_t *args,
+                              int *precision, size_t *count);
+
+// Log a message in binary form, see above.
+#define BINLOG(msg_level, fmt, ...) \
+  do { \
+    static BINLOG_SITE binlog_site_ = { fmt, msg_level }; \
+    if ((msg_level) <= CUTIL_LOG_MIN_LEVEL && (msg_level) <= log_level) { \
+      binlog_write(&binlog_site_, fmt, ##__VA_ARGS__); \
+    } \
+  } while (0)
+
+#endif  // CUTIL_BINLOG_H
@@ -0,0 +1,354 @@
+// A growable array of bits with word at a time bulk operations.
+//
+// Author: Johannes Stüttgen (johannes.stuettgen@gmail.com)
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <string.h>
+
+#include "bitset.h"
+#include "cpu.h"
+
+extern inline uint64_t *bitset_words(const BITSET * const bs);
+extern inline bool bitset_test(const BITSET * const bs, size_t index);
+extern inline ERROR bitset_set(BITSET *bs, size_t index);
+extern inline ERROR bitset_clear(BITSET *bs, size_t index);
+
+// Number of words needed to hold size bits.
+static size_t bitset_word_count(size_t size) {
+  return (size + BITSET_WORD_BITS - 1) / BITSET_WORD_BITS;
+}
+
+// Mask of the bits below index in its word.
+static uint64_t bitset_low_mask(size_t index) {
+  return ((uint64_t)1 << (index % BITSET_WORD_BITS)) - 1;
+}
+
+// Create a new bitset with size bits, all of them cleared.
+//
+// Args:
+//  bs: pointer to the bitset to initialize
+//  size: number of bits
+ERROR bitset_init(BITSET *bs, size_t size) {
+  bs->size = 0;
+  bs->indexed = false;
+  if (vector_init(&bs->index, sizeof(uint64_t), 1) != SUCCESS) {
+    return FAILURE;
+  }
+  if (vector_init(&bs->words, sizeof(uint64_t),
+                  bitset_word_count(size) + 1) != SUCCESS) {
+    vector_destroy(&bs->index);
+    return FAILURE;
+  }
+  return bitset_resize(bs, size);
+}
+
+// release all memory the bitset holds.
+void bitset_destroy(BITSET *bs) {
+  vector_destroy(&bs->words);
+  vector_destroy(&bs->index);
+}
+
+// Change the number of bits. New bits are cleared.
+ERROR bitset_resize(BITSET *bs, size_t size) {
+  size_t old_words = bs->words.used_bytes / sizeof(uint64_t);
+  size_t new_words = bitset_word_count(size);
+  if (new_words > old_words) {
+    if (vector_reserve(&bs->words, new_words) != SUCCESS) {
+      return FAILURE;
+    }
+    memset(bs->words.data + bs->words.used_bytes, 0,
+           (new_words - old_words) * sizeof(uint64_t));
+  }
+  bs->words.used_bytes = new_words * sizeof(uint64_t);
+  // Keep the bits behind the end cleared, so whole words can be counted.
+  if (size < bs->size && size % BITSET_WORD_BITS) {
+    bitset_words(bs)[new_words - 1] &= bitset_low_mask(size);
+  }
+  bs->size = size;
+  bs->indexed = false;
+  return SUCCESS;
+}
+
+// Append a bit, growing the bitset by the policy of its word vector.
+ERROR bitset_push(BITSET *bs, bool value) {
+  if (bs->size % BITSET_WORD_BITS == 0) {
+    uint64_t word = 0;
+    if (!vector_push(&bs->words, &word, sizeof(word))) {
+      return FAILURE;
+    }
+  }
+  if (value) {
+    bitset_words(bs)[bs->size / BITSET_WORD_BITS] |=
+        (uint64_t)1 << (bs->size % BITSET_WORD_BITS);
+  }
+  bs->size++;
+  bs->indexed = false;
+  return SUCCESS;
+}
+
+// Set or clear count bits starting at start, whole words at a time.
+static ERROR bitset_fill_range(BITSET *bs, size_t start, size_t count,
+                               bool value) {
+  if (start > bs->size || count > bs->size - start) {
+    return FAILURE;
+  }
+  uint64_t *words = bitset_words(bs);
+  size_t end = start + count;
+  bs->indexed = false;
+  while (start < end && start % BITSET_WORD_BITS) {
+    uint64_t bit = (uint64_t)1 << (start % BITSET_WORD_BITS);
+    words[start / BITSET_WORD_BITS] =
+        value ? words[start / BITSET_WORD_BITS] | bit :
+                words[start / BITSET_WORD_BITS] & ~bit;
+    start++;
+  }
+  size_t full_words = (end - start) / BITSET_WORD_BITS;
+  memset(words + start / BITSET_WORD_BITS, value ? 0xff : 0,
+         full_words * sizeof(uint64_t));
+  start += full_words * BITSET_WORD_BITS;
+  if (start < end) {
+    uint64_t mask = bitset_low_mask(end);
+    words[start / BITSET_WORD_BITS] =
+        value ? words[start / BITSET_WORD_BITS] | mask :
+                words[start / BITSET_WORD_BITS] & ~mask;
+  }
+  return SUCCESS;
+}
+
+ERROR bitset_set_range(BITSET *bs, size_t start, size_t count) {
+  return bitset_fill_range(bs, start, count, true);
+}
+
+ERROR bitset_clear_range(BITSET *bs, size_t start, size_t count) {
+  return bitset_fill_range(bs, start, count, false);
+}
+
+// Generates dst = op(dst, src) over two bitsets of the same size. The AVX2
+// version processes 256 bits per instruction, the scalar version is left to
+// the compiler.
+#ifdef CUTIL_X86
+#define BITSET_OP_DEFINE_AVX2(name, vector_op, scalar_op) \
+CUTIL_TARGET_AVX2 \
+static void bitset_##name##_avx2(uint64_t *dst, const uint64_t *src, \
+                                 size_t count) { \
+  size_t i = 0; \
+  for (; i + 4 <= count; i += 4) { \
+    __m256i a = _mm256_loadu_si256((const __m256i *)(dst + i)); \
+    __m256i b = _mm256_loadu_si256((const __m256i *)(src + i)); \
+    _mm256_storeu_si256((__m256i *)(dst + i), vector_op(a, b)); \
+  } \
+  for (; i < count; ++i) { \
+    dst[i] = scalar_op(dst[i], src[i]); \
+  } \
+}
+#define BITSET_OP_CALL_AVX2(name, dst, src, count) \
+  if (cpu_has_avx2()) { \
+    bitset_##name##_avx2(dst, src, count); \
+  } else
+#else
+#define BITSET_OP_DEFINE_AVX2(name, vector_op, scalar_op)
+#define BITSET_OP_CALL_AVX2(name, dst, src, count)
+#endif
+
+#define BITSET_OP_DEFINE(name, vector_op, scalar_op) \
+BITSET_OP_DEFINE_AVX2(name, vector_op, scalar_op) \
+\
+static void bitset_##name##_scalar(uint64_t *dst, const uint64_t *src, \
+                                   size_t count) { \
+  for (size_t i = 0; i < count; ++i) { \
+    dst[i] = scalar_op(dst[i], src[i]); \
+  } \
+} \
+\
+ERROR bitset_##name(BITSET *dst, const BITSET * const src) { \
+  if (dst->size != src->size) { \
+    return FAILURE; \
+  } \
+  uint64_t *dst_words = bitset_words(dst); \
+  const uint64_t *src_words = bitset_words(src); \
+  size_t count = bitset_word_count(dst->size); \
+  BITSET_OP_CALL_AVX2(name, dst_words, src_words, count) \
+  bitset_##name##_scalar(dst_words, src_words, count); \
+  dst->indexed = false; \
+  return SUCCESS; \
+}
+
+#define BITSET_AND(a, b) ((a) & (b))
+#define BITSET_OR(a, b) ((a) | (b))
+#define BITSET_XOR(a, b) ((a) ^ (b))
+#define BITSET_ANDNOT(a, b) ((a) & ~(b))
+#define BITSET_ANDNOT_AVX2(a, b) _mm256_andnot_si256(b, a)
+
+BITSET_OP_DEFINE(and, _mm256_and_si256, BITSET_AND)
+BITSET_OP_DEFINE(or, _mm256_or_si256, BITSET_OR)
+BITSET_OP_DEFINE(xor, _mm256_xor_si256, BITSET_XOR)
+BITSET_OP_DEFINE(andnot, BITSET_ANDNOT_AVX2, BITSET_ANDNOT)
+
+static size_t bitset_count_scalar(const uint64_t *words, size_t count) {
+  size_t total = 0;
+  for (size_t i = 0; i < count; ++i) {
+    total += __builtin_popcountll(words[i]);
+  }
+  return total;
+}
+
+#ifdef CUTIL_X86
+// Counts bits with a 4 bit lookup table in a shuffle, summing the byte
+// counts of up to 31 vectors before they could overflow.
+CUTIL_TARGET_AVX2
+static size_t bitset_count_avx2(const uint64_t *words, size_t count) {
+  const __m256i lookup = _mm256_setr_epi8(
+      0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+      0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+  const __m256i low_mask = _mm256_set1_epi8(0x0f);
+  __m256i total = _mm256_setzero_si256();
+  size_t i = 0;
+  while (i + 4 <= count) {
+    __m256i bytes = _mm256_setzero_si256();
+    for (size_t j = 0; j < 31 && i + 4 <= count; ++j, i += 4) {
+      __m256i v = _mm256_loadu_si256((const __m256i *)(words + i));
+      __m256i low = _mm256_and_si256(v, low_mask);
+      __m256i high = _mm256_and_si256(_mm256_srli_epi16(v, 4), low_mask);
+      bytes = _mm256_add_epi8(bytes, _mm256_add_epi8(
+          _mm256_shuffle_epi8(lookup, low),
+          _mm256_shuffle_epi8(lookup, high)));
+    }
+    total = _mm256_add_epi64(total,
+                             _mm256_sad_epu8(bytes, _mm256_setzero_si256()));
+  }
+  // _mm256_extract_epi64() only exists on x86-64, go through memory.
+  uint64_t lanes[4];
+  _mm256_storeu_si256((__m256i *)lanes, total);
+  size_t result = lanes[0] + lanes[1] + lanes[2] + lanes[3];
+  for (; i < count; ++i) {
+    result += __builtin_popcountll(words[i]);
+  }
+  return result;
+}
+#endif
+
+// Count set bits in count words.
+static size_t bitset_count_words(const uint64_t *words, size_t count) {
+#ifdef CUTIL_X86
+  if (cpu_has_avx2()) {
+    return bitset_count_avx2(words, count);
+  }
+#endif
+  return bitset_count_scalar(words, count);
+}
+
+// Number of set bits.
+size_t bitset_count(const BITSET * const bs) {
+  return bitset_count_words(bitset_words(bs), bitset_word_count(bs->size));
+}
+
+// Find the first set bit at or behind start. Returns the size of the bitset
+// if there is none.
+size_t bitset_next_set(const BITSET * const bs, size_t start) {
+  const uint64_t *words = bitset_words(bs);
+  size_t count = bitset_word_count(bs->size);
+  if (start >= bs->size) {
+    return bs->size;
+  }
+  size_t i = start / BITSET_WORD_BITS;
+  uint64_t word = words[i] & ~bitset_low_mask(start);
+  while (!word) {
+    if (++i >= count) {
+      return bs->size;
+    }
+    word = words[i];
+  }
+  return i * BITSET_WORD_BITS + __builtin_ctzll(word);
+}
+
+// Count the set bits in front of each block of BITSET_INDEX_WORDS words, so
+// bitset_rank() and bitset_select() only need to look at a single block.
+ERROR bitset_build_index(BITSET *bs) {
+  const uint64_t *words = bitset_words(bs);
+  size_t count = bitset_word_count(bs->size);
+  size_t blocks = count / BITSET_INDEX_WORDS + 1;
+  if (vector_reserve(&bs->index, blocks) != SUCCESS) {
+    return FAILURE;
+  }
+  uint64_t *index = (uint64_t *)bs->index.data;
+  uint64_t total = 0;
+  for (size_t block = 0; block < blocks; ++block) {
+    index[block] = total;
+    size_t first = block * BITSET_INDEX_WORDS;
+    if (first < count) {
+      size_t block_words = count - first < BITSET_INDEX_WORDS ?
+                           count - first : BITSET_INDEX_WORDS;
+      total += bitset_count_scalar(words + first, block_words);
+    }
+  }
+  bs->index.used_bytes = blocks * sizeof(uint64_t);
+  bs->indexed = true;
+  return SUCCESS;
+}
+
+// Number of set bits in front of index.
+size_t bitset_rank(const BITSET * const bs, size_t index) {
+  const uint64_t *words = bitset_words(bs);
+  if (index > bs->size) {
+    index = bs->size;
+  }
+  size_t word = index / BITSET_WORD_BITS;
+  size_t first = 0;
+  size_t rank = 0;
+  if (bs->indexed) {
+    first = word / BITSET_INDEX_WORDS * BITSET_INDEX_WORDS;
+    rank = ((uint64_t *)bs->index.data)[word / BITSET_INDEX_WORDS];
+  }
+  rank += bitset_count_words(words + first, word - first);
+  if (index % BITSET_WORD_BITS) {
+    rank += __builtin_popcountll(words[word] & bitset_low_mask(index));
+  }
+  return rank;
+}
+
+// Index of the n-th set bit, counting from 0. Returns the size of the bitset
+// if fewer bits are set.
+size_t bitset_select(const BITSET * const bs, size_t n) {
+  const uint64_t *words = bitset_words(bs);
+  size_t count = bitset_word_count(bs->size);
+  size_t i = 0;
+  if (bs->indexed) {
+    // Find the last block with at most n bits in front of it.
+    const uint64_t *index = (uint64_t *)bs->index.data;
+    size_t low = 0;
+    size_t high = bs->index.used_bytes / sizeof(uint64_t);
+    while (high - low > 1) {
+      size_t middle = low + (high - low) / 2;
+      if (index[middle] <= n) {
+        low = middle;
+      } else {
+        high = middle;
+      }
+    }
+    n -= index[low];
+    i = low * BITSET_INDEX_WORDS;
+  }
+  for (; i < count; ++i) {
+    size_t bits = __builtin_popcountll(words[i]);
+    if (n < bits) {
+      uint64_t word = words[i];
+      for (; n; --n) {
+        word &= word - 1;
+      }
+      return i * BITSET_WORD_BITS + __builtin_ctzll(word);
+    }
+    n -= bits;
+  }
+  return bs->size;
+}
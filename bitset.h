@@ -0,0 +1,96 @@
+// A growable array of bits, which takes an eighth of the memory of a VECTOR
+// of bool and can be processed a word at a time. The bulk operations and
+// counting use AVX2 when the CPU supports it.
+//
+// For fast rank (number of set bits in front of an index) and select (index
+// of the n-th set bit) queries build an index with bitset_build_index() once
+// the bitset is filled. Any change to the bitset invalidates the index, and
+// without one rank and select count all words up to the answer.
+//
+// Author: Johannes Stüttgen (johannes.stuettgen@gmail.com)
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef CUTIL_BITSET_H
+#define CUTIL_BITSET_H
+
+#include "types.h"
+#include "vector.h"
+
+#define BITSET_WORD_BITS 64
+
+// The rank index stores the number of set bits in front of every block of
+// this many words.
+#define BITSET_INDEX_WORDS 8
+
+typedef struct BITSET_ {
+  VECTOR words;     // uint64_t words, bits past size are always 0
+  size_t size;      // Number of bits
+  VECTOR index;     // uint64_t set bits in front of each block
+  bool indexed;     // The index is up to date
+} BITSET;
+
+ERROR bitset_init(BITSET *bs, size_t size);
+void bitset_destroy(BITSET *bs);
+ERROR bitset_resize(BITSET *bs, size_t size);
+ERROR bitset_push(BITSET *bs, bool value);
+
+ERROR bitset_set_range(BITSET *bs, size_t start, size_t count);
+ERROR bitset_clear_range(BITSET *bs, size_t start, size_t count);
+ERROR bitset_and(BITSET *dst, const BITSET * const src);
+ERROR bitset_or(BITSET *dst, const BITSET * const src);
+ERROR bitset_xor(BITSET *dst, const BITSET * const src);
+ERROR bitset_andnot(BITSET *dst, const BITSET * const src);
+
+size_t bitset_count(const BITSET * const bs);
+size_t bitset_next_set(const BITSET * const bs, size_t start);
+
+ERROR bitset_build_index(BITSET *bs);
+size_t bitset_rank(const BITSET * const bs, size_t index);
+size_t bitset_select(const BITSET * const bs, size_t n);
+
+// Single bit access, defined here so it can be inlined. All of them check
+// the index, bitset.c provides the external definitions.
+inline uint64_t *bitset_words(const BITSET * const bs) {
+  return (uint64_t *)bs->words.data;
+}
+
+inline bool bitset_test(const BITSET * const bs, size_t index) {
+  if (index >= bs->size) {
+    return false;
+  }
+  return (bitset_words(bs)[index / BITSET_WORD_BITS] >>
+          (index % BITSET_WORD_BITS)) & 1;
+}
+
+inline ERROR bitset_set(BITSET *bs, size_t index) {
+  if (index >= bs->size) {
+    return FAILURE;
+  }
+  bitset_words(bs)[index / BITSET_WORD_BITS] |=
+      (uint64_t)1 << (index % BITSET_WORD_BITS);
+  bs->indexed = false;
+  return SUCCESS;
+}
+
+inline ERROR bitset_clear(BITSET *bs, size_t index) {
+  if (index >= bs->size) {
+    return FAILURE;
+  }
+  bitset_words(bs)[index / BITSET_WORD_BITS] &=
+      ~((uint64_t)1 << (index % BITSET_WORD_BITS));
+  bs->indexed = false;
+  return SUCCESS;
+}
+
+#endif  // CUTIL_BITSET_H
@@ -0,0 +1,346 @@
+// Growable byte buffers and chains of buffers.
+//
+// Author: Johannes Stüttgen (johannes.stuettgen@gmail.com)
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <errno.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "buffer.h"
+
+// Create a new, empty buffer.
+//
+// Args:
+//  buf: pointer to the buffer to initialize
+//  capacity: number of bytes to allocate up front
+ERROR buf_init(BUFFER *buf, size_t capacity) {
+  if (capacity < BUFFER_MIN_SIZE) {
+    capacity = BUFFER_MIN_SIZE;
+  }
+  buf->read = 0;
+  buf->write = 0;
+  buf->capacity = capacity;
+  buf->data = malloc(capacity);
+  if (!buf->data) {
+    return FAILURE;
+  }
+  return SUCCESS;
+}
+
+// release all memory the buffer holds.
+void buf_destroy(BUFFER *buf) {
+  free(buf->data);
+  buf->data = NULL;
+  buf->capacity = 0;
+  buf->read = 0;
+  buf->write = 0;
+}
+
+// Make room for at least size more bytes and return a pointer to it. Write
+// into the room and add what was written with buf_commit(), which must not
+// be more than size. Returns NULL if the buffer can't grow.
+//
+// Consumed bytes at the front are reused before the buffer grows, but only
+// when they make up at least half of it, so the remaining bytes are never
+// moved more than once per doubling.
+uint8_t *buf_reserve(BUFFER *buf, size_t size) {
+  if (size < buf->capacity - buf->write) {
+    return buf->data + buf->write;
+  }
+  size_t used = buf->write - buf->read;
+  if (buf->read >= used) {
+    memmove(buf->data, buf->data + buf->read, used);
+    buf->read = 0;
+    buf->write = used;
+    if (size < buf->capacity - buf->write) {
+      return buf->data + buf->write;
+    }
+  }
+  size_t needed;
+  if (__builtin_add_overflow(buf->write, size, &needed) ||
+      __builtin_add_overflow(needed, 1, &needed)) {
+    return NULL;
+  }
+  size_t capacity = buf->capacity;
+  while (capacity < needed) {
+    if (capacity > SIZE_MAX / 2) {
+      capacity = needed;
+      break;
+    }
+    capacity *= 2;
+  }
+  uint8_t *data = realloc(buf->data, capacity);
+  if (!data) {
+    return NULL;
+  }
+  buf->data = data;
+  buf->capacity = capacity;
+  return buf->data + buf->write;
+}
+
+// Append a copy of size bytes to the buffer.
+ERROR buf_append(BUFFER *buf, const void * const data, size_t size) {
+  uint8_t *room = buf_reserve(buf, size);
+  if (!room) {
+    return FAILURE;
+  }
+  memcpy(room, data, size);
+  buf_commit(buf, size);
+  return SUCCESS;
+}
+
+// Append a string to the buffer, without its terminating 0.
+ERROR buf_append_str(BUFFER *buf, const char * const str) {
+  return buf_append(buf, str, strlen(str));
+}
+
+// Append formatted output to the buffer, like sprintf().
+ERROR buf_printf(BUFFER *buf, const char *fmt, ...) {
+  va_list args;
+  va_start(args, fmt);
+  ERROR result = buf_vprintf(buf, fmt, args);
+  va_end(args);
+  return result;
+}
+
+// Same as buf_printf(), with a va_list. The output is formatted straight
+// into the spare capacity, only output which doesn't fit is formatted a
+// second time after the buffer grew.
+ERROR buf_vprintf(BUFFER *buf, const char *fmt, va_list args) {
+  va_list retry;
+  va_copy(retry, args);
+  size_t spare = buf->capacity - buf->write;
+  int length = vsnprintf((char *)buf->data + buf->write, spare, fmt, args);
+  if (length >= 0 && (size_t)length >= spare) {
+    uint8_t *room = buf_reserve(buf, length);
+    if (room) {
+      vsnprintf((char *)room, length + 1, fmt, retry);
+    } else {
+      length = -1;
+    }
+  }
+  va_end(retry);
+  if (length < 0) {
+    return FAILURE;
+  }
+  buf_commit(buf, length);
+  return SUCCESS;
+}
+
+// Write the contents of the buffer to a file descriptor and consume
+// everything that was written. On failure, the bytes not written yet stay
+// in the buffer.
+ERROR buf_write(BUFFER *buf, int fd) {
+  while (buf_size(buf)) {
+    ssize_t written = write(fd, buf_data(buf), buf_size(buf));
+    if (written < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return FAILURE;
+    }
+    buf_consume(buf, written);
+  }
+  return SUCCESS;
+}
+
+// Create a new, empty buffer chain.
+//
+// Args:
+//  chain: pointer to the chain to initialize
+//  chunk_size: size of the chunks the chain copies data into, e.g.
+//              BUFFER_CHAIN_CHUNK_SIZE
+ERROR buf_chain_init(BUFFER_CHAIN *chain, size_t chunk_size) {
+  chain->tail = NULL;
+  chain->tail_free = 0;
+  chain->chunk_size = chunk_size ? chunk_size : BUFFER_CHAIN_CHUNK_SIZE;
+  chain->size = 0;
+  if (vector_init(&chain->iov, sizeof(struct iovec),
+                  VECTOR_DEFAULT_SIZE) != SUCCESS) {
+    return FAILURE;
+  }
+  if (vector_init(&chain->chunks, sizeof(uint8_t *),
+                  VECTOR_DEFAULT_SIZE) != SUCCESS) {
+    vector_destroy(&chain->iov);
+    return FAILURE;
+  }
+  return SUCCESS;
+}
+
+// release all memory the chain holds.
+void buf_chain_destroy(BUFFER_CHAIN *chain) {
+  buf_chain_clear(chain);
+  vector_destroy(&chain->iov);
+  vector_destroy(&chain->chunks);
+}
+
+// Remove all pieces from the chain and release its chunks.
+void buf_chain_clear(BUFFER_CHAIN *chain) {
+  size_t count = chain->chunks.used_bytes / sizeof(uint8_t *);
+  for (size_t i = 0; i < count; ++i) {
+    free(*(uint8_t **)vector_ptr(&chain->chunks, i));
+  }
+  chain->chunks.used_bytes = 0;
+  chain->iov.used_bytes = 0;
+  chain->tail = NULL;
+  chain->tail_free = 0;
+  chain->size = 0;
+}
+
+// Make room for at least size more bytes and return a pointer to it, like
+// buf_reserve(). Bytes already in the chain never move, if the room doesn't
+// fit into the newest chunk the chain starts a new one.
+uint8_t *buf_chain_reserve(BUFFER_CHAIN *chain, size_t size) {
+  if (size <= chain->tail_free) {
+    return chain->tail;
+  }
+  size_t chunk_size = size > chain->chunk_size ? size : chain->chunk_size;
+  uint8_t *chunk = malloc(chunk_size);
+  if (!chunk) {
+    return NULL;
+  }
+  if (!vector_push(&chain->chunks, &chunk, sizeof(chunk))) {
+    free(chunk);
+    return NULL;
+  }
+  chain->tail = chunk;
+  chain->tail_free = chunk_size;
+  return chain->tail;
+}
+
+// Add a piece to the end of the chain, merging it into the last piece if
+// both are next to each other in memory.
+static ERROR buf_chain_add(BUFFER_CHAIN *chain, const void * const data,
+                           size_t size) {
+  size_t count = chain->iov.used_bytes / sizeof(struct iovec);
+  if (count) {
+    struct iovec *last = vector_ptr(&chain->iov, count - 1);
+    if ((uint8_t *)last->iov_base + last->iov_len == data) {
+      last->iov_len += size;
+      chain->size += size;
+      return SUCCESS;
+    }
+  }
+  struct iovec piece = { .iov_base = (void *)data, .iov_len = size };
+  if (!vector_push(&chain->iov, &piece, sizeof(piece))) {
+    return FAILURE;
+  }
+  chain->size += size;
+  return SUCCESS;
+}
+
+// Add size bytes written to the room returned by buf_chain_reserve().
+ERROR buf_chain_commit(BUFFER_CHAIN *chain, size_t size) {
+  if (size > chain->tail_free) {
+    return FAILURE;
+  }
+  if (size == 0) {
+    return SUCCESS;
+  }
+  if (buf_chain_add(chain, chain->tail, size) != SUCCESS) {
+    return FAILURE;
+  }
+  chain->tail += size;
+  chain->tail_free -= size;
+  return SUCCESS;
+}
+
+// Append a copy of size bytes to the chain.
+ERROR buf_chain_append(BUFFER_CHAIN *chain, const void * const data,
+                       size_t size) {
+  uint8_t *room = buf_chain_reserve(chain, size);
+  if (!room) {
+    return FAILURE;
+  }
+  memcpy(room, data, size);
+  return buf_chain_commit(chain, size);
+}
+
+// Append size bytes to the chain without copying them. The memory must stay
+// valid and unchanged until the chain is written or cleared.
+ERROR buf_chain_append_ref(BUFFER_CHAIN *chain, const void * const data,
+                           size_t size) {
+  if (size == 0) {
+    return SUCCESS;
+  }
+  return buf_chain_add(chain, data, size);
+}
+
+// Append formatted output to the chain, like sprintf().
+ERROR buf_chain_printf(BUFFER_CHAIN *chain, const char *fmt, ...) {
+  va_list args;
+  va_start(args, fmt);
+  ERROR result = buf_chain_vprintf(chain, fmt, args);
+  va_end(args);
+  return result;
+}
+
+// Same as buf_chain_printf(), with a va_list. Output which doesn't fit into
+// the newest chunk is formatted a second time into a new one.
+ERROR buf_chain_vprintf(BUFFER_CHAIN *chain, const char *fmt, va_list args) {
+  va_list retry;
+  va_copy(retry, args);
+  int length = vsnprintf((char *)chain->tail, chain->tail_free, fmt, args);
+  // vsnprintf() needs room for the terminating 0, which the chain doesn't
+  // keep, so output which fills the chunk exactly is formatted twice.
+  if (length >= 0 && (size_t)length >= chain->tail_free) {
+    uint8_t *room = buf_chain_reserve(chain, (size_t)length + 1);
+    if (room) {
+      vsnprintf((char *)room, length + 1, fmt, retry);
+    } else {
+      length = -1;
+    }
+  }
+  va_end(retry);
+  if (length < 0) {
+    return FAILURE;
+  }
+  return buf_chain_commit(chain, length);
+}
+
+// Write all pieces of the chain to a file descriptor with as few writev()
+// calls as possible and clear the chain. On failure, the chain keeps the
+// bytes not written yet and the write can be retried.
+ERROR buf_chain_write(BUFFER_CHAIN *chain, int fd) {
+  struct iovec *iov = (struct iovec *)chain->iov.data;
+  size_t count = chain->iov.used_bytes / sizeof(struct iovec);
+  size_t index = 0;
+  while (index < count) {
+    size_t batch = count - index < IOV_MAX ? count - index : IOV_MAX;
+    ssize_t written = writev(fd, iov + index, batch);
+    if (written < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return FAILURE;
+    }
+    chain->size -= written;
+    // Skip the pieces written completely and cut the front off the piece
+    // written partially.
+    while (index < count && (size_t)written >= iov[index].iov_len) {
+      written -= iov[index].iov_len;
+      iov[index++].iov_len = 0;
+    }
+    if (written) {
+      iov[index].iov_base = (uint8_t *)iov[index].iov_base + written;
+      iov[index].iov_len -= written;
+    }
+  }
+  buf_chain_clear(chain);
+  return SUCCESS;
+}
@@ -0,0 +1,128 @@
+// Growable byte buffers for building output, and chains of buffers for
+// output too large to copy around.
+//
+// A BUFFER holds bytes between a read and a write offset. Appending grows it
+// geometrically, so building a string piece by piece costs amortized O(1)
+// per byte instead of the O(n) rescan of every strcat(). buf_printf()
+// formats straight into the spare capacity and only formats a second time
+// if the output didn't fit. Producers can also reserve room, fill it
+// themselves and commit what they wrote, while consumers take bytes off the
+// front with buf_consume():
+//
+//   uint8_t *room = buf_reserve(&buf, 4096);
+//   ssize_t got = read(fd, room, 4096);
+//   buf_commit(&buf, got);
+//   ...
+//   buf_consume(&buf, parsed);
+//
+// A BUFFER_CHAIN never moves bytes it already holds. It fills fixed chunks
+// and starts a new one when the current one is full, and it can reference
+// caller memory without copying it at all. buf_chain_write() sends all
+// pieces with a single writev(), so a large response is never concatenated
+// into one contiguous copy.
+//
+// Author: Johannes Stüttgen (johannes.stuettgen@gmail.com)
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef CUTIL_BUFFER_H
+#define CUTIL_BUFFER_H
+
+#include <stdarg.h>
+#include <sys/uio.h>
+
+#include "types.h"
+#include "vector.h"
+
+// Smallest capacity of a buffer.
+#define BUFFER_MIN_SIZE 64
+
+// Default size of the chunks in a buffer chain.
+#define BUFFER_CHAIN_CHUNK_SIZE (16 * 1024)
+
+typedef struct BUFFER_ {
+  uint8_t *data;
+  size_t read;      // Offset of the first byte not consumed yet
+  size_t write;     // Offset behind the last byte written
+  size_t capacity;  // Always larger than write, to fit a terminating 0
+} BUFFER;
+
+typedef struct BUFFER_CHAIN_ {
+  VECTOR iov;        // struct iovec for every piece, in output order
+  VECTOR chunks;     // Pointers to the chunks owned by the chain
+  uint8_t *tail;     // Free space in the newest chunk
+  size_t tail_free;
+  size_t chunk_size;
+  size_t size;       // Bytes in all pieces together
+} BUFFER_CHAIN;
+
+ERROR buf_init(BUFFER *buf, size_t capacity);
+void buf_destroy(BUFFER *buf);
+uint8_t *buf_reserve(BUFFER *buf, size_t size);
+ERROR buf_append(BUFFER *buf, const void * const data, size_t size);
+ERROR buf_append_str(BUFFER *buf, const char * const str);
+ERROR buf_printf(BUFFER *buf, const char *fmt, ...)
+    __attribute__((format(printf, 2, 3)));
+ERROR buf_vprintf(BUFFER *buf, const char *fmt, va_list args);
+ERROR buf_write(BUFFER *buf, int fd);
+
+ERROR buf_chain_init(BUFFER_CHAIN *chain, size_t chunk_size);
+void buf_chain_destroy(BUFFER_CHAIN *chain);
+void buf_chain_clear(BUFFER_CHAIN *chain);
+uint8_t *buf_chain_reserve(BUFFER_CHAIN *chain, size_t size);
+ERROR buf_chain_commit(BUFFER_CHAIN *chain, size_t size);
+ERROR buf_chain_append(BUFFER_CHAIN *chain, const void * const data,
+                       size_t size);
+ERROR buf_chain_append_ref(BUFFER_CHAIN *chain, const void * const data,
+                           size_t size);
+ERROR buf_chain_printf(BUFFER_CHAIN *chain, const char *fmt, ...)
+    __attribute__((format(printf, 2, 3)));
+ERROR buf_chain_vprintf(BUFFER_CHAIN *chain, const char *fmt, va_list args);
+ERROR buf_chain_write(BUFFER_CHAIN *chain, int fd);
+
+// The bytes in the buffer which were not consumed yet.
+static inline uint8_t *buf_data(const BUFFER *buf) {
+  return buf->data + buf->read;
+}
+
+static inline size_t buf_size(const BUFFER *buf) {
+  return buf->write - buf->read;
+}
+
+// The contents of the buffer as a string. The terminating 0 is not part of
+// the contents, so further appends overwrite it.
+static inline char *buf_cstr(BUFFER *buf) {
+  buf->data[buf->write] = 0;
+  return (char *)buf_data(buf);
+}
+
+// Add size bytes written to the room returned by buf_reserve().
+static inline void buf_commit(BUFFER *buf, size_t size) {
+  buf->write += size;
+}
+
+// Drop size bytes from the front of the buffer.
+static inline void buf_consume(BUFFER *buf, size_t size) {
+  buf->read += size;
+  if (buf->read >= buf->write) {
+    buf->read = 0;
+    buf->write = 0;
+  }
+}
+
+static inline void buf_clear(BUFFER *buf) {
+  buf->read = 0;
+  buf->write = 0;
+}
+
+#endif  // CUTIL_BUFFER_H
@@ -2,7 +2,7 @@
 
 BUILD_DIR="build"
 RELEASE_DIR="release"
-RELEASE_FILES="libcutil.a tests/cutil_tests"
+RELEASE_FILES="libcutil.a tests/cutil_tests benchmarks/cutil_bench tools/binlog_decode"
 
 CMAKE=`which cmake`
 if [ $? -gt 0 ]; then
@@ -0,0 +1,50 @@
+// Runtime detection of CPU features, so code can pick a SIMD implementation
+// when it runs instead of when it is compiled. Functions using an instruction
+// set beyond the compilers default are declared with CUTIL_TARGET_AVX2 and
+// only called after checking cpu_has_avx2().
+//
+// Author: Johannes Stüttgen (johannes.stuettgen@gmail.com)
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef CUTIL_CPU_H
+#define CUTIL_CPU_H
+
+#include <stdlib.h>
+
+#include "types.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define CUTIL_X86 1
+#include <immintrin.h>
+#define CUTIL_TARGET_AVX2 __attribute__((target("avx2,popcnt")))
+#endif
+
+// Set CUTIL_NO_SIMD in the environment to force the scalar implementations,
+// e.g. to test them on machines which support AVX2.
+static inline bool cpu_has_avx2(void) {
+#ifdef CUTIL_X86
+  static int has_avx2 = -1;
+  int result = __atomic_load_n(&has_avx2, __ATOMIC_RELAXED);
+  if (result < 0) {
+    __builtin_cpu_init();
+    result = __builtin_cpu_supports("avx2") && !getenv("CUTIL_NO_SIMD");
+    __atomic_store_n(&has_avx2, result, __ATOMIC_RELAXED);
+  }
+  return result;
+#else
+  return false;
+#endif
+}
+
+#endif  // CUTIL_CPU_H
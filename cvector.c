@@ -0,0 +1,180 @@
+// An append-only vector that many threads can push to concurrently without
+// taking a lock. Producers reserve slots with a single atomic fetch-add and
+// storage grows in segments of doubling size, so existing elements never
+// move and pointers to them stay valid until the vector is destroyed.
+//
+// Writing an element takes two steps: cvector_reserve() hands out a slot,
+// and once the element is written cvector_commit() publishes it. Readers
+// only ever see published elements, cvector_get() returns NULL for slots
+// that are still being written. cvector_push() does all of this for you.
+//
+// NOTE: Elements can't be removed, and destroying the vector is not thread
+// safe, make sure all producers and readers are done before.
+//
+// Author: Johannes Stüttgen (johannes.stuettgen@gmail.com)
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "cvector.h"
+
+// Create a new concurrent vector. Only the first segment is allocated,
+// all others are allocated by the first producer that needs them.
+//
+// Args:
+//  vec: pointer to the vector to initialize
+//  item_size: size of an individual item in the vector
+//  first_capacity: number of items in the first segment, rounded up to the
+//                  next power of two, which must fit into a size_t
+ERROR cvector_init(CVECTOR *vec, size_t item_size, size_t first_capacity) {
+  uint8_t first_shift = 0;
+  memset(vec->segments, 0, sizeof(vec->segments));
+  if (first_capacity > SIZE_MAX / 2 + 1) {
+    return FAILURE;
+  }
+  while (((size_t)1 << first_shift) < first_capacity) {
+    first_shift++;
+  }
+  vec->item_size = item_size;
+  vec->first_shift = first_shift;
+  vec->reserved = 0;
+  vec->published = 0;
+  size_t items = cvector_segment_items(vec, 0);
+  vec->segments[0] = calloc(items, item_size + 1);
+  if (vec->segments[0]) {
+    return SUCCESS;
+  }
+  return FAILURE;
+}
+
+// release all segments.
+void cvector_destroy(CVECTOR *vec) {
+  for (size_t k = 0; k < CVECTOR_MAX_SEGMENTS; ++k) {
+    free(vec->segments[k]);
+    vec->segments[k] = NULL;
+  }
+}
+
+// Pointer to the ready flag of the item at offset in segment k.
+static uint8_t *cvector_flag(CVECTOR *vec, uint8_t *data, size_t k,
+                             size_t offset) {
+  return data + cvector_segment_items(vec, k) * vec->item_size + offset;
+}
+
+// Get segment k, allocating it if no other producer did so yet. If two
+// producers race, the loser frees its segment and uses the winners.
+static uint8_t *cvector_segment(CVECTOR *vec, size_t k) {
+  uint8_t *data = __atomic_load_n(&vec->segments[k], __ATOMIC_ACQUIRE);
+  if (data) {
+    return data;
+  }
+  uint8_t *new_data = calloc(cvector_segment_items(vec, k), vec->item_size + 1);
+  if (!new_data) {
+    return NULL;
+  }
+  if (__atomic_compare_exchange_n(&vec->segments[k], &data, new_data, false,
+                                  __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+    return new_data;
+  }
+  free(new_data);
+  return data;
+}
+
+// Reserve a slot for a new element and return a pointer to it. The index of
+// the slot is stored in *index, pass it to cvector_commit() once you have
+// written the element. Returns NULL if a new segment can't be allocated.
+//
+// NOTE: A failed reservation still uses up its index, which can never be
+// committed. cvector_published() stops in front of it for good, so treat
+// a failure as fatal for the vector. Elements behind it can still be read
+// with cvector_get().
+void *cvector_reserve(CVECTOR *vec, size_t *index) {
+  size_t segment;
+  size_t offset;
+  *index = __atomic_fetch_add(&vec->reserved, 1, __ATOMIC_RELAXED);
+  cvector_locate(vec, *index, &segment, &offset);
+  if (segment >= CVECTOR_MAX_SEGMENTS) {
+    return NULL;
+  }
+  uint8_t *data = cvector_segment(vec, segment);
+  if (!data) {
+    return NULL;
+  }
+  return data + offset * vec->item_size;
+}
+
+// Publish a reserved element, making it visible to readers.
+void cvector_commit(CVECTOR *vec, size_t index) {
+  size_t segment;
+  size_t offset;
+  cvector_locate(vec, index, &segment, &offset);
+  uint8_t *data = __atomic_load_n(&vec->segments[segment], __ATOMIC_ACQUIRE);
+  __atomic_store_n(cvector_flag(vec, data, segment, offset), 1,
+                   __ATOMIC_RELEASE);
+}
+
+// Add a new element by copying it into a reserved slot and publishing it.
+// The supplied size must equal the vectors item_size, see vector_push().
+void *cvector_push(CVECTOR *vec, const void * const value, size_t size) {
+  size_t index;
+  if (size != vec->item_size) {
+    return NULL;
+  }
+  void *element = cvector_reserve(vec, &index);
+  if (!element) {
+    return NULL;
+  }
+  memcpy(element, value, vec->item_size);
+  cvector_commit(vec, index);
+  return element;
+}
+
+// Get a pointer to a published element, or NULL if the index is out of
+// bounds or the element is still being written.
+void *cvector_get(CVECTOR *vec, size_t index) {
+  size_t segment;
+  size_t offset;
+  if (index >= __atomic_load_n(&vec->reserved, __ATOMIC_RELAXED)) {
+    return NULL;
+  }
+  cvector_locate(vec, index, &segment, &offset);
+  uint8_t *data = __atomic_load_n(&vec->segments[segment], __ATOMIC_ACQUIRE);
+  if (!data ||
+      !__atomic_load_n(cvector_flag(vec, data, segment, offset),
+                       __ATOMIC_ACQUIRE)) {
+    return NULL;
+  }
+  return data + offset * vec->item_size;
+}
+
+// Number of slots reserved so far, including the ones still being written.
+size_t cvector_size(CVECTOR *vec) {
+  return __atomic_load_n(&vec->reserved, __ATOMIC_RELAXED);
+}
+
+// Number of elements at the start of the vector that are all published.
+// Any thread can read these with cvector_ptr() without further checks.
+size_t cvector_published(CVECTOR *vec) {
+  size_t published = __atomic_load_n(&vec->published, __ATOMIC_ACQUIRE);
+  size_t end = published;
+  while (cvector_get(vec, end)) {
+    end++;
+  }
+  // Only ever move the watermark forward, another reader may have been faster.
+  while (end > published &&
+         !__atomic_compare_exchange_n(&vec->published, &published, end, true,
+                                      __ATOMIC_RELEASE, __ATOMIC_ACQUIRE)) {}
+  return end > published ? end : published;
+}
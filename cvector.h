@@ -0,0 +1,81 @@
+// An append-only vector that many threads can push to concurrently without
+// taking a lock. Producers reserve slots with a single atomic fetch-add and
+// storage grows in segments of doubling size, so existing elements never
+// move and pointers to them stay valid until the vector is destroyed.
+//
+// Writing an element takes two steps: cvector_reserve() hands out a slot,
+// and once the element is written cvector_commit() publishes it. Readers
+// only ever see published elements, cvector_get() returns NULL for slots
+// that are still being written. cvector_push() does all of this for you.
+//
+// NOTE: Elements can't be removed, and destroying the vector is not thread
+// safe, make sure all producers and readers are done before. Running out of
+// memory in cvector_reserve() leaves a hole that cvector_published() never
+// moves past, so the vector is not usable after that.
+//
+// Author: Johannes Stüttgen (johannes.stuettgen@gmail.com)
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef CUTIL_CVECTOR_H
+#define CUTIL_CVECTOR_H
+
+#include "types.h"
+
+// Segment k holds (first_capacity << k) items, so this is plenty.
+#define CVECTOR_MAX_SEGMENTS 48
+
+typedef struct CVECTOR_ {
+  // Each segment holds its items followed by one ready flag per item.
+  uint8_t *segments[CVECTOR_MAX_SEGMENTS];
+  size_t item_size;
+  uint8_t first_shift;  // log2 of the number of items in the first segment
+  size_t reserved;  // Number of slots handed out to producers
+  size_t published;  // All slots below this index are committed
+} CVECTOR;
+
+ERROR cvector_init(CVECTOR *vec, size_t item_size, size_t first_capacity);
+void cvector_destroy(CVECTOR *vec);
+void *cvector_reserve(CVECTOR *vec, size_t *index);
+void cvector_commit(CVECTOR *vec, size_t index);
+void *cvector_push(CVECTOR *vec, const void * const value, size_t size);
+void *cvector_get(CVECTOR *vec, size_t index);
+size_t cvector_size(CVECTOR *vec);
+size_t cvector_published(CVECTOR *vec);
+
+// Number of items in segment k.
+static inline size_t cvector_segment_items(const CVECTOR *vec, size_t k) {
+  return (size_t)1 << (vec->first_shift + k);
+}
+
+// Find the segment and the offset inside it for an index. With a first
+// segment of n items, segment k starts at index n * (2^k - 1).
+static inline void cvector_locate(const CVECTOR *vec, size_t index,
+                                  size_t *segment, size_t *offset) {
+  size_t position = index + ((size_t)1 << vec->first_shift);
+  size_t top_bit = sizeof(long long) * 8 - 1 - __builtin_clzll(position);
+  *segment = top_bit - vec->first_shift;
+  *offset = position - ((size_t)1 << top_bit);
+}
+
+// Calculates a pointer to an element without checking if it was published,
+// use this to iterate over the first cvector_published() elements.
+static inline void *cvector_ptr(CVECTOR *vec, size_t index) {
+  size_t segment;
+  size_t offset;
+  cvector_locate(vec, index, &segment, &offset);
+  uint8_t *data = __atomic_load_n(&vec->segments[segment], __ATOMIC_ACQUIRE);
+  return data + offset * vec->item_size;
+}
+
+#endif  // CUTIL_CVECTOR_H
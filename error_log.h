@@ -18,8 +18,43 @@
 #ifndef CUTIL_ERROR_LOG_H
 #define CUTIL_ERROR_LOG_H
 
+#include <inttypes.h>
+#include <stdio.h>
+
+#include "ratelimit.h"
+
 #define ERROR_LOG(fmt, ...) do { \
   printf("Error in %s(%d): " fmt, __func__, __LINE__, ##__VA_ARGS__); \
 } while (0)
 
+// Like ERROR_LOG(), but prints at most per_second errors per second from
+// this call site. At most once a second the number of dropped errors is
+// printed after an error which got through, so errors dropped right before a
+// call site goes quiet are never reported.
+#define ERROR_LOG_RATELIMITED(per_second, fmt, ...) do { \
+  static RATELIMIT error_log_ratelimit_; \
+  if (ratelimit_allow(&error_log_ratelimit_, (per_second))) { \
+    ERROR_LOG(fmt, ##__VA_ARGS__); \
+    ERROR_LOG_SUPPRESSED(&error_log_ratelimit_); \
+  } \
+} while (0)
+
+// Like ERROR_LOG(), but only prints every k-th error from this call site. A
+// k of 0 or 1 prints every error.
+#define ERROR_LOG_SAMPLED(k, fmt, ...) do { \
+  static RATELIMIT error_log_ratelimit_; \
+  if (ratelimit_sample(&error_log_ratelimit_, (k))) { \
+    ERROR_LOG(fmt, ##__VA_ARGS__); \
+    ERROR_LOG_SUPPRESSED(&error_log_ratelimit_); \
+  } \
+} while (0)
+
+#define ERROR_LOG_SUPPRESSED(limit) do { \
+  uint64_t error_log_suppressed_ = ratelimit_summary(limit); \
+  if (error_log_suppressed_) { \
+    ERROR_LOG("suppressed %" PRIu64 " similar errors\n", \
+              error_log_suppressed_); \
+  } \
+} while (0)
+
 #endif  // CUTIL_ERROR_LOG_H
@@ -0,0 +1,270 @@
+// A hash map which stores keys and values inline, using open addressing with
+// linear probing over groups of control bytes.
+//
+// Author: Johannes Stüttgen (johannes.stuettgen@gmail.com)
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <stdlib.h>
+
+#include "hashmap.h"
+
+// Smallest capacity of a map, so a group never wraps more than once.
+static const size_t hashmap_min_capacity = HASHMAP_GROUP_SIZE;
+
+// Hash arbitrary bytes, 8 at a time.
+uint64_t hashmap_hash_bytes(const void *key, size_t key_size) {
+  const uint8_t *bytes = key;
+  uint64_t hash = 0x9e3779b97f4a7c15ULL ^ key_size;
+  while (key_size >= sizeof(uint64_t)) {
+    uint64_t word;
+    memcpy(&word, bytes, sizeof(word));
+    hash = (hash ^ word) * 0xbf58476d1ce4e5b9ULL;
+    hash ^= hash >> 31;
+    bytes += sizeof(word);
+    key_size -= sizeof(word);
+  }
+  if (key_size) {
+    uint64_t word = 0;
+    memcpy(&word, bytes, key_size);
+    hash = (hash ^ word) * 0xbf58476d1ce4e5b9ULL;
+  }
+  return hashmap_hash_u64(hash);
+}
+
+bool hashmap_equal_bytes(const void *a, const void *b, size_t key_size) {
+  return memcmp(a, b, key_size) == 0;
+}
+
+// Largest power of two up to 8 which divides size, used as the alignment of
+// keys and values in a slot.
+static size_t hashmap_alignment(size_t size) {
+  size_t alignment = size & -size;
+  if (alignment == 0 || alignment > 8) {
+    return 8;
+  }
+  return alignment;
+}
+
+// Number of entries a map of this capacity holds before it grows (7/8).
+static size_t hashmap_max_load(size_t capacity) {
+  return capacity - capacity / 8;
+}
+
+// Set the control byte of a slot, including its mirror behind the end.
+static void hashmap_set_ctrl(HASHMAP *map, size_t index, uint8_t ctrl) {
+  map->ctrl[index] = ctrl;
+  if (index < HASHMAP_GROUP_SIZE) {
+    map->ctrl[map->capacity + index] = ctrl;
+  }
+}
+
+// Put a key which is known not to be in the map into the first free slot of
+// its cluster. The map must have room for it.
+static uint8_t *hashmap_place(HASHMAP *map, const void * const key,
+                              uint64_t hash) {
+  size_t mask = map->capacity - 1;
+  size_t pos = (hash >> 7) & mask;
+  uint32_t empty;
+  while (!(empty = hashmap_group_empty(map->ctrl + pos))) {
+    pos = (pos + HASHMAP_GROUP_SIZE) & mask;
+  }
+  size_t index = (pos + __builtin_ctz(empty)) & mask;
+  hashmap_set_ctrl(map, index, hash & 0x7f);
+  uint8_t *slot = map->slots + index * map->slot_size;
+  memcpy(slot, key, map->key_size);
+  map->size++;
+  return slot;
+}
+
+// Move all entries into new storage with the given capacity.
+static ERROR hashmap_resize(HASHMAP *map, size_t capacity) {
+  uint8_t *ctrl = malloc(capacity + HASHMAP_GROUP_SIZE);
+  uint8_t *slots = calloc(capacity, map->slot_size);
+  if (!ctrl || !slots) {
+    free(ctrl);
+    free(slots);
+    return FAILURE;
+  }
+  memset(ctrl, HASHMAP_EMPTY, capacity + HASHMAP_GROUP_SIZE);
+
+  HASHMAP old = *map;
+  map->ctrl = ctrl;
+  map->slots = slots;
+  map->capacity = capacity;
+  map->size = 0;
+  for (size_t i = 0; i < old.capacity; ++i) {
+    if (old.ctrl[i] & HASHMAP_EMPTY) {
+      continue;
+    }
+    uint8_t *old_slot = old.slots + i * old.slot_size;
+    uint8_t *slot = hashmap_place(map, old_slot,
+                                  map->hash(old_slot, map->key_size));
+    memcpy(slot + map->value_offset, old_slot + map->value_offset,
+           map->value_size);
+  }
+  free(old.ctrl);
+  free(old.slots);
+  return SUCCESS;
+}
+
+// Create a new map.
+//
+// Args:
+//  map: pointer to the map to initialize
+//  key_size: size of the keys
+//  value_size: size of the values, may be 0 to use the map as a set
+//  hash: hash function for keys, NULL hashes the raw key bytes
+//  equal: compares two keys, NULL compares the raw key bytes
+ERROR hashmap_init(HASHMAP *map, size_t key_size, size_t value_size,
+                   HASHMAP_HASH hash, HASHMAP_EQUAL equal) {
+  map->ctrl = NULL;
+  map->slots = NULL;
+  map->capacity = 0;
+  map->size = 0;
+  if (key_size == 0) {
+    return FAILURE;
+  }
+  size_t key_alignment = hashmap_alignment(key_size);
+  size_t value_alignment = hashmap_alignment(value_size);
+  size_t slot_alignment = key_alignment > value_alignment ?
+                          key_alignment : value_alignment;
+  map->key_size = key_size;
+  map->value_size = value_size;
+  map->value_offset = (key_size + value_alignment - 1) &
+                      ~(value_alignment - 1);
+  map->slot_size = (map->value_offset + value_size + slot_alignment - 1) &
+                   ~(slot_alignment - 1);
+  map->hash = hash ? hash : hashmap_hash_bytes;
+  map->equal = equal ? equal : hashmap_equal_bytes;
+  return hashmap_resize(map, hashmap_min_capacity);
+}
+
+// release all memory the map holds.
+void hashmap_destroy(HASHMAP *map) {
+  free(map->ctrl);
+  free(map->slots);
+  map->ctrl = NULL;
+  map->slots = NULL;
+}
+
+// Make sure the map can hold count entries without growing.
+ERROR hashmap_reserve(HASHMAP *map, size_t count) {
+  size_t capacity = map->capacity;
+  while (hashmap_max_load(capacity) < count) {
+    if (capacity > SIZE_MAX / 2) {
+      return FAILURE;
+    }
+    capacity *= 2;
+  }
+  if (capacity == map->capacity) {
+    return SUCCESS;
+  }
+  return hashmap_resize(map, capacity);
+}
+
+// Insert a key which is known not to be in the map, growing the map if it
+// is full. Returns a pointer to the key in its slot or NULL if the map
+// can't grow. The value is zeroed.
+void *hashmap_insert_hashed(HASHMAP *map, const void * const key,
+                            uint64_t hash) {
+  if (map->size >= hashmap_max_load(map->capacity) &&
+      hashmap_reserve(map, map->size + 1) != SUCCESS) {
+    return NULL;
+  }
+  uint8_t *slot = hashmap_place(map, key, hash);
+  memset(slot + map->value_offset, 0, map->value_size);
+  return slot;
+}
+
+// Get a pointer to the value stored for a key, or NULL if the key is not in
+// the map.
+void *hashmap_get(const HASHMAP *map, const void * const key) {
+  uint8_t *slot = hashmap_find_hashed(map, key,
+                                      map->hash(key, map->key_size),
+                                      map->equal);
+  return slot ? slot + map->value_offset : NULL;
+}
+
+// Get a pointer to the value stored for a key, inserting the key with a
+// zeroed value first if it is not in the map yet. Returns NULL if the map
+// can't grow.
+void *hashmap_put_new(HASHMAP *map, const void * const key) {
+  uint64_t hash = map->hash(key, map->key_size);
+  uint8_t *slot = hashmap_find_hashed(map, key, hash, map->equal);
+  if (!slot) {
+    slot = hashmap_insert_hashed(map, key, hash);
+    if (!slot) {
+      return NULL;
+    }
+  }
+  return slot + map->value_offset;
+}
+
+// Store a copy of the value for a key, replacing the previous value if the
+// key is already in the map. Returns a pointer to the stored value or NULL
+// if the map can't grow.
+void *hashmap_put(HASHMAP *map, const void * const key,
+                  const void * const value) {
+  void *stored = hashmap_put_new(map, key);
+  if (stored) {
+    memcpy(stored, value, map->value_size);
+  }
+  return stored;
+}
+
+// Remove the entry in a slot. Following entries of the same cluster move
+// back into the hole, unless that would put them in front of their home
+// slot. This keeps every entry reachable from its home slot without gaps,
+// so no tombstones are needed.
+void hashmap_del_slot(HASHMAP *map, void *slot) {
+  size_t mask = map->capacity - 1;
+  size_t hole = ((uint8_t *)slot - map->slots) / map->slot_size;
+  for (size_t next = (hole + 1) & mask; !(map->ctrl[next] & HASHMAP_EMPTY);
+       next = (next + 1) & mask) {
+    uint8_t *next_slot = map->slots + next * map->slot_size;
+    size_t home = (map->hash(next_slot, map->key_size) >> 7) & mask;
+    if (((next - home) & mask) < ((next - hole) & mask)) {
+      continue;
+    }
+    memcpy(map->slots + hole * map->slot_size, next_slot, map->slot_size);
+    hashmap_set_ctrl(map, hole, map->ctrl[next]);
+    hole = next;
+  }
+  hashmap_set_ctrl(map, hole, HASHMAP_EMPTY);
+  map->size--;
+}
+
+// Remove a key and its value from the map.
+ERROR hashmap_del(HASHMAP *map, const void * const key) {
+  void *slot = hashmap_find_hashed(map, key, map->hash(key, map->key_size),
+                                   map->equal);
+  if (!slot) {
+    return FAILURE;
+  }
+  hashmap_del_slot(map, slot);
+  return SUCCESS;
+}
+
+// Iterate over all entries in the map, in no particular order. Start with
+// index 0, every call returns a pointer to the key of the next entry and
+// advances the index, until it returns NULL. Use hashmap_value() to get to
+// the value. The map must not be changed while iterating.
+void *hashmap_next(const HASHMAP *map, size_t *index) {
+  for (; *index < map->capacity; ++*index) {
+    if (!(map->ctrl[*index] & HASHMAP_EMPTY)) {
+      return map->slots + (*index)++ * map->slot_size;
+    }
+  }
+  return NULL;
+}
@@ -0,0 +1,238 @@
+// A hash map which stores keys and values inline, just like VECTOR stores
+// its items. put() copies the key and the value into the map, so the map
+// owns its memory and a single hashmap_destroy() releases everything.
+//
+// The map uses open addressing with linear probing. Next to the slots it
+// keeps one control byte per slot, which is either HASHMAP_EMPTY or the low 7
+// bits of the hash of the key in the slot. Lookups compare 16 control bytes
+// at a time (with SSE2 where available), so they only touch the slots whose
+// control byte matches and rarely need more than one step even at the
+// maximum load factor of 7/8. Deleting shifts the following entries back
+// instead of leaving tombstones, so lookups never slow down over time.
+//
+// NOTE: Just like with VECTOR, pointers into the map are only valid until
+// the next put() or del().
+//
+// Author: Johannes Stüttgen (johannes.stuettgen@gmail.com)
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef CUTIL_HASHMAP_H
+#define CUTIL_HASHMAP_H
+
+#include <string.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "types.h"
+
+// Number of control bytes probed at once.
+#define HASHMAP_GROUP_SIZE 16
+
+// Control byte of a free slot, used slots store 7 bits of their hash.
+#define HASHMAP_EMPTY 0x80
+
+// Hash functions get a pointer to a key and the key size of the map.
+typedef uint64_t (*HASHMAP_HASH)(const void *key, size_t key_size);
+
+// Returns true if the two keys are equal.
+typedef bool (*HASHMAP_EQUAL)(const void *a, const void *b, size_t key_size);
+
+typedef struct HASHMAP_ {
+  uint8_t *ctrl;   // capacity control bytes, the first group mirrored behind
+  uint8_t *slots;  // capacity slots of slot_size, key followed by value
+  size_t capacity;
+  size_t size;
+  size_t key_size;
+  size_t value_size;
+  size_t value_offset;
+  size_t slot_size;
+  HASHMAP_HASH hash;
+  HASHMAP_EQUAL equal;
+} HASHMAP;
+
+ERROR hashmap_init(HASHMAP *map, size_t key_size, size_t value_size,
+                   HASHMAP_HASH hash, HASHMAP_EQUAL equal);
+void hashmap_destroy(HASHMAP *map);
+ERROR hashmap_reserve(HASHMAP *map, size_t count);
+void *hashmap_get(const HASHMAP *map, const void * const key);
+void *hashmap_put(HASHMAP *map, const void * const key,
+                  const void * const value);
+void *hashmap_put_new(HASHMAP *map, const void * const key);
+ERROR hashmap_del(HASHMAP *map, const void * const key);
+void *hashmap_next(const HASHMAP *map, size_t *index);
+
+// Used by the typed maps below, see hashmap.c.
+void *hashmap_insert_hashed(HASHMAP *map, const void * const key,
+                            uint64_t hash);
+void hashmap_del_slot(HASHMAP *map, void *slot);
+
+// The default hash and equality functions, which work on the raw bytes of
+// the key. Don't use them for keys with padding.
+uint64_t hashmap_hash_bytes(const void *key, size_t key_size);
+bool hashmap_equal_bytes(const void *a, const void *b, size_t key_size);
+
+// Scrambles the bits of an integer key, use this to hash integers.
+static inline uint64_t hashmap_hash_u64(uint64_t key) {
+  key ^= key >> 33;
+  key *= 0xff51afd7ed558ccdULL;
+  key ^= key >> 33;
+  key *= 0xc4ceb9fe1a85ec53ULL;
+  key ^= key >> 33;
+  return key;
+}
+
+// Get the value of an entry from the pointer to its key, as returned by
+// hashmap_next().
+static inline void *hashmap_value(const HASHMAP *map, void *key) {
+  return (uint8_t *)key + map->value_offset;
+}
+
+// Bitmask of the control bytes in a group which equal byte.
+static inline uint32_t hashmap_group_match(const uint8_t *ctrl,
+                                           uint8_t byte) {
+#ifdef __SSE2__
+  __m128i group = _mm_loadu_si128((const __m128i *)ctrl);
+  return _mm_movemask_epi8(_mm_cmpeq_epi8(group, _mm_set1_epi8(byte)));
+#else
+  uint32_t mask = 0;
+  for (size_t i = 0; i < HASHMAP_GROUP_SIZE; ++i) {
+    mask |= (uint32_t)(ctrl[i] == byte) << i;
+  }
+  return mask;
+#endif
+}
+
+// Bitmask of the free slots in a group.
+static inline uint32_t hashmap_group_empty(const uint8_t *ctrl) {
+#ifdef __SSE2__
+  return _mm_movemask_epi8(_mm_loadu_si128((const __m128i *)ctrl));
+#else
+  return hashmap_group_match(ctrl, HASHMAP_EMPTY);
+#endif
+}
+
+// Find the slot holding a key, given the hash of the key. Returns a pointer
+// to the key in the slot or NULL if the map doesn't contain the key.
+// This is inline so the typed maps can inline their equality function.
+static inline void *hashmap_find_hashed(const HASHMAP *map,
+                                        const void * const key,
+                                        uint64_t hash, HASHMAP_EQUAL equal) {
+  size_t mask = map->capacity - 1;
+  size_t pos = (hash >> 7) & mask;
+  uint8_t tag = hash & 0x7f;
+  while (true) {
+    uint32_t empty = hashmap_group_empty(map->ctrl + pos);
+    uint32_t match = hashmap_group_match(map->ctrl + pos, tag);
+    // Entries behind the first free slot belong to another cluster.
+    if (empty) {
+      match &= (empty & -empty) - 1;
+    }
+    while (match) {
+      uint8_t *slot = map->slots +
+          ((pos + __builtin_ctz(match)) & mask) * map->slot_size;
+      if (equal(slot, key, map->key_size)) {
+        return slot;
+      }
+      match &= match - 1;
+    }
+    if (empty) {
+      return NULL;
+    }
+    pos = (pos + HASHMAP_GROUP_SIZE) & mask;
+  }
+}
+
+// Generates a map for a single key and value type, e.g.
+//
+//   #define NAME_HASH(key) hashmap_hash_bytes(*(key), strlen(*(key)))
+//   #define NAME_EQUAL(a, b) (strcmp(*(a), *(b)) == 0)
+//   HASHMAP_DEFINE(name_map, const char *, size_t, NAME_HASH, NAME_EQUAL)
+//
+// declares the type name_map and the functions
+//
+//   ERROR name_map_init(name_map *map);
+//   void name_map_destroy(name_map *map);
+//   size_t *name_map_get(const name_map *map, const char *key);
+//   size_t *name_map_put(name_map *map, const char *key, size_t value);
+//   ERROR name_map_del(name_map *map, const char *key);
+//   size_t name_map_size(const name_map *map);
+//
+// 'hash' gets a pointer to a key and returns its 64 bit hash, 'equal' gets
+// pointers to two keys and returns true if they are equal. Both are inlined
+// into the lookup, which avoids the indirect calls of the generic map.
+// Keys and values are passed by value, and the map wraps a HASHMAP 'map'
+// which works with all generic functions.
+#define HASHMAP_DEFINE(name, key_type, value_type, hash, equal) \
+typedef struct name##_ { \
+  HASHMAP map; \
+} name; \
+\
+static inline uint64_t name##_hash(const void *key, size_t key_size) { \
+  (void)key_size; \
+  return hash((const key_type *)key); \
+} \
+\
+static inline bool name##_equal(const void *a, const void *b, \
+                                size_t key_size) { \
+  (void)key_size; \
+  return equal((const key_type *)a, (const key_type *)b); \
+} \
+\
+static inline ERROR name##_init(name *map) { \
+  return hashmap_init(&map->map, sizeof(key_type), sizeof(value_type), \
+                      name##_hash, name##_equal); \
+} \
+\
+static inline void name##_destroy(name *map) { \
+  hashmap_destroy(&map->map); \
+} \
+\
+static inline value_type *name##_get(const name *map, key_type key) { \
+  uint8_t *slot = hashmap_find_hashed(&map->map, &key, hash(&key), \
+                                      name##_equal); \
+  return slot ? (value_type *)(slot + map->map.value_offset) : NULL; \
+} \
+\
+static inline value_type *name##_put(name *map, key_type key, \
+                                     value_type value) { \
+  uint64_t key_hash = hash(&key); \
+  uint8_t *slot = hashmap_find_hashed(&map->map, &key, key_hash, \
+                                      name##_equal); \
+  if (!slot) { \
+    slot = hashmap_insert_hashed(&map->map, &key, key_hash); \
+    if (!slot) { \
+      return NULL; \
+    } \
+  } \
+  value_type *stored = (value_type *)(slot + map->map.value_offset); \
+  *stored = value; \
+  return stored; \
+} \
+\
+static inline ERROR name##_del(name *map, key_type key) { \
+  uint8_t *slot = hashmap_find_hashed(&map->map, &key, hash(&key), \
+                                      name##_equal); \
+  if (!slot) { \
+    return FAILURE; \
+  } \
+  hashmap_del_slot(&map->map, slot); \
+  return SUCCESS; \
+} \
+\
+static inline size_t name##_size(const name *map) { \
+  return map->map.size; \
+}
+
+#endif  // CUTIL_HASHMAP_H
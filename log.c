@@ -16,20 +16,357 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#include <pthread.h>
+#include <sched.h>
 #include <stdarg.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
 
+#include "buffer.h"
 #include "log.h"
+#include "ringbuffer.h"
 
 LOGLEVEL log_level = LL_LOG;
 
-void log_print(LOGLEVEL msg_level, const char *fmt, ...) {
-  va_list argptr;
+// Number of records the background thread writes with one writev().
+#define LOG_BATCH_SIZE 64
 
-  if (msg_level > log_level) {
+// How long the background thread sleeps when nobody asked it to write.
+#define LOG_IDLE_NS 10000000
+
+typedef struct LOG_RECORD_ {
+  uint32_t length;
+  char text[LOG_RECORD_SIZE - sizeof(uint32_t)];
+} LOG_RECORD;
+
+// The ring of one thread. It stays registered after the thread exited,
+// until the background thread wrote its last records.
+typedef struct LOG_THREAD_ {
+  SPSC_RING ring;
+  bool exited;
+  struct LOG_THREAD_ *next;
+} LOG_THREAD;
+
+// State of async mode. The lock protects the list of threads and the flush
+// counters, everything else is constant while async mode runs.
+typedef struct LOG_ASYNC_ {
+  bool running;
+  bool sleeping;           // The background thread waits for a wake up
+  int fd;
+  size_t capacity;
+  LOG_FULL_POLICY policy;
+  size_t generation;       // Incremented by every log_async_start()
+  size_t dropped;
+  size_t flush_requested;  // Number of log_flush() calls so far
+  size_t flushed;          // Last flush request the background thread did
+  LOG_THREAD *threads;
+  BUFFER_CHAIN chain;
+  pthread_t writer;
+  pthread_key_t key;
+  pthread_mutex_t lock;
+  pthread_cond_t wake;
+  pthread_cond_t done;
+} LOG_ASYNC;
+
+static LOG_ASYNC log_async = {
+  .lock = PTHREAD_MUTEX_INITIALIZER,
+  .wake = PTHREAD_COND_INITIALIZER,
+  .done = PTHREAD_COND_INITIALIZER
+};
+
+// All modules registered with log_module_register().
+static LOG_MODULE *log_modules = NULL;
+static pthread_mutex_t log_modules_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// The ring of the calling thread, if log_thread_generation is current.
+static __thread LOG_THREAD *log_thread;
+static __thread size_t log_thread_generation;
+
+// Destructor of the thread specific key, runs when a thread exits.
+static void log_thread_exit(void *thread) {
+  log_thread_generation = 0;
+  __atomic_store_n(&((LOG_THREAD *)thread)->exited, true, __ATOMIC_RELEASE);
+}
+
+// Get the ring of the calling thread, registering a new one on the first
+// message a thread logs.
+static LOG_THREAD *log_thread_get(void) {
+  size_t generation = __atomic_load_n(&log_async.generation,
+                                      __ATOMIC_ACQUIRE);
+  if (log_thread_generation == generation) {
+    return log_thread;
+  }
+  LOG_THREAD *thread;
+  if (posix_memalign((void **)&thread, CUTIL_CACHE_LINE, sizeof(*thread))) {
+    return NULL;
+  }
+  if (spsc_ring_init(&thread->ring, sizeof(LOG_RECORD),
+                     log_async.capacity) != SUCCESS) {
+    free(thread);
+    return NULL;
+  }
+  thread->exited = false;
+  pthread_mutex_lock(&log_async.lock);
+  thread->next = log_async.threads;
+  log_async.threads = thread;
+  pthread_mutex_unlock(&log_async.lock);
+  pthread_setspecific(log_async.key, thread);
+  log_thread = thread;
+  log_thread_generation = generation;
+  return thread;
+}
+
+// Wake the background thread if it is sleeping.
+static void log_wake(void) {
+  if (__atomic_load_n(&log_async.sleeping, __ATOMIC_RELAXED)) {
+    pthread_mutex_lock(&log_async.lock);
+    pthread_cond_signal(&log_async.wake);
+    pthread_mutex_unlock(&log_async.lock);
+  }
+}
+
+static void log_write_records(LOG_RECORD *records, size_t count) {
+  for (size_t i = 0; i < count; ++i) {
+    buf_chain_append_ref(&log_async.chain, records[i].text,
+                         records[i].length);
+  }
+  if (buf_chain_write(&log_async.chain, log_async.fd) != SUCCESS) {
+    buf_chain_clear(&log_async.chain);
+  }
+}
+
+// Write all records which are in the rings of all threads right now.
+static void log_drain(LOG_RECORD *records) {
+  pthread_mutex_lock(&log_async.lock);
+  LOG_THREAD *thread = log_async.threads;
+  pthread_mutex_unlock(&log_async.lock);
+
+  size_t count = 0;
+  for (; thread; thread = thread->next) {
+    size_t popped;
+    while ((popped = spsc_ring_pop_n(&thread->ring, records + count,
+                                     LOG_BATCH_SIZE - count))) {
+      count += popped;
+      if (count == LOG_BATCH_SIZE) {
+        log_write_records(records, count);
+        count = 0;
+      }
+    }
+  }
+  if (count) {
+    log_write_records(records, count);
+  }
+}
+
+// Release the rings of threads which exited and have nothing left to write.
+static void log_reap(void) {
+  pthread_mutex_lock(&log_async.lock);
+  LOG_THREAD **link = &log_async.threads;
+  while (*link) {
+    LOG_THREAD *thread = *link;
+    if (__atomic_load_n(&thread->exited, __ATOMIC_ACQUIRE) &&
+        spsc_ring_size(&thread->ring) == 0) {
+      *link = thread->next;
+      spsc_ring_destroy(&thread->ring);
+      free(thread);
+    } else {
+      link = &thread->next;
+    }
+  }
+  pthread_mutex_unlock(&log_async.lock);
+}
+
+// The background thread. Every round it writes everything logged so far
+// and then sleeps until it is woken up, or for LOG_IDLE_NS.
+static void *log_writer(void *arg) {
+  (void)arg;
+  LOG_RECORD records[LOG_BATCH_SIZE];
+  size_t reported = 0;
+
+  pthread_mutex_lock(&log_async.lock);
+  while (true) {
+    size_t flush = log_async.flush_requested;
+    bool running = log_async.running;
+    pthread_mutex_unlock(&log_async.lock);
+
+    log_drain(records);
+    size_t dropped = __atomic_load_n(&log_async.dropped, __ATOMIC_RELAXED);
+    if (dropped != reported) {
+      records[0].length = snprintf(records[0].text, sizeof(records[0].text),
+                                   "[-] %zu log messages dropped\n",
+                                   dropped - reported);
+      log_write_records(records, 1);
+      reported = dropped;
+    }
+    log_reap();
+
+    pthread_mutex_lock(&log_async.lock);
+    log_async.flushed = flush;
+    pthread_cond_broadcast(&log_async.done);
+    if (!running) {
+      break;
+    }
+    if (log_async.flush_requested == flush && log_async.running) {
+      struct timespec deadline;
+      clock_gettime(CLOCK_REALTIME, &deadline);
+      deadline.tv_nsec += LOG_IDLE_NS;
+      if (deadline.tv_nsec >= 1000000000) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000;
+      }
+      __atomic_store_n(&log_async.sleeping, true, __ATOMIC_RELAXED);
+      pthread_cond_timedwait(&log_async.wake, &log_async.lock, &deadline);
+      __atomic_store_n(&log_async.sleeping, false, __ATOMIC_RELAXED);
+    }
+  }
+  pthread_mutex_unlock(&log_async.lock);
+  return NULL;
+}
+
+// Switch log_print() to async mode. Messages logged so far to stdout are
+// flushed first. Fails if async mode already runs.
+//
+// Args:
+//  fd: file descriptor all messages are written to, e.g. STDOUT_FILENO
+//  capacity: number of records in the ring of every thread, 0 for
+//            LOG_ASYNC_DEFAULT_CAPACITY
+//  policy: what to do with messages when the ring of a thread is full
+ERROR log_async_start(int fd, size_t capacity, LOG_FULL_POLICY policy) {
+  static bool flush_at_exit = false;
+
+  fflush(stdout);
+  pthread_mutex_lock(&log_async.lock);
+  if (log_async.running || buf_chain_init(&log_async.chain, 0) != SUCCESS) {
+    pthread_mutex_unlock(&log_async.lock);
+    return FAILURE;
+  }
+  if (pthread_key_create(&log_async.key, log_thread_exit) != 0) {
+    buf_chain_destroy(&log_async.chain);
+    pthread_mutex_unlock(&log_async.lock);
+    return FAILURE;
+  }
+  log_async.fd = fd;
+  log_async.capacity = capacity ? capacity : LOG_ASYNC_DEFAULT_CAPACITY;
+  log_async.policy = policy;
+  log_async.dropped = 0;
+  log_async.flushed = log_async.flush_requested;
+  __atomic_add_fetch(&log_async.generation, 1, __ATOMIC_RELEASE);
+  __atomic_store_n(&log_async.running, true, __ATOMIC_RELEASE);
+  if (pthread_create(&log_async.writer, NULL, log_writer, NULL) != 0) {
+    __atomic_store_n(&log_async.running, false, __ATOMIC_RELEASE);
+    pthread_key_delete(log_async.key);
+    buf_chain_destroy(&log_async.chain);
+    pthread_mutex_unlock(&log_async.lock);
+    return FAILURE;
+  }
+  if (!flush_at_exit) {
+    atexit(log_flush);
+    flush_at_exit = true;
+  }
+  pthread_mutex_unlock(&log_async.lock);
+  return SUCCESS;
+}
+
+// Write all pending messages, stop the background thread and switch
+// log_print() back to synchronous output.
+//
+// NOTE: No other thread may log while this runs, or its messages are lost.
+void log_async_stop(void) {
+  pthread_mutex_lock(&log_async.lock);
+  if (!log_async.running) {
+    pthread_mutex_unlock(&log_async.lock);
+    return;
+  }
+  __atomic_store_n(&log_async.running, false, __ATOMIC_RELEASE);
+  pthread_cond_signal(&log_async.wake);
+  pthread_mutex_unlock(&log_async.lock);
+  pthread_join(log_async.writer, NULL);
+
+  while (log_async.threads) {
+    LOG_THREAD *thread = log_async.threads;
+    log_async.threads = thread->next;
+    spsc_ring_destroy(&thread->ring);
+    free(thread);
+  }
+  pthread_key_delete(log_async.key);
+  buf_chain_destroy(&log_async.chain);
+}
+
+// Wait until all messages logged so far are written.
+void log_flush(void) {
+  pthread_mutex_lock(&log_async.lock);
+  if (!log_async.running) {
+    pthread_mutex_unlock(&log_async.lock);
+    fflush(stdout);
+    fflush(stderr);
+    return;
+  }
+  size_t request = ++log_async.flush_requested;
+  pthread_cond_signal(&log_async.wake);
+  while (log_async.flushed < request) {
+    pthread_cond_wait(&log_async.done, &log_async.lock);
+  }
+  pthread_mutex_unlock(&log_async.lock);
+}
+
+// Number of messages dropped since async mode started.
+size_t log_dropped(void) {
+  return __atomic_load_n(&log_async.dropped, __ATOMIC_RELAXED);
+}
+
+// Format a message into a record and push it to the ring of the calling
+// thread.
+static void log_async_print(LOGLEVEL msg_level, const char *fmt,
+                            va_list args) {
+  LOG_THREAD *thread = log_thread_get();
+  if (!thread) {
+    __atomic_add_fetch(&log_async.dropped, 1, __ATOMIC_RELAXED);
+    return;
+  }
+  LOG_RECORD record;
+  size_t length = 0;
+  if (msg_level == LL_ERR) {
+    memcpy(record.text, "[-] ", 4);
+    length = 4;
+  } else if (msg_level != LL_MSG) {
+    memcpy(record.text, "[+] ", 4);
+    length = 4;
+  }
+  // Truncated messages still end in a newline, it replaces the 0.
+  size_t room = sizeof(record.text) - length;
+  int written = vsnprintf(record.text + length, room, fmt, args);
+  if (written > 0) {
+    length += (size_t)written < room ? (size_t)written : room - 1;
+  }
+  if (msg_level != LL_NNL) {
+    record.text[length++] = '\n';
+  }
+  record.length = length;
+
+  while (spsc_ring_push(&thread->ring, &record, sizeof(record)) != SUCCESS) {
+    if (log_async.policy == LOG_DROP) {
+      __atomic_add_fetch(&log_async.dropped, 1, __ATOMIC_RELAXED);
+      return;
+    }
+    log_wake();
+    sched_yield();
+  }
+  if (msg_level == LL_ERR) {
+    log_flush();
+  } else if ((thread->ring.tail & (thread->ring.mask >> 1)) == 0) {
+    // Wake the background thread every time the ring fills up halfway.
+    log_wake();
+  }
+}
+
+// Write a message, whatever its level is.
+static void log_vprint(LOGLEVEL msg_level, const char *fmt, va_list argptr) {
+  if (__atomic_load_n(&log_async.running, __ATOMIC_ACQUIRE)) {
+    log_async_print(msg_level, fmt, argptr);
     return;
   }
-  va_start(argptr, fmt);
   switch (msg_level) {
     case LL_ERR:
       fprintf(stderr, "[-] ");
@@ -55,5 +392,49 @@ void log_print(LOGLEVEL msg_level, const char *fmt, ...) {
       vprintf(fmt, argptr);
       break;
   }
+}
+
+void log_print(LOGLEVEL msg_level, const char *fmt, ...) {
+  va_list argptr;
+
+  if (msg_level > log_level) {
+    return;
+  }
+  va_start(argptr, fmt);
+  log_vprint(msg_level, fmt, argptr);
   va_end(argptr);
 }
+
+// Same as log_print() without checking log_level, for the LOG_* macros which
+// check the level before evaluating their arguments.
+void log_print_unfiltered(LOGLEVEL msg_level, const char *fmt, ...) {
+  va_list argptr;
+
+  va_start(argptr, fmt);
+  log_vprint(msg_level, fmt, argptr);
+  va_end(argptr);
+}
+
+// Add a module to the modules log_module_set_level() knows about. Modules
+// from LOG_MODULE_DEFINE() register themselves.
+void log_module_register(LOG_MODULE *module) {
+  pthread_mutex_lock(&log_modules_lock);
+  module->next = log_modules;
+  log_modules = module;
+  pthread_mutex_unlock(&log_modules_lock);
+}
+
+// Change the level of a module by its name, fails if there is no module
+// with that name.
+ERROR log_module_set_level(const char * const name, LOGLEVEL level) {
+  ERROR result = FAILURE;
+  pthread_mutex_lock(&log_modules_lock);
+  for (LOG_MODULE *module = log_modules; module; module = module->next) {
+    if (strcmp(module->name, name) == 0) {
+      __atomic_store_n(&module->level, level, __ATOMIC_RELAXED);
+      result = SUCCESS;
+    }
+  }
+  pthread_mutex_unlock(&log_modules_lock);
+  return result;
+}
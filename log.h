@@ -1,5 +1,19 @@
 // Simple logging functionality to prettify output and manage verbosity.
 //
+// By default log_print() writes synchronously to stdout and stderr. After
+// log_async_start() it only formats the message into a fixed size record
+// and hands it to a background thread through a ring buffer owned by the
+// calling thread, so logging never waits for I/O. The background thread
+// writes batches of records with a single writev(). Errors (LL_ERR) are
+// flushed before log_print() returns, everything else is written within a
+// few milliseconds, and log_flush() waits until all messages logged so far
+// are written. Messages are also flushed when the process exits.
+//
+// In async mode all messages go to the same file descriptor, and messages
+// longer than a record are truncated. Messages of one thread stay in order,
+// messages of different threads may be interleaved differently than they
+// were logged.
+//
 // Adapted from the LMAP project.
 // Copyright 2013 Google Inc. All Rights Reserved.
 // Author: Johannes Stüttgen (johannes.stuettgen@gmail.com)
@@ -19,6 +33,11 @@
 #ifndef CUTIL_LOG_H
 #define CUTIL_LOG_H
 
+#include <inttypes.h>
+
+#include "ratelimit.h"
+#include "types.h"
+
 typedef enum LOGLEVEL_ {
   LL_ERR = 0,  // Special error formatting (gets a '[-]' prefix)
   LL_NNL,  // No New Line
@@ -28,7 +47,134 @@ typedef enum LOGLEVEL_ {
   LL_DBG   // Really verbose debug logging
 } LOGLEVEL;
 
-LOGLEVEL log_level;
-void log_print(LOGLEVEL msg_level, const char *fmt, ...);
+// What log_print() does when the ring buffer of a thread is full in async
+// mode.
+typedef enum LOG_FULL_POLICY_ {
+  LOG_DROP = 0,  // Drop the message, the number of dropped messages is logged
+  LOG_BLOCK      // Wait for the background thread to make room
+} LOG_FULL_POLICY;
+
+// Number of records in the ring buffer of every thread in async mode.
+#define LOG_ASYNC_DEFAULT_CAPACITY 1024
+
+// Size of a record in async mode, including the prefix and the newline.
+#define LOG_RECORD_SIZE 256
+
+// The most verbose level the LOG_* macros below keep. Calls above it are
+// removed by the compiler, arguments and all, e.g. build with
+// -DCUTIL_LOG_MIN_LEVEL=LL_LOG to drop all verbose and debug logging.
+#ifndef CUTIL_LOG_MIN_LEVEL
+#define CUTIL_LOG_MIN_LEVEL LL_DBG
+#endif
+
+// A group of messages with its own level, which can be changed at runtime
+// by name. Define one with LOG_MODULE_DEFINE().
+typedef struct LOG_MODULE_ {
+  const char *name;
+  LOGLEVEL level;
+  struct LOG_MODULE_ *next;
+} LOG_MODULE;
+
+extern LOGLEVEL log_level;
+void log_print(LOGLEVEL msg_level, const char *fmt, ...)
+    __attribute__((format(printf, 2, 3)));
+void log_print_unfiltered(LOGLEVEL msg_level, const char *fmt, ...)
+    __attribute__((format(printf, 2, 3)));
+
+void log_module_register(LOG_MODULE *module);
+ERROR log_module_set_level(const char * const name, LOGLEVEL level);
+
+ERROR log_async_start(int fd, size_t capacity, LOG_FULL_POLICY policy);
+void log_async_stop(void);
+void log_flush(void);
+size_t log_dropped(void);
+
+// Log a message if its level is enabled. Unlike calling log_print()
+// directly, the level is checked inline before any argument is evaluated,
+// so disabled messages cost a load and a branch.
+#define LOG_AT(msg_level, ...) \
+  do { \
+    if ((msg_level) <= CUTIL_LOG_MIN_LEVEL && (msg_level) <= log_level) { \
+      log_print_unfiltered((msg_level), __VA_ARGS__); \
+    } \
+  } while (0)
+
+#define LOG_ERR(...) LOG_AT(LL_ERR, __VA_ARGS__)
+#define LOG_MSG(...) LOG_AT(LL_MSG, __VA_ARGS__)
+#define LOG_LOG(...) LOG_AT(LL_LOG, __VA_ARGS__)
+#define LOG_VER(...) LOG_AT(LL_VER, __VA_ARGS__)
+#define LOG_DBG(...) LOG_AT(LL_DBG, __VA_ARGS__)
+
+// Like LOG_AT(), but logs at most per_second messages per second from this
+// call site. Dropped messages are counted, and at most once a second the
+// count is logged after a message which got through, so messages dropped
+// right before a call site goes quiet are never reported.
+#define LOG_RATELIMITED(msg_level, per_second, ...) \
+  do { \
+    static RATELIMIT log_ratelimit_; \
+    if ((msg_level) <= CUTIL_LOG_MIN_LEVEL && (msg_level) <= log_level && \
+        ratelimit_allow(&log_ratelimit_, (per_second))) { \
+      log_print_unfiltered((msg_level), __VA_ARGS__); \
+      LOG_SUPPRESSED(msg_level, &log_ratelimit_); \
+    } \
+  } while (0)
+
+// Like LOG_AT(), but only logs every k-th message from this call site. A k
+// of 0 or 1 logs every message. The count of dropped messages is logged like
+// in LOG_RATELIMITED().
+#define LOG_SAMPLED(msg_level, k, ...) \
+  do { \
+    static RATELIMIT log_ratelimit_; \
+    if ((msg_level) <= CUTIL_LOG_MIN_LEVEL && (msg_level) <= log_level && \
+        ratelimit_sample(&log_ratelimit_, (k))) { \
+      log_print_unfiltered((msg_level), __VA_ARGS__); \
+      LOG_SUPPRESSED(msg_level, &log_ratelimit_); \
+    } \
+  } while (0)
+
+// Log how many messages a call site dropped, if a summary is due.
+#define LOG_SUPPRESSED(msg_level, limit) \
+  do { \
+    uint64_t log_suppressed_ = ratelimit_summary(limit); \
+    if (log_suppressed_) { \
+      log_print_unfiltered((msg_level), \
+                           "suppressed %" PRIu64 " messages from %s:%d", \
+                           log_suppressed_, __FILE__, __LINE__); \
+    } \
+  } while (0)
+
+// Defines a module with a default level, e.g. at file scope
+//
+//   LOG_MODULE_DEFINE(pool, LL_LOG)
+//   ...
+//   LOG_MODULE_DBG(pool, "new slab at %p", slab);
+//
+// Other files use the module after LOG_MODULE_DECLARE(pool). The module
+// registers itself before main() runs, so its level can be changed with
+// log_module_set_level("pool", LL_DBG) at any time.
+#define LOG_MODULE_DEFINE(module, default_level) \
+  LOG_MODULE log_module_##module = { #module, default_level, NULL }; \
+  __attribute__((constructor)) \
+  static void log_module_register_##module(void) { \
+    log_module_register(&log_module_##module); \
+  }
+
+#define LOG_MODULE_DECLARE(module) extern LOG_MODULE log_module_##module
+
+// Like LOG_AT(), but checks against the level of a module instead of
+// log_level.
+#define LOG_MODULE_AT(module, msg_level, ...) \
+  do { \
+    if ((msg_level) <= CUTIL_LOG_MIN_LEVEL && \
+        (msg_level) <= __atomic_load_n(&log_module_##module.level, \
+                                       __ATOMIC_RELAXED)) { \
+      log_print_unfiltered((msg_level), __VA_ARGS__); \
+    } \
+  } while (0)
+
+#define LOG_MODULE_ERR(module, ...) LOG_MODULE_AT(module, LL_ERR, __VA_ARGS__)
+#define LOG_MODULE_LOG(module, ...) LOG_MODULE_AT(module, LL_LOG, __VA_ARGS__)
+#define LOG_MODULE_VER(module, ...) LOG_MODULE_AT(module, LL_VER, __VA_ARGS__)
+#define LOG_MODULE_DBG(module, ...) LOG_MODULE_AT(module, LL_DBG, __VA_ARGS__)
 
 #endif  // CUTIL_LOG_H
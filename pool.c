@@ -0,0 +1,225 @@
+// A pool for lots of objects of the same size, which are allocated and freed
+// at a high rate from many threads.
+//
+// Author: Johannes Stüttgen (johannes.stuettgen@gmail.com)
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <string.h>
+
+#include "pool.h"
+
+// Every slab starts with this header, followed by the objects.
+typedef struct POOL_SLAB_ {
+  POOL *pool;
+  struct POOL_SLAB_ *next;
+} POOL_SLAB;
+
+// Objects start at this offset in a slab, which keeps them 16 byte aligned.
+static const size_t pool_slab_header_size = 16;
+
+static void pool_list_push(POOL_LIST *list, void *object) {
+  *(void **)object = list->head;
+  list->head = object;
+  list->count++;
+}
+
+static void *pool_list_pop(POOL_LIST *list) {
+  void *object = list->head;
+  list->head = *(void **)object;
+  list->count--;
+  return object;
+}
+
+// Hand a magazine to the depot. If the depot can't grow the objects are
+// not reused, but still released with their slabs by pool_destroy().
+static void pool_depot_push(POOL *pool, POOL_LIST *list) {
+  if (!list->count) {
+    return;
+  }
+  pthread_mutex_lock(&pool->lock);
+  vector_push(&pool->depot, list, sizeof(*list));
+  pthread_mutex_unlock(&pool->lock);
+  list->head = NULL;
+  list->count = 0;
+}
+
+// Fill an empty magazine, preferably with objects from the depot and
+// otherwise with fresh objects from the newest slab.
+static ERROR pool_refill(POOL *pool, POOL_LIST *list) {
+  pthread_mutex_lock(&pool->lock);
+  if (pool->depot.used_bytes) {
+    *list = *(POOL_LIST *)vector_get(&pool->depot,
+        pool->depot.used_bytes / sizeof(*list) - 1);
+    vector_pop(&pool->depot);
+    pthread_mutex_unlock(&pool->lock);
+    return SUCCESS;
+  }
+  if ((size_t)(pool->slab_end - pool->slab_next) < pool->object_size) {
+    POOL_SLAB *slab;
+    if (posix_memalign((void **)&slab, POOL_SLAB_SIZE, POOL_SLAB_SIZE)) {
+      pthread_mutex_unlock(&pool->lock);
+      return FAILURE;
+    }
+    slab->pool = pool;
+    slab->next = pool->slabs;
+    pool->slabs = slab;
+    pool->slab_next = (uint8_t *)slab + pool_slab_header_size;
+    pool->slab_end = (uint8_t *)slab + POOL_SLAB_SIZE;
+  }
+  while (list->count < POOL_BATCH_SIZE &&
+         (size_t)(pool->slab_end - pool->slab_next) >= pool->object_size) {
+    pool_list_push(list, pool->slab_next);
+    pool->slab_next += pool->object_size;
+  }
+  pthread_mutex_unlock(&pool->lock);
+  return SUCCESS;
+}
+
+// Called when a thread exits, gives its cached objects to the depot.
+static void pool_cache_destroy(void *arg) {
+  POOL_CACHE *cache = arg;
+  POOL *pool = cache->pool;
+  pool_depot_push(pool, &cache->loaded);
+  pool_depot_push(pool, &cache->previous);
+  pthread_mutex_lock(&pool->lock);
+  for (POOL_CACHE **pcache = &pool->caches; *pcache;
+       pcache = &(*pcache)->next) {
+    if (*pcache == cache) {
+      *pcache = cache->next;
+      break;
+    }
+  }
+  pthread_mutex_unlock(&pool->lock);
+  free(cache);
+}
+
+// Get the cache of the calling thread, creating it on first use.
+static POOL_CACHE *pool_cache(POOL *pool) {
+  POOL_CACHE *cache = pthread_getspecific(pool->cache_key);
+  if (cache) {
+    return cache;
+  }
+  cache = calloc(1, sizeof(*cache));
+  if (!cache) {
+    return NULL;
+  }
+  if (pthread_setspecific(pool->cache_key, cache)) {
+    free(cache);
+    return NULL;
+  }
+  cache->pool = pool;
+  pthread_mutex_lock(&pool->lock);
+  cache->next = pool->caches;
+  pool->caches = cache;
+  pthread_mutex_unlock(&pool->lock);
+  return cache;
+}
+
+// Create a new pool.
+//
+// Args:
+//  pool: pointer to the pool to initialize
+//  object_size: size of the objects in the pool, rounded up to a multiple of
+//               the pointer size. Objects with a size divisible by 16 are
+//               16 byte aligned, all others are pointer aligned.
+ERROR pool_init(POOL *pool, size_t object_size) {
+  if (object_size < sizeof(void *)) {
+    object_size = sizeof(void *);
+  }
+  object_size = (object_size + sizeof(void *) - 1) & ~(sizeof(void *) - 1);
+  if (object_size > POOL_SLAB_SIZE - pool_slab_header_size) {
+    return FAILURE;
+  }
+  pool->object_size = object_size;
+  pool->caches = NULL;
+  pool->slabs = NULL;
+  pool->slab_next = NULL;
+  pool->slab_end = NULL;
+  if (vector_init_policy(&pool->depot, sizeof(POOL_LIST), VECTOR_DEFAULT_SIZE,
+                         VECTOR_POLICY_NEVER_SHRINK)) {
+    return FAILURE;
+  }
+  if (pthread_key_create(&pool->cache_key, pool_cache_destroy)) {
+    vector_destroy(&pool->depot);
+    return FAILURE;
+  }
+  pthread_mutex_init(&pool->lock, NULL);
+  return SUCCESS;
+}
+
+// Release all memory the pool holds, this invalidates every object allocated
+// from it. Threads using the pool must not exit during the call.
+void pool_destroy(POOL *pool) {
+  pthread_key_delete(pool->cache_key);
+  while (pool->caches) {
+    POOL_CACHE *next = pool->caches->next;
+    free(pool->caches);
+    pool->caches = next;
+  }
+  while (pool->slabs) {
+    POOL_SLAB *next = ((POOL_SLAB *)pool->slabs)->next;
+    free(pool->slabs);
+    pool->slabs = next;
+  }
+  vector_destroy(&pool->depot);
+  pthread_mutex_destroy(&pool->lock);
+}
+
+// Allocate an object from the pool. Its contents are undefined.
+void *pool_alloc(POOL *pool) {
+  POOL_CACHE *cache = pool_cache(pool);
+  if (!cache) {
+    return NULL;
+  }
+  if (!cache->loaded.count) {
+    if (cache->previous.count) {
+      POOL_LIST tmp = cache->loaded;
+      cache->loaded = cache->previous;
+      cache->previous = tmp;
+    } else if (pool_refill(pool, &cache->loaded) != SUCCESS) {
+      return NULL;
+    }
+  }
+  return pool_list_pop(&cache->loaded);
+}
+
+// Give an object back to the pool it was allocated from.
+void pool_free(POOL *pool, void *object) {
+  POOL_CACHE *cache = pool_cache(pool);
+  if (!cache) {
+    POOL_LIST list = {NULL, 0};
+    pool_list_push(&list, object);
+    pool_depot_push(pool, &list);
+    return;
+  }
+  if (cache->loaded.count >= POOL_BATCH_SIZE) {
+    pool_depot_push(pool, &cache->previous);
+    cache->previous = cache->loaded;
+    cache->loaded.head = NULL;
+    cache->loaded.count = 0;
+  }
+  pool_list_push(&cache->loaded, object);
+}
+
+// Destructor for LOCAL_POOLED, gives the object back to the pool which owns
+// its slab and sets the pointer to NULL.
+void pool_release(void *pobject) {
+  void **ppobject = (void **)pobject;
+  if (*ppobject) {
+    POOL_SLAB *slab = (POOL_SLAB *)((uintptr_t)*ppobject &
+                                    ~(uintptr_t)(POOL_SLAB_SIZE - 1));
+    pool_free(slab->pool, *ppobject);
+    *ppobject = NULL;
+  }
+}
@@ -0,0 +1,85 @@
+// A pool for lots of objects of the same size, which are allocated and freed
+// at a high rate from many threads. Objects are carved from large slabs and
+// kept on intrusive free lists, so the pool itself never touches malloc()
+// once it is warm. Every thread has a small cache of free objects (two
+// magazines of POOL_BATCH_SIZE objects each), and only exchanges whole
+// magazines with a shared depot, so the depot lock is taken at most once
+// every POOL_BATCH_SIZE operations.
+//
+// Freed objects are never returned to the system before the pool is
+// destroyed. It is fine to free an object in another thread than the one
+// that allocated it.
+//
+// USAGE: Objects declared LOCAL_POOLED go back to their pool when they go
+// out of scope, the pool is found through the slab the object lives in:
+//
+//   LOCAL_POOLED NODE *node = pool_alloc(&pool);
+//
+// Author: Johannes Stüttgen (johannes.stuettgen@gmail.com)
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef CUTIL_POOL_H
+#define CUTIL_POOL_H
+
+#include <pthread.h>
+
+#include "raii.h"
+#include "types.h"
+#include "vector.h"
+
+// Return an object to its pool when the pointer goes out of scope.
+#define LOCAL_POOLED LOCAL_DESTRUCTOR(pool_release)
+
+// Slabs are aligned to their size, so the slab header of an object can be
+// found by masking its address.
+#define POOL_SLAB_SIZE (64 * 1024)
+
+// Number of objects in a magazine, which is moved to and from the depot as
+// a whole.
+#define POOL_BATCH_SIZE 64
+
+// An intrusive list of free objects, each free object stores the pointer to
+// the next one in its first bytes.
+typedef struct POOL_LIST_ {
+  void *head;
+  size_t count;
+} POOL_LIST;
+
+// Free objects cached by a single thread.
+typedef struct POOL_CACHE_ {
+  POOL_LIST loaded;
+  POOL_LIST previous;
+  struct POOL_CACHE_ *next;
+  struct POOL_ *pool;
+} POOL_CACHE;
+
+typedef struct POOL_ {
+  size_t object_size;
+  pthread_key_t cache_key;
+  pthread_mutex_t lock;
+  // Everything below is protected by the lock.
+  VECTOR depot;        // Magazines of free objects as POOL_LIST
+  POOL_CACHE *caches;  // All per thread caches
+  void *slabs;         // Allocated slabs, linked through their headers
+  uint8_t *slab_next;  // Next object never handed out in the newest slab
+  uint8_t *slab_end;
+} POOL;
+
+ERROR pool_init(POOL *pool, size_t object_size);
+void pool_destroy(POOL *pool);
+void *pool_alloc(POOL *pool);
+void pool_free(POOL *pool, void *object);
+void pool_release(void *pobject);
+
+#endif  // CUTIL_POOL_H
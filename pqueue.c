@@ -0,0 +1,192 @@
+// A priority queue stored as a d-ary heap in a VECTOR.
+//
+// Author: Johannes Stüttgen (johannes.stuettgen@gmail.com)
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <string.h>
+
+#include "pqueue.h"
+
+static uint8_t *pqueue_item(PQUEUE *pq, size_t index) {
+  return pq->vec.data + index * pq->vec.item_size;
+}
+
+// Copy an item into a slot of the heap and report its new position.
+static void pqueue_place(PQUEUE *pq, size_t index, const uint8_t *item) {
+  memcpy(pqueue_item(pq, index), item, pq->vec.item_size);
+  if (pq->moved) {
+    pq->moved(pqueue_item(pq, index), index, pq->ctx);
+  }
+}
+
+// Move the item at index up until its parent is ordered before it. Returns
+// the final index.
+static size_t pqueue_sift_up(PQUEUE *pq, size_t index) {
+  memcpy(pq->scratch, pqueue_item(pq, index), pq->vec.item_size);
+  while (index > 0) {
+    size_t parent = (index - 1) / pq->arity;
+    if (pq->cmp(pq->scratch, pqueue_item(pq, parent)) >= 0) {
+      break;
+    }
+    pqueue_place(pq, index, pqueue_item(pq, parent));
+    index = parent;
+  }
+  pqueue_place(pq, index, pq->scratch);
+  return index;
+}
+
+// Move the item at index down until none of its children is ordered before
+// it. All children of a node are next to each other, so finding the best
+// one touches only one or two cache lines.
+static void pqueue_sift_down(PQUEUE *pq, size_t index) {
+  size_t count = pqueue_size(pq);
+  size_t first;
+  memcpy(pq->scratch, pqueue_item(pq, index), pq->vec.item_size);
+  while ((first = index * pq->arity + 1) < count) {
+    size_t last = first + pq->arity < count ? first + pq->arity : count;
+    size_t best = first;
+    for (size_t child = first + 1; child < last; ++child) {
+      if (pq->cmp(pqueue_item(pq, child), pqueue_item(pq, best)) < 0) {
+        best = child;
+      }
+    }
+    if (pq->cmp(pqueue_item(pq, best), pq->scratch) >= 0) {
+      break;
+    }
+    pqueue_place(pq, index, pqueue_item(pq, best));
+    index = best;
+  }
+  pqueue_place(pq, index, pq->scratch);
+}
+
+// Create a new, empty priority queue.
+//
+// Args:
+//  pq: pointer to the queue to initialize
+//  item_size: size of an individual item in the queue
+//  arity: number of children per node, 4 or 8 are usually fastest
+//  cmp: comparator, the item ordered first is at the top
+ERROR pqueue_init(PQUEUE *pq, size_t item_size, size_t arity,
+                  VECTOR_COMPARATOR cmp) {
+  VECTOR items;
+  if (vector_init(&items, item_size, VECTOR_DEFAULT_SIZE) != SUCCESS) {
+    return FAILURE;
+  }
+  if (pqueue_heapify(pq, &items, arity, cmp) != SUCCESS) {
+    vector_destroy(&items);
+    return FAILURE;
+  }
+  return SUCCESS;
+}
+
+// Create a priority queue from all items of an existing vector in O(n).
+// On success the queue takes over the vector, which must not be used or
+// destroyed by the caller afterwards. On failure it is left to the caller.
+//
+// Args:
+//  pq: pointer to the queue to initialize
+//  items: vector with the initial items
+//  arity: number of children per node, 4 or 8 are usually fastest
+//  cmp: comparator, the item ordered first is at the top
+ERROR pqueue_heapify(PQUEUE *pq, VECTOR *items, size_t arity,
+                     VECTOR_COMPARATOR cmp) {
+  if (arity < 2) {
+    return FAILURE;
+  }
+  pq->scratch = malloc(items->item_size);
+  if (!pq->scratch) {
+    return FAILURE;
+  }
+  pq->vec = *items;
+  pq->arity = arity;
+  pq->cmp = cmp;
+  pq->moved = NULL;
+  pq->ctx = NULL;
+  size_t count = pqueue_size(pq);
+  for (size_t i = count / arity + 1; i-- > 0;) {
+    if (i < count) {
+      pqueue_sift_down(pq, i);
+    }
+  }
+  return SUCCESS;
+}
+
+// release all memory the queue holds.
+void pqueue_destroy(PQUEUE *pq) {
+  vector_destroy(&pq->vec);
+  free(pq->scratch);
+  pq->scratch = NULL;
+}
+
+// Report the new index of every item that moves from now on. The callback is
+// immediately called for all items already in the queue.
+void pqueue_track(PQUEUE *pq, PQUEUE_MOVED moved, void *ctx) {
+  pq->moved = moved;
+  pq->ctx = ctx;
+  if (moved) {
+    for (size_t i = 0; i < pqueue_size(pq); ++i) {
+      moved(pqueue_item(pq, i), i, ctx);
+    }
+  }
+}
+
+// Add a copy of an item to the queue.
+ERROR pqueue_push(PQUEUE *pq, const void * const item, size_t size) {
+  if (!vector_push(&pq->vec, item, size)) {
+    return FAILURE;
+  }
+  pqueue_sift_up(pq, pqueue_size(pq) - 1);
+  return SUCCESS;
+}
+
+// Remove the item at the top of the queue and copy it to item, unless item
+// is NULL.
+ERROR pqueue_pop(PQUEUE *pq, void *item) {
+  return pqueue_remove(pq, 0, item);
+}
+
+// Remove the item at index and copy it to item, unless item is NULL.
+ERROR pqueue_remove(PQUEUE *pq, size_t index, void *item) {
+  size_t count = pqueue_size(pq);
+  if (index >= count) {
+    return FAILURE;
+  }
+  if (item) {
+    memcpy(item, pqueue_item(pq, index), pq->vec.item_size);
+  }
+  if (index != count - 1) {
+    memcpy(pqueue_item(pq, index), pqueue_item(pq, count - 1),
+           pq->vec.item_size);
+  }
+  pq->vec.used_bytes -= pq->vec.item_size;
+  if (index != count - 1) {
+    pqueue_update(pq, index);
+  }
+  if (vector_should_shrink(&pq->vec)) {
+    vector_shrink(&pq->vec);
+  }
+  return SUCCESS;
+}
+
+// Restore the heap order after the priority of the item at index changed,
+// in either direction.
+ERROR pqueue_update(PQUEUE *pq, size_t index) {
+  if (index >= pqueue_size(pq)) {
+    return FAILURE;
+  }
+  if (pqueue_sift_up(pq, index) == index) {
+    pqueue_sift_down(pq, index);
+  }
+  return SUCCESS;
+}
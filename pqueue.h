@@ -0,0 +1,161 @@
+// A priority queue stored as a d-ary heap in a VECTOR. With 4 or 8 children
+// per node all siblings share a cache line or two, so a pop touches
+// log_d(n) instead of log_2(n) cache lines, at the cost of a few more
+// comparisons per level which are cheap once the line is loaded.
+//
+// The item at the top is the one the comparator orders first, so with a
+// comparator like the ones for qsort() the heap pops the smallest item.
+//
+// To change the priority of an item in the queue, track where its items
+// are with pqueue_track(). The callback gets every item which moved and its
+// new index, change the item through pqueue_get() and call pqueue_update().
+//
+// Author: Johannes Stüttgen (johannes.stuettgen@gmail.com)
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef CUTIL_PQUEUE_H
+#define CUTIL_PQUEUE_H
+
+#include "types.h"
+#include "vector.h"
+#include "vector_sort.h"
+
+// Gets an item and the index it moved to, and the ctx passed to
+// pqueue_track().
+typedef void (*PQUEUE_MOVED)(const void *item, size_t index, void *ctx);
+
+typedef struct PQUEUE_ {
+  VECTOR vec;
+  size_t arity;
+  VECTOR_COMPARATOR cmp;
+  PQUEUE_MOVED moved;
+  void *ctx;
+  uint8_t *scratch;  // Room for one item
+} PQUEUE;
+
+ERROR pqueue_init(PQUEUE *pq, size_t item_size, size_t arity,
+                  VECTOR_COMPARATOR cmp);
+ERROR pqueue_heapify(PQUEUE *pq, VECTOR *items, size_t arity,
+                     VECTOR_COMPARATOR cmp);
+void pqueue_destroy(PQUEUE *pq);
+void pqueue_track(PQUEUE *pq, PQUEUE_MOVED moved, void *ctx);
+ERROR pqueue_push(PQUEUE *pq, const void * const item, size_t size);
+ERROR pqueue_pop(PQUEUE *pq, void *item);
+ERROR pqueue_update(PQUEUE *pq, size_t index);
+ERROR pqueue_remove(PQUEUE *pq, size_t index, void *item);
+
+static inline size_t pqueue_size(const PQUEUE *pq) {
+  return pq->vec.used_bytes / pq->vec.item_size;
+}
+
+// The item at the top of the queue, or NULL if it is empty.
+static inline void *pqueue_peek(PQUEUE *pq) {
+  return vector_get(&pq->vec, 0);
+}
+
+static inline void *pqueue_get(PQUEUE *pq, size_t index) {
+  return vector_get(&pq->vec, index);
+}
+
+// Generates a heap with a fixed arity for a single item type on top of a
+// plain VECTOR, e.g.
+//
+//   #define TIMER_LESS(a, b, ctx) ((a)->deadline < (b)->deadline)
+//   PQUEUE_DEFINE(timer_heap, TIMER, 4, TIMER_LESS)
+//
+// declares timer_heap_push(VECTOR *vec, TIMER item, void *ctx),
+// timer_heap_pop(VECTOR *vec, TIMER *item, void *ctx) and
+// timer_heap_heapify(VECTOR *vec, void *ctx). 'less' works as for
+// VECTOR_SORT_DEFINE, the least item is on top. Use vector_get(vec, 0) to
+// peek. These inline the comparison and move items by assignment, but
+// don't track positions, use PQUEUE if you need pqueue_update().
+#define PQUEUE_DEFINE(name, type, arity, less) \
+static inline void name##_sift_up(type *items, size_t index, void *ctx) { \
+  (void)ctx; \
+  type item = items[index]; \
+  while (index > 0) { \
+    size_t parent = (index - 1) / (arity); \
+    if (!less(&item, &items[parent], ctx)) { \
+      break; \
+    } \
+    items[index] = items[parent]; \
+    index = parent; \
+  } \
+  items[index] = item; \
+} \
+\
+static inline void name##_sift_down(type *items, size_t index, size_t count, \
+                                    void *ctx) { \
+  (void)ctx; \
+  type item = items[index]; \
+  size_t first; \
+  while ((first = index * (arity) + 1) < count) { \
+    size_t last = first + (arity) < count ? first + (arity) : count; \
+    size_t best = first; \
+    for (size_t child = first + 1; child < last; ++child) { \
+      if (less(&items[child], &items[best], ctx)) { \
+        best = child; \
+      } \
+    } \
+    if (!less(&items[best], &item, ctx)) { \
+      break; \
+    } \
+    items[index] = items[best]; \
+    index = best; \
+  } \
+  items[index] = item; \
+} \
+\
+static inline ERROR name##_push(VECTOR *vec, type item, void *ctx) { \
+  if (__builtin_expect(vec->used_bytes >= vec->total_bytes, 0) && \
+      vector_grow(vec) != SUCCESS) { \
+    return FAILURE; \
+  } \
+  size_t index = vec->used_bytes / sizeof(type); \
+  ((type *)vec->data)[index] = item; \
+  vec->used_bytes += sizeof(type); \
+  name##_sift_up((type *)vec->data, index, ctx); \
+  return SUCCESS; \
+} \
+\
+static inline ERROR name##_pop(VECTOR *vec, type *item, void *ctx) { \
+  size_t count = vec->used_bytes / sizeof(type); \
+  type *items = (type *)vec->data; \
+  if (count == 0) { \
+    return FAILURE; \
+  } \
+  if (item) { \
+    *item = items[0]; \
+  } \
+  items[0] = items[--count]; \
+  vec->used_bytes -= sizeof(type); \
+  if (count > 1) { \
+    name##_sift_down(items, 0, count, ctx); \
+  } \
+  if (vector_should_shrink(vec)) { \
+    vector_shrink(vec); \
+  } \
+  return SUCCESS; \
+} \
+\
+static inline void name##_heapify(VECTOR *vec, void *ctx) { \
+  size_t count = vec->used_bytes / sizeof(type); \
+  for (size_t i = count / (arity) + 1; i-- > 0;) { \
+    if (i < count) { \
+      name##_sift_down((type *)vec->data, i, count, ctx); \
+    } \
+  } \
+}
+
+#endif  // CUTIL_PQUEUE_H
@@ -18,9 +18,12 @@
 #ifndef CUTIL_RAII_H
 #define CUTIL_RAII_H
 
+#include <fcntl.h>
 #include <stdio.h>
 #include <stdlib.h>
-#include <types.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "types.h"
 #include <unistd.h>
 
 // Automatically free memory when the pointer goes out of scope.
@@ -39,6 +42,11 @@
 // NOTE: Never use this on anything else or behaviour is undefined.
 #define LOCAL_FD __attribute__((cleanup(close_fd)))
 
+// Automatically unmap a MMAP_REGION, e.g. one mapped with mmap_file(),
+// when it goes out of scope.
+// NOTE: Initialize the region to {NULL, 0} if it might not get mapped.
+#define LOCAL_MMAP __attribute__((cleanup(unmap_region)))
+
 // Sets a custom destructor to be called when the variable goes out of scope.
 #define LOCAL_DESTRUCTOR(x) __attribute__((cleanup(x)))
 
@@ -48,6 +56,20 @@ typedef void (*destructor)(uintptr_t *pobj);
 // This is the standard error return value for open()
 static const int invalid_fileno = -1;
 
+// A memory mapping and its length.
+typedef struct MMAP_REGION_ {
+  uint8_t *data;
+  size_t size;
+} MMAP_REGION;
+
+// Access pattern hints for mmap_advise().
+typedef enum MMAP_ADVICE_ {
+  MMAP_NORMAL = MADV_NORMAL,
+  MMAP_SEQUENTIAL = MADV_SEQUENTIAL,  // Read ahead aggressively
+  MMAP_RANDOM = MADV_RANDOM,          // Don't read ahead at all
+  MMAP_WILLNEED = MADV_WILLNEED       // Start paging everything in now
+} MMAP_ADVICE;
+
 // Frees memory obtained with malloc. You need to pass the object pointer
 // by reference to allow the function to set it to NULL after freeing it.
 //
@@ -81,4 +103,47 @@ static inline void close_fd(int *pfileno) {
   }
 }
 
+// Unmap a region and set its data to NULL.
+static inline void unmap_region(MMAP_REGION *region) {
+  if (region->data) {
+    munmap(region->data, region->size);
+    region->data = NULL;
+    region->size = 0;
+  }
+}
+
+// Map a whole file into memory. Read only mappings are private, writable
+// ones write back to the file. Empty files give an empty region with NULL
+// data, as they can't be mapped.
+static inline ERROR mmap_file(MMAP_REGION *region, const char * const path,
+                              bool writable) {
+  LOCAL_FD int fd = open(path, writable ? O_RDWR : O_RDONLY);
+  struct stat st;
+  region->data = NULL;
+  region->size = 0;
+  if (fd == invalid_fileno || fstat(fd, &st) != 0) {
+    return FAILURE;
+  }
+  if (st.st_size == 0) {
+    return SUCCESS;
+  }
+  void *data = mmap(NULL, st.st_size,
+                    writable ? PROT_READ | PROT_WRITE : PROT_READ,
+                    writable ? MAP_SHARED : MAP_PRIVATE, fd, 0);
+  if (data == MAP_FAILED) {
+    return FAILURE;
+  }
+  region->data = data;
+  region->size = st.st_size;
+  return SUCCESS;
+}
+
+// Tell the kernel how the region will be accessed.
+static inline ERROR mmap_advise(MMAP_REGION *region, MMAP_ADVICE advice) {
+  if (region->data && madvise(region->data, region->size, advice) != 0) {
+    return FAILURE;
+  }
+  return SUCCESS;
+}
+
 #endif  // CUTIL_RAII_H
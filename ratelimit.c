@@ -0,0 +1,78 @@
+// Rate limiting and sampling for log messages.
+//
+// Author: Johannes Stüttgen (johannes.stuettgen@gmail.com)
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "ratelimit.h"
+
+#define RATELIMIT_TOKEN_BITS 24
+#define RATELIMIT_TOKEN_MASK ((1ULL << RATELIMIT_TOKEN_BITS) - 1)
+
+// Take a token from the bucket if there is one, refilling it first.
+// Returns false if the call should be dropped.
+//
+// Args:
+//  limit: the bucket, zero initialized on first use
+//  per_second: the number of calls allowed per second, which is also the
+//              number of calls allowed in a burst
+bool ratelimit_allow(RATELIMIT *limit, uint32_t per_second) {
+  if (per_second > RATELIMIT_MAX_RATE) {
+    per_second = RATELIMIT_MAX_RATE;
+  }
+  uint64_t now = ratelimit_now();
+  uint64_t state = __atomic_load_n(&limit->state, __ATOMIC_RELAXED);
+  while (true) {
+    uint64_t last = state >> RATELIMIT_TOKEN_BITS;
+    uint64_t tokens = state & RATELIMIT_TOKEN_MASK;
+    // Only move the time of the last refill forward by the time the added
+    // tokens stand for, so frequent calls don't lose the fractions.
+    uint64_t elapsed = now > last ? now - last : 0;
+    uint64_t added = elapsed >= 1000 ? per_second :
+                     elapsed * per_second / 1000;
+    if (tokens + added == 0) {
+      __atomic_add_fetch(&limit->rejected, 1, __ATOMIC_RELAXED);
+      return false;
+    }
+    if (tokens + added >= per_second) {
+      tokens = per_second;
+      last = now;
+    } else if (added) {
+      tokens += added;
+      last += added * 1000 / per_second;
+    }
+    uint64_t next = (last << RATELIMIT_TOKEN_BITS) | (tokens - 1);
+    if (__atomic_compare_exchange_n(&limit->state, &state, next, true,
+                                    __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+      return true;
+    }
+  }
+}
+
+// Returns the number of calls dropped since the last summary, if the last
+// summary is at least RATELIMIT_SUMMARY_MS ago, and 0 otherwise.
+uint64_t ratelimit_summary(RATELIMIT *limit) {
+  if (!__atomic_load_n(&limit->rejected, __ATOMIC_RELAXED)) {
+    return 0;
+  }
+  uint64_t now = ratelimit_now();
+  uint64_t last = __atomic_load_n(&limit->last_summary, __ATOMIC_RELAXED);
+  if (last && now - last < RATELIMIT_SUMMARY_MS) {
+    return 0;
+  }
+  if (!__atomic_compare_exchange_n(&limit->last_summary, &last, now, false,
+                                   __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+    return 0;
+  }
+  return __atomic_exchange_n(&limit->rejected, 0, __ATOMIC_RELAXED);
+}
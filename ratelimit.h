@@ -0,0 +1,80 @@
+// Rate limiting and sampling for messages logged from a single place, so a
+// loop which fails a million times doesn't turn into a million lines of
+// output. Used by LOG_RATELIMITED()/LOG_SAMPLED() in log.h and
+// ERROR_LOG_RATELIMITED()/ERROR_LOG_SAMPLED() in error_log.h, which keep a
+// static RATELIMIT per call site.
+//
+// ratelimit_allow() is a token bucket which refills per_second tokens per
+// second, up to per_second tokens. ratelimit_sample() lets every k-th call
+// through. Both count what they reject, and ratelimit_summary() returns that
+// count at most once every RATELIMIT_SUMMARY_MS, to log a summary line.
+//
+// The macros only ask for a summary after a message got through, which keeps
+// the rejected path cheap. A call site which goes quiet after a burst never
+// reports the messages it dropped at the end of that burst.
+//
+// A call rejected by ratelimit_allow() still costs a function call and a
+// read of CLOCK_MONOTONIC_COARSE, which the vDSO serves without a system
+// call, before a relaxed load of the bucket and a relaxed increment of the
+// counter. The bucket is only written when a call gets through. A call
+// rejected by the inline ratelimit_sample() costs two relaxed increments.
+//
+// Author: Johannes Stüttgen (johannes.stuettgen@gmail.com)
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef CUTIL_RATELIMIT_H
+#define CUTIL_RATELIMIT_H
+
+#include <time.h>
+
+#include "types.h"
+
+// Shortest time between two summaries of a call site.
+#define RATELIMIT_SUMMARY_MS 1000
+
+// Largest rate a bucket supports.
+#define RATELIMIT_MAX_RATE ((1 << 24) - 1)
+
+typedef struct RATELIMIT_ {
+  // Token bucket: time of the last refill in ms in the upper 40 bits,
+  // tokens in the lower 24 bits. Number of calls when sampling.
+  uint64_t state;
+  uint64_t rejected;
+  uint64_t last_summary;
+} RATELIMIT;
+
+bool ratelimit_allow(RATELIMIT *limit, uint32_t per_second);
+uint64_t ratelimit_summary(RATELIMIT *limit);
+
+// A cheap millisecond clock, it advances in steps of a few milliseconds.
+static inline uint64_t ratelimit_now(void) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC_COARSE, &now);
+  return now.tv_sec * 1000ULL + now.tv_nsec / 1000000;
+}
+
+// Returns true for every k-th call, starting with the first. A k of 0 or 1
+// lets every call through.
+static inline bool ratelimit_sample(RATELIMIT *limit, uint32_t k) {
+  if (k <= 1) {
+    return true;
+  }
+  if (__atomic_fetch_add(&limit->state, 1, __ATOMIC_RELAXED) % k == 0) {
+    return true;
+  }
+  __atomic_add_fetch(&limit->rejected, 1, __ATOMIC_RELAXED);
+  return false;
+}
+
+#endif  // CUTIL_RATELIMIT_H
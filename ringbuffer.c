@@ -0,0 +1,290 @@
+// Bounded FIFO queues for handing items from one thread to another.
+// Like VECTOR they copy items into their internal storage, which is a ring
+// of a fixed power of two number of slots.
+//
+// SPSC_RING is wait-free but only safe with a single producer and a single
+// consumer thread. The producer and consumer indices live on separate cache
+// lines, and each side keeps a cached copy of the other sides index, so
+// they only touch the shared cache line when the ring looks full or empty.
+//
+// MPMC_RING is lock-free and safe with any number of producers and
+// consumers. Every slot carries a sequence number which tells producers
+// and consumers whose turn it is, so threads only contend on the shared
+// indices and never wait for each other while copying items.
+//
+// The _n variants move a batch of items with a single update of the shared
+// index, which amortizes the cost of the atomic operations.
+//
+// Author: Johannes Stüttgen (johannes.stuettgen@gmail.com)
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "ringbuffer.h"
+
+// Round capacity up to the next power of two, returns 0 on overflow.
+static size_t ring_capacity(size_t capacity) {
+  size_t rounded = 1;
+  while (rounded < capacity) {
+    if (rounded > SIZE_MAX / 2) {
+      return 0;
+    }
+    rounded <<= 1;
+  }
+  return rounded;
+}
+
+// Create a new single producer single consumer ring.
+//
+// Args:
+//  ring: pointer to the ring to initialize
+//  item_size: size of an individual item in the ring
+//  capacity: number of items the ring can hold, rounded up to the next
+//            power of two
+ERROR spsc_ring_init(SPSC_RING *ring, size_t item_size, size_t capacity) {
+  capacity = ring_capacity(capacity);
+  ring->head = 0;
+  ring->tail = 0;
+  ring->cached_head = 0;
+  ring->cached_tail = 0;
+  ring->item_size = item_size;
+  ring->mask = capacity - 1;
+  ring->data = capacity ? calloc(capacity, item_size) : NULL;
+  if (ring->data) {
+    return SUCCESS;
+  }
+  return FAILURE;
+}
+
+// release the memory of the ring, all items in it are lost.
+void spsc_ring_destroy(SPSC_RING *ring) {
+  free(ring->data);
+  ring->data = NULL;
+}
+
+// Copy count items starting at ring position pos from or to a flat array,
+// taking care of the wrap around at the end of the ring.
+static void ring_copy_in(uint8_t *data, size_t mask, size_t item_size,
+                         size_t pos, const uint8_t *values, size_t count) {
+  size_t first = pos & mask;
+  size_t until_end = mask + 1 - first;
+  size_t head_count = count < until_end ? count : until_end;
+  memcpy(data + first * item_size, values, head_count * item_size);
+  memcpy(data, values + head_count * item_size,
+         (count - head_count) * item_size);
+}
+
+static void ring_copy_out(const uint8_t *data, size_t mask, size_t item_size,
+                          size_t pos, uint8_t *values, size_t count) {
+  size_t first = pos & mask;
+  size_t until_end = mask + 1 - first;
+  size_t head_count = count < until_end ? count : until_end;
+  memcpy(values, data + first * item_size, head_count * item_size);
+  memcpy(values + head_count * item_size, data,
+         (count - head_count) * item_size);
+}
+
+// Add up to count items from a contiguous array to the ring and return how
+// many fit. Only call this from the producer thread.
+size_t spsc_ring_push_n(SPSC_RING *ring, const void * const values,
+                        size_t count, size_t size) {
+  if (size != ring->item_size) {
+    return 0;
+  }
+  size_t tail = ring->tail;
+  size_t capacity = ring->mask + 1;
+  size_t free_slots = capacity - (tail - ring->cached_head);
+  if (free_slots < count) {
+    ring->cached_head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+    free_slots = capacity - (tail - ring->cached_head);
+  }
+  if (count > free_slots) {
+    count = free_slots;
+  }
+  ring_copy_in(ring->data, ring->mask, ring->item_size, tail, values, count);
+  __atomic_store_n(&ring->tail, tail + count, __ATOMIC_RELEASE);
+  return count;
+}
+
+// Remove up to count items from the ring into a contiguous array and return
+// how many there were. Only call this from the consumer thread.
+size_t spsc_ring_pop_n(SPSC_RING *ring, void *values, size_t count) {
+  size_t head = ring->head;
+  size_t available = ring->cached_tail - head;
+  if (available < count) {
+    ring->cached_tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+    available = ring->cached_tail - head;
+  }
+  if (count > available) {
+    count = available;
+  }
+  ring_copy_out(ring->data, ring->mask, ring->item_size, head, values, count);
+  __atomic_store_n(&ring->head, head + count, __ATOMIC_RELEASE);
+  return count;
+}
+
+// Add an item to the ring, fails if the ring is full.
+// The supplied size must equal the rings item_size, see vector_push().
+ERROR spsc_ring_push(SPSC_RING *ring, const void * const value, size_t size) {
+  if (spsc_ring_push_n(ring, value, 1, size) == 1) {
+    return SUCCESS;
+  }
+  return FAILURE;
+}
+
+// Remove the oldest item from the ring and copy it to value,
+// fails if the ring is empty.
+ERROR spsc_ring_pop(SPSC_RING *ring, void *value) {
+  if (spsc_ring_pop_n(ring, value, 1) == 1) {
+    return SUCCESS;
+  }
+  return FAILURE;
+}
+
+// Number of items in the ring. This is only a snapshot if the other side
+// is working on the ring concurrently.
+size_t spsc_ring_size(SPSC_RING *ring) {
+  size_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+  return __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) - head;
+}
+
+// Each MPMC slot starts with its sequence number, followed by the item.
+static inline size_t *mpmc_slot(MPMC_RING *ring, size_t pos) {
+  return (size_t *)(ring->slots + (pos & ring->mask) * ring->slot_size);
+}
+
+// Create a new multi producer multi consumer ring.
+//
+// Args:
+//  ring: pointer to the ring to initialize
+//  item_size: size of an individual item in the ring
+//  capacity: number of items the ring can hold, rounded up to the next
+//            power of two
+ERROR mpmc_ring_init(MPMC_RING *ring, size_t item_size, size_t capacity) {
+  capacity = ring_capacity(capacity);
+  ring->head = 0;
+  ring->tail = 0;
+  ring->item_size = item_size;
+  ring->mask = capacity - 1;
+  // Keep the sequence numbers aligned.
+  ring->slot_size = (sizeof(size_t) + item_size + sizeof(size_t) - 1) &
+                    ~(sizeof(size_t) - 1);
+  ring->slots = capacity ? calloc(capacity, ring->slot_size) : NULL;
+  if (!ring->slots) {
+    return FAILURE;
+  }
+  // Slot i is free for the producer that claims position i.
+  for (size_t i = 0; i < capacity; ++i) {
+    *mpmc_slot(ring, i) = i;
+  }
+  return SUCCESS;
+}
+
+// release the memory of the ring, all items in it are lost.
+void mpmc_ring_destroy(MPMC_RING *ring) {
+  free(ring->slots);
+  ring->slots = NULL;
+}
+
+// Claim up to count consecutive slots starting at the shared index, whose
+// sequence numbers must equal their position plus ready_offset. Producers
+// claim free slots at the tail, consumers claim full slots at the head.
+// Returns the number of claimed slots and stores the first position in
+// *start, it returns 0 if the ring is full (or empty for consumers).
+static size_t mpmc_claim(MPMC_RING *ring, size_t *index, size_t count,
+                         size_t ready_offset, size_t *start) {
+  size_t pos = __atomic_load_n(index, __ATOMIC_RELAXED);
+  for (;;) {
+    size_t claimed = 0;
+    intptr_t diff = 0;
+    while (claimed < count) {
+      size_t seq = __atomic_load_n(mpmc_slot(ring, pos + claimed),
+                                   __ATOMIC_ACQUIRE);
+      diff = (intptr_t)(seq - (pos + claimed + ready_offset));
+      if (diff != 0) {
+        break;
+      }
+      claimed++;
+    }
+    if (claimed > 0) {
+      // On failure this reloads pos, so we simply try again.
+      if (__atomic_compare_exchange_n(index, &pos, pos + claimed, true,
+                                      __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+        *start = pos;
+        return claimed;
+      }
+    } else if (diff < 0) {
+      // The slot hasn't been released from the last lap around the ring.
+      return 0;
+    } else {
+      // Another thread claimed the slot, catch up with the index.
+      pos = __atomic_load_n(index, __ATOMIC_RELAXED);
+    }
+  }
+}
+
+// Add up to count items from a contiguous array to the ring and return how
+// many fit. Safe to call from any number of threads.
+size_t mpmc_ring_push_n(MPMC_RING *ring, const void * const values,
+                        size_t count, size_t size) {
+  const uint8_t *value = values;
+  size_t start;
+  if (size != ring->item_size || count == 0) {
+    return 0;
+  }
+  count = mpmc_claim(ring, &ring->tail, count, 0, &start);
+  for (size_t i = 0; i < count; ++i) {
+    size_t *slot = mpmc_slot(ring, start + i);
+    memcpy(slot + 1, value + i * ring->item_size, ring->item_size);
+    __atomic_store_n(slot, start + i + 1, __ATOMIC_RELEASE);
+  }
+  return count;
+}
+
+// Remove up to count items from the ring into a contiguous array and return
+// how many there were. Safe to call from any number of threads.
+size_t mpmc_ring_pop_n(MPMC_RING *ring, void *values, size_t count) {
+  uint8_t *value = values;
+  size_t start;
+  if (count == 0) {
+    return 0;
+  }
+  count = mpmc_claim(ring, &ring->head, count, 1, &start);
+  for (size_t i = 0; i < count; ++i) {
+    size_t *slot = mpmc_slot(ring, start + i);
+    memcpy(value + i * ring->item_size, slot + 1, ring->item_size);
+    // Free the slot for the producer one lap ahead.
+    __atomic_store_n(slot, start + i + ring->mask + 1, __ATOMIC_RELEASE);
+  }
+  return count;
+}
+
+// Add an item to the ring, fails if the ring is full.
+// The supplied size must equal the rings item_size, see vector_push().
+ERROR mpmc_ring_push(MPMC_RING *ring, const void * const value, size_t size) {
+  if (mpmc_ring_push_n(ring, value, 1, size) == 1) {
+    return SUCCESS;
+  }
+  return FAILURE;
+}
+
+// Remove the oldest item from the ring and copy it to value,
+// fails if the ring is empty.
+ERROR mpmc_ring_pop(MPMC_RING *ring, void *value) {
+  if (mpmc_ring_pop_n(ring, value, 1) == 1) {
+    return SUCCESS;
+  }
+  return FAILURE;
+}
@@ -0,0 +1,79 @@
+// Bounded FIFO queues for handing items from one thread to another.
+// Like VECTOR they copy items into their internal storage, which is a ring
+// of a fixed power of two number of slots.
+//
+// SPSC_RING is wait-free but only safe with a single producer and a single
+// consumer thread. The producer and consumer indices live on separate cache
+// lines, and each side keeps a cached copy of the other sides index, so
+// they only touch the shared cache line when the ring looks full or empty.
+//
+// MPMC_RING is lock-free and safe with any number of producers and
+// consumers. Every slot carries a sequence number which tells producers
+// and consumers whose turn it is, so threads only contend on the shared
+// indices and never wait for each other while copying items.
+//
+// The _n variants move a batch of items with a single update of the shared
+// index, which amortizes the cost of the atomic operations.
+//
+// Author: Johannes Stüttgen (johannes.stuettgen@gmail.com)
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef CUTIL_RINGBUFFER_H
+#define CUTIL_RINGBUFFER_H
+
+#include "types.h"
+
+#define CUTIL_CACHE_LINE 64
+
+typedef struct SPSC_RING_ {
+  // Only written by the producer.
+  size_t tail __attribute__((aligned(CUTIL_CACHE_LINE)));
+  size_t cached_head;
+  // Only written by the consumer.
+  size_t head __attribute__((aligned(CUTIL_CACHE_LINE)));
+  size_t cached_tail;
+  // Constant after initialization.
+  uint8_t *data __attribute__((aligned(CUTIL_CACHE_LINE)));
+  size_t item_size;
+  size_t mask;
+} SPSC_RING;
+
+typedef struct MPMC_RING_ {
+  size_t tail __attribute__((aligned(CUTIL_CACHE_LINE)));
+  size_t head __attribute__((aligned(CUTIL_CACHE_LINE)));
+  // Constant after initialization.
+  uint8_t *slots __attribute__((aligned(CUTIL_CACHE_LINE)));
+  size_t slot_size;
+  size_t item_size;
+  size_t mask;
+} MPMC_RING;
+
+ERROR spsc_ring_init(SPSC_RING *ring, size_t item_size, size_t capacity);
+void spsc_ring_destroy(SPSC_RING *ring);
+ERROR spsc_ring_push(SPSC_RING *ring, const void * const value, size_t size);
+ERROR spsc_ring_pop(SPSC_RING *ring, void *value);
+size_t spsc_ring_push_n(SPSC_RING *ring, const void * const values,
+                        size_t count, size_t size);
+size_t spsc_ring_pop_n(SPSC_RING *ring, void *values, size_t count);
+size_t spsc_ring_size(SPSC_RING *ring);
+
+ERROR mpmc_ring_init(MPMC_RING *ring, size_t item_size, size_t capacity);
+void mpmc_ring_destroy(MPMC_RING *ring);
+ERROR mpmc_ring_push(MPMC_RING *ring, const void * const value, size_t size);
+ERROR mpmc_ring_pop(MPMC_RING *ring, void *value);
+size_t mpmc_ring_push_n(MPMC_RING *ring, const void * const values,
+                        size_t count, size_t size);
+size_t mpmc_ring_pop_n(MPMC_RING *ring, void *values, size_t count);
+
+#endif  // CUTIL_RINGBUFFER_H
@@ -0,0 +1,123 @@
+// A growable array that never moves its elements. Instead of reallocating
+// one contiguous block it allocates fixed size chunks and keeps a small
+// directory of chunk pointers, so growing never copies elements and
+// pointers to elements stay valid until the element is popped.
+// Indexing stays O(1), as the number of items per chunk is a power of two
+// and the chunk and offset are found with a shift and a mask.
+//
+// It offers the same push/get/pop functions as VECTOR, and also copies data
+// into its internal storage.
+//
+// Author: Johannes Stüttgen (johannes.stuettgen@gmail.com)
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <string.h>
+
+#include "segvector.h"
+
+extern inline void *segvector_ptr(SEGVECTOR *vec, size_t index);
+extern inline void *segvector_get(SEGVECTOR *vec, size_t index);
+
+// Create a new segmented vector. No chunk is allocated until the first push.
+//
+// Args:
+//  vec: pointer to the vector to initialize
+//  item_size: size of an individual item in the vector
+//  chunk_shift: each chunk holds (1 << chunk_shift) items,
+//               use SEGVECTOR_DEFAULT_CHUNK_SHIFT if unsure.
+ERROR segvector_init(SEGVECTOR *vec, size_t item_size, uint8_t chunk_shift) {
+  if (chunk_shift >= sizeof(size_t) * 8) {
+    return FAILURE;
+  }
+  vec->item_size = item_size;
+  vec->size = 0;
+  vec->chunk_shift = chunk_shift;
+  vec->chunk_mask = ((size_t)1 << chunk_shift) - 1;
+  return vector_init(&vec->chunks, sizeof(uint8_t *), VECTOR_DEFAULT_SIZE);
+}
+
+// release all chunks and the directory.
+void segvector_destroy(SEGVECTOR *vec) {
+  uint8_t **chunks = (uint8_t **)vec->chunks.data;
+  size_t num_chunks = vec->chunks.used_bytes / sizeof(uint8_t *);
+
+  for (size_t i = 0; i < num_chunks; ++i) {
+    free(chunks[i]);
+  }
+  vector_destroy(&vec->chunks);
+}
+
+// Add a new element to the vector by copying it into the next free slot.
+// The supplied size must equal the vectors item_size, see vector_push().
+void *segvector_push(SEGVECTOR *vec, const void * const value, size_t size) {
+  void *element = segvector_push_new(vec, size);
+  if (!element) {
+    return NULL;
+  }
+  memcpy(element, value, vec->item_size);
+  return element;
+}
+
+// Allocate a new element in the vector and return a pointer to it.
+// If the last chunk is full this allocates a new one, but it never moves
+// any existing element.
+void *segvector_push_new(SEGVECTOR *vec, size_t size) {
+  if (size != vec->item_size) {
+    return NULL;
+  }
+  size_t num_chunks = vec->chunks.used_bytes / sizeof(uint8_t *);
+  if ((vec->size >> vec->chunk_shift) >= num_chunks) {
+    uint8_t *chunk = malloc((vec->chunk_mask + 1) * vec->item_size);
+    if (!chunk) {
+      return NULL;
+    }
+    if (!vector_push(&vec->chunks, &chunk, sizeof(chunk))) {
+      free(chunk);
+      return NULL;
+    }
+  }
+  return segvector_ptr(vec, vec->size++);
+}
+
+// Delete the last element. A chunk is only released once the chunk before it
+// is empty as well, so pushing and popping right at a chunk boundary doesn't
+// call malloc and free every time.
+ERROR segvector_pop(SEGVECTOR *vec) {
+  if (vec->size == 0) {
+    return FAILURE;
+  }
+  vec->size--;
+  size_t num_chunks = vec->chunks.used_bytes / sizeof(uint8_t *);
+  size_t used_chunks = (vec->size + vec->chunk_mask) >> vec->chunk_shift;
+  if (num_chunks > used_chunks + 1) {
+    free(((uint8_t **)vec->chunks.data)[num_chunks - 1]);
+    vector_pop(&vec->chunks);
+  }
+  return SUCCESS;
+}
+
+// Delete the last element and return a copy.
+void *segvector_pop_copy(SEGVECTOR *vec) {
+  void *element = segvector_get(vec, vec->size - 1);
+  if (!element) {
+    return NULL;
+  }
+  void *copy = malloc(vec->item_size);
+  if (!copy) {
+    return NULL;
+  }
+  memcpy(copy, element, vec->item_size);
+  segvector_pop(vec);
+  return copy;
+}
@@ -0,0 +1,64 @@
+// A growable array that never moves its elements. Instead of reallocating
+// one contiguous block it allocates fixed size chunks and keeps a small
+// directory of chunk pointers, so growing never copies elements and
+// pointers to elements stay valid until the element is popped.
+// Indexing stays O(1), as the number of items per chunk is a power of two
+// and the chunk and offset are found with a shift and a mask.
+//
+// It offers the same push/get/pop functions as VECTOR, and also copies data
+// into its internal storage.
+//
+// Author: Johannes Stüttgen (johannes.stuettgen@gmail.com)
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef CUTIL_SEGVECTOR_H
+#define CUTIL_SEGVECTOR_H
+
+#include "types.h"
+#include "vector.h"
+
+typedef struct SEGVECTOR_ {
+  VECTOR chunks;  // Directory of chunk pointers
+  size_t item_size;
+  size_t size;  // Number of items stored
+  uint8_t chunk_shift;  // log2 of the number of items per chunk
+  size_t chunk_mask;
+} SEGVECTOR;
+
+// 1024 items per chunk.
+static const uint8_t SEGVECTOR_DEFAULT_CHUNK_SHIFT = 10;
+
+ERROR segvector_init(SEGVECTOR *vec, size_t item_size, uint8_t chunk_shift);
+void segvector_destroy(SEGVECTOR *vec);
+void *segvector_push(SEGVECTOR *vec, const void * const value, size_t size);
+void *segvector_push_new(SEGVECTOR *vec, size_t size);
+ERROR segvector_pop(SEGVECTOR *vec);
+void *segvector_pop_copy(SEGVECTOR *vec);
+
+// Calculates a pointer to the desired element without any bounds checking.
+inline void *segvector_ptr(SEGVECTOR *vec, size_t index) {
+  uint8_t *chunk = ((uint8_t **)vec->chunks.data)[index >> vec->chunk_shift];
+  return chunk + (index & vec->chunk_mask) * vec->item_size;
+}
+
+// Get a pointer to an element in the vector. Implements bounds checking,
+// so the pointer is guaranteed to be valid or NULL in case of an invalid index.
+inline void *segvector_get(SEGVECTOR *vec, size_t index) {
+  if (index >= vec->size) {
+    return NULL;
+  }
+  return segvector_ptr(vec, index);
+}
+
+#endif  // CUTIL_SEGVECTOR_H
@@ -1,5 +1,6 @@
-// Simple unit test framework that has no external dependencies except
-// for the standard library and focuses on minimal complexity.
+// Simple unit test framework that focuses on minimal complexity. Besides
+// the standard library it only needs buffer.h for tests_run_parallel() and
+// alloc_track.h for counting allocations.
 //
 // USAGE: You can write your own test functions that use any of the ASSERT_X
 // macros to check for problems. Add test functions to the queue with
@@ -12,6 +13,22 @@
 // of your ressources in a seperate init() and cleanup() function outside of
 // your test function.
 //
+// tests_run_parallel() avoids this by running every test in a forked process
+// instead, a number of them at the same time. A test which crashes or hangs
+// only takes its own process down, and is reported with the signal that
+// killed it or as timed out. The output of every test is collected and
+// printed in the order the tests were added, just like tests_run() does.
+// Tests must not depend on state left behind by earlier tests in this mode.
+//
+// Programs which use ALLOC_TRACK_INTERPOSE() from alloc_track.h get the heap
+// allocations of every test counted and printed. Tests which end with more
+// heap memory in use than they started with, or exceed the budget set with
+// test_alloc_budget(), fail. A test which frees memory allocated before it
+// started can hide a leak of up to that many bytes. The runner sets up the
+// time zone and the stdout buffer before the tests, other caches the C
+// library fills on first use and keeps forever count as a leak of the first
+// test using them.
+//
 // Author: Johannes Stüttgen (johannes.stuettgen@gmail.com)
 //
 // Licensed under the Apache License, Version 2.0 (the "License");
@@ -26,6 +43,15 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#include <errno.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "buffer.h"
 #include "test.h"
 
 typedef struct TESTS_ {
@@ -35,10 +61,35 @@ typedef struct TESTS_ {
   size_t max_size;
 } TESTS;
 
+// A test running in a forked process in tests_run_parallel().
+typedef struct TEST_WORKER_ {
+  pid_t pid;
+  int fd;             // Reads the stdout and stderr of the test
+  size_t test;
+  uint64_t deadline;  // In ms of the monotonic clock
+} TEST_WORKER;
+
+// What a test in tests_run_parallel() printed and how its process ended.
+typedef struct TEST_RESULT_ {
+  BUFFER output;
+  int status;
+  bool done;
+  bool timed_out;
+} TEST_RESULT;
+
+// Allocations a test may make, see test_alloc_budget().
+typedef struct TEST_BUDGET_ {
+  uint64_t allocations;
+  int64_t peak_bytes;
+} TEST_BUDGET;
+
 static const int TEST_FAILED = 1;
 static unsigned int current_test = 0;
 static unsigned int passed_tests = 0;
 static jmp_buf test_exception;
+static TEST_BUDGET test_budget;
+// Allocations of the last test, the peak relative to the start of the test.
+static ALLOC_STATS test_allocations;
 static TESTS tests = {
   .functions = {0},
   .names = {0},
@@ -52,6 +103,57 @@ static void test_abort(int signum __attribute__((unused))) {
   longjmp(test_exception, TEST_FAILED);
 }
 
+// Fail the running test if it allocates more than max_allocations blocks or
+// has more than max_peak_bytes allocated at once.
+void test_alloc_budget(uint64_t max_allocations, int64_t max_peak_bytes) {
+  test_budget.allocations = max_allocations;
+  test_budget.peak_bytes = max_peak_bytes;
+}
+
+// Calls a test function with its allocations counted, and fails the test if
+// it leaked or went over its budget.
+static void test_call(TEST test_function) {
+  ALLOC_STATS before;
+  test_alloc_budget(UINT64_MAX, INT64_MAX);
+  alloc_track_reset_peak();
+  alloc_track_stats(&before);
+  alloc_track_start();
+  test_function();
+  alloc_track_stop();
+  alloc_track_stats(&test_allocations);
+  test_allocations.allocations -= before.allocations;
+  test_allocations.frees -= before.frees;
+  test_allocations.bytes -= before.bytes;
+  test_allocations.live_bytes -= before.live_bytes;
+  test_allocations.peak_bytes -= before.live_bytes;
+  if (test_allocations.live_bytes > 0) {
+    printf("[--]\n\t leaked %" PRId64 " bytes\n",
+           test_allocations.live_bytes);
+    longjmp(test_exception, TEST_FAILED);
+  }
+  if (test_allocations.allocations > test_budget.allocations ||
+      test_allocations.peak_bytes > test_budget.peak_bytes) {
+    printf("[--]\n\t %" PRIu64 " allocations with a peak of %" PRId64
+           " bytes exceed the budget of %" PRIu64 " allocations and %" PRId64
+           " bytes\n",
+           test_allocations.allocations, test_allocations.peak_bytes,
+           test_budget.allocations, test_budget.peak_bytes);
+    longjmp(test_exception, TEST_FAILED);
+  }
+}
+
+// Prints the result of a passed test, with its allocations if they were
+// counted.
+static void test_passed(void) {
+  printf("[%s]", "OK");
+  if (alloc_track_installed()) {
+    printf(" %" PRIu64 " allocations, %" PRIu64 " bytes, peak %" PRId64
+           " bytes", test_allocations.allocations, test_allocations.bytes,
+           test_allocations.peak_bytes);
+  }
+  printf("\n");
+}
+
 // This function runs unit test functions and recovers from errors.
 // It will always return after printing information on test failure,
 // so your tests can continue.
@@ -61,9 +163,11 @@ static void test_run(TEST test_function, const char * const test_name,
   signal(SIGABRT, test_abort);
   current_test++;
   if (setjmp(test_exception) != TEST_FAILED) {
-    test_function();
-    printf("[%s]\n", "OK");
+    test_call(test_function);
+    test_passed();
     passed_tests++;
+  } else {
+    alloc_track_stop();
   }
 }
 
@@ -78,11 +182,8 @@ ERROR test_add(TEST test_function, const char * const test_name) {
   return FAILURE;
 }
 
-// Runs any queued tests and prints some statistics.
-ERROR tests_run(void) {
-  for (size_t i = 0; i < tests.size; ++i) {
-    test_run(tests.functions[i], tests.names[i], i);
-  }
+// Prints how many tests failed, if any.
+static ERROR tests_summary(void) {
   if (current_test == passed_tests) {
     puts("ALL TESTS PASSED");
     return SUCCESS;
@@ -90,3 +191,220 @@ ERROR tests_run(void) {
   printf("%d TESTS FAILED\n", current_test - passed_tests);
   return FAILURE;
 }
+
+// Forgets the queued tests and their results, so a test can run tests of its
+// own in a forked process.
+void tests_reset(void) {
+  tests.size = 0;
+  current_test = 0;
+  passed_tests = 0;
+}
+
+// The C library sets up some caches on first use and keeps them until the
+// program exits. Set them up before the first test, so they don't count as
+// leaked by whichever test happens to use them first.
+static void test_warm_caches(void) {
+  // localtime() and friends load the time zone once.
+  tzset();
+}
+
+// Runs any queued tests and prints some statistics.
+ERROR tests_run(void) {
+  test_warm_caches();
+  for (size_t i = 0; i < tests.size; ++i) {
+    test_run(tests.functions[i], tests.names[i], i);
+  }
+  return tests_summary();
+}
+
+static uint64_t test_now_ms(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000ULL + ts.tv_nsec / 1000000;
+}
+
+// Runs a test in a forked process, with stdout and stderr going to fd.
+// Failed assertions exit with TEST_FAILED, crashes kill the process.
+static void test_child(TEST test_function, int fd) {
+  // stdout allocates its buffer on the first write, which would happen in
+  // the test and count as a leak if nothing was printed before the fork.
+  static char output_buffer[BUFSIZ];
+  int status = 0;
+  dup2(fd, STDOUT_FILENO);
+  dup2(fd, STDERR_FILENO);
+  close(fd);
+  setvbuf(stdout, output_buffer, _IOFBF, sizeof(output_buffer));
+  signal(SIGABRT, test_abort);
+  if (setjmp(test_exception) != TEST_FAILED) {
+    test_call(test_function);
+    test_passed();
+  } else {
+    status = TEST_FAILED;
+  }
+  fflush(stdout);
+  fflush(stderr);
+  _exit(status);
+}
+
+// Forks a process for a test.
+static ERROR test_start(TEST_WORKER *worker, size_t test_index,
+                        unsigned int timeout) {
+  int fds[2];
+  if (pipe(fds) != 0) {
+    return FAILURE;
+  }
+  pid_t pid = fork();
+  if (pid < 0) {
+    close(fds[0]);
+    close(fds[1]);
+    return FAILURE;
+  }
+  if (pid == 0) {
+    close(fds[0]);
+    test_child(tests.functions[test_index], fds[1]);
+  }
+  close(fds[1]);
+  worker->pid = pid;
+  worker->fd = fds[0];
+  worker->test = test_index;
+  worker->deadline = test_now_ms() + timeout * 1000ULL;
+  return SUCCESS;
+}
+
+// Reads what the test printed. Returns false once the test is done and its
+// process has been reaped.
+static bool test_collect(TEST_WORKER *worker, TEST_RESULT *result) {
+  uint8_t *room = buf_reserve(&result->output, 4096);
+  ssize_t size = room ? read(worker->fd, room, 4096) : 0;
+  if (size < 0 && errno == EINTR) {
+    return true;
+  }
+  if (size > 0) {
+    buf_commit(&result->output, size);
+    return true;
+  }
+  close(worker->fd);
+  while (waitpid(worker->pid, &result->status, 0) < 0 && errno == EINTR) {}
+  result->done = true;
+  return false;
+}
+
+// Kills a test which ran out of time.
+static void test_kill(TEST_WORKER *worker, TEST_RESULT *result) {
+  kill(worker->pid, SIGKILL);
+  close(worker->fd);
+  while (waitpid(worker->pid, &result->status, 0) < 0 && errno == EINTR) {}
+  result->timed_out = true;
+  result->done = true;
+}
+
+// Prints the result of a test from tests_run_parallel() the same way
+// test_run() would have.
+static void test_report(TEST_RESULT *result, size_t test_index,
+                        unsigned int timeout) {
+  printf("[TEST %zu] %-50s ", test_index, tests.names[test_index]);
+  fwrite(buf_data(&result->output), 1, buf_size(&result->output), stdout);
+  current_test++;
+  if (result->timed_out) {
+    printf("[--]\n\t timed out after %u seconds\n", timeout);
+  } else if (WIFSIGNALED(result->status)) {
+    printf("[--]\n\t killed by signal %d (%s)\n", WTERMSIG(result->status),
+           strsignal(WTERMSIG(result->status)));
+  } else if (WEXITSTATUS(result->status) == 0) {
+    // The test printed its result itself.
+    passed_tests++;
+  } else if (WEXITSTATUS(result->status) != TEST_FAILED) {
+    printf("[--]\n\t exited with status %d\n", WEXITSTATUS(result->status));
+  }
+  fflush(stdout);
+}
+
+// Runs the queued tests in forked processes, up to workers at a time, and
+// prints the results in the order the tests were added.
+//
+// Args:
+//  workers: how many tests run at the same time, 0 for one per CPU
+//  timeout: seconds after which a test is killed, 0 for TEST_DEFAULT_TIMEOUT
+ERROR tests_run_parallel(size_t workers, unsigned int timeout) {
+  if (workers == 0) {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    workers = cpus > 0 ? cpus : 1;
+  }
+  if (timeout == 0) {
+    timeout = TEST_DEFAULT_TIMEOUT;
+  }
+  TEST_RESULT *results = calloc(tests.size, sizeof(TEST_RESULT));
+  TEST_WORKER *running = calloc(workers, sizeof(TEST_WORKER));
+  struct pollfd *fds = calloc(workers, sizeof(struct pollfd));
+  if (!results || !running || !fds) {
+    free(results);
+    free(running);
+    free(fds);
+    return FAILURE;
+  }
+  size_t active = 0;
+  size_t next_test = 0;
+  size_t next_report = 0;
+  test_warm_caches();
+  // Don't let the children inherit buffered output.
+  fflush(stdout);
+  fflush(stderr);
+  while (next_report < tests.size) {
+    while (active < workers && next_test < tests.size) {
+      TEST_RESULT *result = &results[next_test];
+      buf_init(&result->output, 0);
+      if (test_start(&running[active], next_test, timeout) == SUCCESS) {
+        ++active;
+      } else {
+        buf_append_str(&result->output, "[--]\n\t can't fork a worker\n");
+        result->status = W_EXITCODE(TEST_FAILED, 0);
+        result->done = true;
+      }
+      ++next_test;
+    }
+    uint64_t now = test_now_ms();
+    int wait_ms = -1;
+    for (size_t i = 0; i < active; ++i) {
+      fds[i].fd = running[i].fd;
+      fds[i].events = POLLIN;
+      fds[i].revents = 0;
+      uint64_t left = running[i].deadline > now ?
+                      running[i].deadline - now : 0;
+      if (wait_ms < 0 || left < (uint64_t)wait_ms) {
+        wait_ms = left;
+      }
+    }
+    if (active && poll(fds, active, wait_ms) < 0 && errno != EINTR) {
+      break;
+    }
+    now = test_now_ms();
+    // Go backwards, so finished workers can be replaced by the last one.
+    for (size_t i = active; i-- > 0;) {
+      TEST_RESULT *result = &results[running[i].test];
+      if (now >= running[i].deadline) {
+        test_kill(&running[i], result);
+      } else if (!fds[i].revents || test_collect(&running[i], result)) {
+        continue;
+      }
+      running[i] = running[--active];
+      fds[i] = fds[active];
+    }
+    while (next_report < tests.size && results[next_report].done) {
+      test_report(&results[next_report], next_report, timeout);
+      buf_destroy(&results[next_report].output);
+      ++next_report;
+    }
+  }
+  // Only left early if poll() failed.
+  for (size_t i = 0; i < active; ++i) {
+    test_kill(&running[i], &results[running[i].test]);
+  }
+  for (size_t i = next_report; i < tests.size; ++i) {
+    buf_destroy(&results[i].output);
+  }
+  ERROR status = next_report == tests.size ? tests_summary() : FAILURE;
+  free(results);
+  free(running);
+  free(fds);
+  return status;
+}
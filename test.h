@@ -1,5 +1,6 @@
-// Simple unit test framework that has no external dependencies except
-// for the standard library and focuses on minimal complexity.
+// Simple unit test framework that focuses on minimal complexity. Besides
+// the standard library it only needs buffer.h for tests_run_parallel() and
+// alloc_track.h for counting allocations.
 //
 // USAGE: You can write your own test functions that use any of the ASSERT_X
 // macros to check for problems. Add test functions to the queue with
@@ -12,6 +13,22 @@
 // of your ressources in a seperate init() and cleanup() function outside of
 // your test function.
 //
+// tests_run_parallel() avoids this by running every test in a forked process
+// instead, a number of them at the same time. A test which crashes or hangs
+// only takes its own process down, and is reported with the signal that
+// killed it or as timed out. The output of every test is collected and
+// printed in the order the tests were added, just like tests_run() does.
+// Tests must not depend on state left behind by earlier tests in this mode.
+//
+// Programs which use ALLOC_TRACK_INTERPOSE() from alloc_track.h get the heap
+// allocations of every test counted and printed. Tests which end with more
+// heap memory in use than they started with, or exceed the budget set with
+// test_alloc_budget(), fail. A test which frees memory allocated before it
+// started can hide a leak of up to that many bytes. The runner sets up the
+// time zone and the stdout buffer before the tests, other caches the C
+// library fills on first use and keeps forever count as a leak of the first
+// test using them.
+//
 // Author: Johannes Stüttgen (johannes.stuettgen@gmail.com)
 //
 // Licensed under the Apache License, Version 2.0 (the "License");
@@ -29,10 +46,12 @@
 #ifndef CUTIL_TEST_H
 #define CUTIL_TEST_H
 
+#include <inttypes.h>
 #include <setjmp.h>
 #include <signal.h>
 #include <stdio.h>
 
+#include "alloc_track.h"
 #include "types.h"
 
 // To keep things simple there is a hardcoded limit to the number of
@@ -49,6 +68,23 @@ ERROR test_add(TEST test_function, const char * const test_name);
 // Runs any queued tests and prints some statistics.
 ERROR tests_run(void);
 
+// Forgets the queued tests and their results.
+void tests_reset(void);
+
+// Fail the running test if it allocates more than max_allocations blocks or
+// has more than max_peak_bytes allocated at once, checked when it returns.
+// Tests without a budget only fail if they leak. Allocations are only
+// counted in programs which use ALLOC_TRACK_INTERPOSE().
+void test_alloc_budget(uint64_t max_allocations, int64_t max_peak_bytes);
+
+// Tests running longer than this in tests_run_parallel() are killed.
+#define TEST_DEFAULT_TIMEOUT 600
+
+// Same as tests_run(), with every test in its own process and up to workers
+// tests at a time, 0 for one per CPU. Tests running longer than timeout
+// seconds fail, 0 for TEST_DEFAULT_TIMEOUT.
+ERROR tests_run_parallel(size_t workers, unsigned int timeout);
+
 // Print a formatted error message and the exact location of the test failure.
 #define TEST_FAILED(fmt, ...) do { \
   printf("[--]\n\t " fmt " in %s:%d %s()\n", \
@@ -63,6 +99,18 @@ ERROR tests_run(void);
     TEST_FAILED("%s not true", __STRING(expression)); \
 } while (0)
 
+// Fails if the statement allocates memory, e.g. to check that a hot path
+// never calls malloc().
+#define ASSERT_NO_ALLOCATIONS(statement) do { \
+  ALLOC_STATS before_, after_; \
+  alloc_track_stats(&before_); \
+  statement; \
+  alloc_track_stats(&after_); \
+  if (after_.allocations != before_.allocations) \
+    TEST_FAILED("%s allocated %" PRIu64 " times", __STRING(statement), \
+                after_.allocations - before_.allocations); \
+} while (0)
+
 #define ASSERT_SUCCESS(expression) do { \
   if ((expression) != SUCCESS) \
     TEST_FAILED("%s not successful", __STRING(expression)); \
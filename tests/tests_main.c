@@ -15,23 +15,44 @@
 // limitations under the License.
 
 #include <fcntl.h>
+#include <limits.h>
 #include <math.h>
-#include <mcheck.h>
+#include <pthread.h>
+#include <sched.h>
 #include <string.h>
+#include <sys/wait.h>
 
+// Compile out debug messages, log_test_levels() checks they are gone.
+#define CUTIL_LOG_MIN_LEVEL LL_VER
+
+#include "alloc_track.h"
+#include "arena.h"
+#include "bench.h"
+#include "binlog.h"
+#include "bitset.h"
+#include "buffer.h"
+#include "cvector.h"
+#include "hashmap.h"
 #include "log.h"
+#include "pool.h"
+#include "pqueue.h"
 #include "raii.h"
+#include "ratelimit.h"
+#include "ringbuffer.h"
+#include "segvector.h"
 #include "test.h"
 #include "vector.h"
+#include "vector_find.h"
+#include "vector_sort.h"
+
+VECTOR_DEFINE(int_vec, int)
 
-// To avoid raising aborts on mprobe we need to install a nop callback.
-void mcheck_abortfunc(enum mcheck_status status) {(void)status;}
+// Count heap allocations, so tests_run() fails tests which leak.
+ALLOC_TRACK_INTERPOSE()
 
 void init_tests(void) {
   // Restrict the logging to error messages to avoid cluttering test output.
   log_level = LL_LOG;
-   // Install debug hooks into malloc to track heap allocations.
-  mcheck(mcheck_abortfunc);
 }
 
 void cleanup_tests(void) {}
@@ -41,17 +62,28 @@ void reset_tests(void) {
   init_tests();
 }
 
-void raii_test(void) {
-  char *fd_filename = malloc(L_tmpnam * sizeof(char));
-  char *fp_filename = malloc(L_tmpnam * sizeof(char));
-  char **deallocated_fd_test_filename = NULL;
-  char **deallocated_fp_test_filename = NULL;
-  FILE **deallocated_test_fp = NULL;
-  char *fd_test_filename_copy = NULL;
-  char *fp_test_filename_copy = NULL;
-  FILE *test_fp_copy = NULL;
+// The variables of the scope in raii_test(), which is declared first in that
+// scope so its destructor runs after all others while they still exist.
+typedef struct RAII_TEST_SCOPE_ {
+  char **fd_test_filename;
+  char **fp_test_filename;
+  FILE **test_fp;
+  bool *cleared;
+} RAII_TEST_SCOPE;
 
-  int *deallocated_test_fd = 0;
+// Records if the destructors of the other variables set them to NULL.
+void raii_test_scope_exit(RAII_TEST_SCOPE *scope) {
+  *scope->cleared = *scope->fd_test_filename == NULL &&
+                    *scope->fp_test_filename == NULL &&
+                    *scope->test_fp == NULL;
+}
+
+void raii_test(void) {
+  LOCAL char *fd_filename = malloc(L_tmpnam * sizeof(char));
+  LOCAL char *fp_filename = malloc(L_tmpnam * sizeof(char));
+  bool cleared = false;
+  ALLOC_STATS before, after;
+  int closed_test_fd = invalid_fileno;
 
   ASSERT_NOT_NULL(fd_filename);
   ASSERT_NOT_NULL(fp_filename);
@@ -59,33 +91,34 @@ void raii_test(void) {
   ASSERT_NOT_NULL(tmpnam(fd_filename));
   ASSERT_NOT_NULL(tmpnam(fp_filename));
   // We use a local scope to test proper resource deallocation.
+  alloc_track_stats(&before);
   {
+    LOCAL_DESTRUCTOR(raii_test_scope_exit) RAII_TEST_SCOPE scope = {
+      .cleared = &cleared
+    };
     LOCAL char *fd_test_filename = strdup(fd_filename);
     LOCAL char *fp_test_filename = strdup(fp_filename);
     LOCAL_FD int test_fd = open(fd_test_filename, O_CREAT | O_EXCL, S_IRWXU);
     ASSERT_GREATER(test_fd, STDERR_FILENO);
     LOCAL_FP FILE *test_fp = fopen(fp_test_filename, "w+");
     ASSERT_NOT_NULL(test_fp);
-    // Copy local pointers to enable heap diagnostics.
-    fd_test_filename_copy = fd_test_filename;
-    fp_test_filename_copy = fp_test_filename;
-    test_fp_copy = test_fp;
-    // Store location of local variables to be able to check if
-    // their destructor set them to NULL/invalid.
-    deallocated_fd_test_filename = &fd_test_filename;
-    deallocated_fp_test_filename = &fp_test_filename;
-    deallocated_test_fp = &test_fp;
-    deallocated_test_fd = &test_fd;
+    // Let the scope check if the destructors set the variables to NULL, and
+    // keep the descriptor to check if it was closed.
+    scope.fd_test_filename = &fd_test_filename;
+    scope.fp_test_filename = &fp_test_filename;
+    scope.test_fp = &test_fp;
+    closed_test_fd = test_fd;
   }
   // Now check if the memory and files that have left their scope
   // have been closed/deallocated.
-  ASSERT_EQUAL(mprobe(fd_test_filename_copy), MCHECK_FREE);
-  ASSERT_EQUAL(mprobe(fp_test_filename_copy), MCHECK_FREE);
-  ASSERT_EQUAL(mprobe(test_fp_copy), MCHECK_FREE);
-  ASSERT_NULL(*deallocated_fd_test_filename);
-  ASSERT_NULL(*deallocated_fp_test_filename);
-  ASSERT_NULL(*deallocated_test_fp);
-  ASSERT_EQUAL(*deallocated_test_fd, invalid_fileno);
+  alloc_track_stats(&after);
+  // Both strings and the FILE.
+  ASSERT_TRUE(after.allocations - before.allocations >= 3);
+  ASSERT_EQUAL(after.allocations - before.allocations,
+               after.frees - before.frees);
+  ASSERT_EQUAL(after.live_bytes, before.live_bytes);
+  ASSERT_TRUE(cleared);
+  ASSERT_EQUAL(fcntl(closed_test_fd, F_GETFD), -1);
   // Make sure we don't leave tmpfiles lying around...
   ASSERT_ZERO(unlink(fd_filename));
   ASSERT_ZERO(unlink(fp_filename));
@@ -106,6 +139,7 @@ void vector_test_charp(void) {
   ASSERT_SUCCESS(vector_del(&vec, 0));
   ASSERT_EQUAL(vec.used_bytes, 0);
   ASSERT_EQUAL(vec.total_bytes, test_initial_capacity * vec.item_size);
+  vector_destroy(&vec);
 }
 
 void vector_test_lots_ints(void) {
@@ -127,19 +161,1703 @@ void vector_test_lots_ints(void) {
     size_t *number = vector_get(&vec, i);
     ASSERT_EQUAL(*number, i);
   }
+  vector_destroy(&vec);
+}
+
+void vector_test_typed(void) {
+  size_t test_size = 10000;
+  int value = 0;
+  int_vec vec;
+
+  ASSERT_SUCCESS(int_vec_init(&vec, VECTOR_DEFAULT_SIZE));
+  ASSERT_EQUAL(int_vec_size(&vec), 0);
+  for (size_t i = 0; i < test_size; ++i) {
+    ASSERT_NOT_NULL(int_vec_push(&vec, (int)i));
+  }
+  ASSERT_EQUAL(int_vec_size(&vec), test_size);
+  ASSERT_EQUAL(vec.vec.used_bytes, test_size * sizeof(int));
+  for (size_t i = 0; i < test_size; ++i) {
+    ASSERT_EQUAL(*int_vec_at(&vec, i), i);
+  }
+  ASSERT_NULL(int_vec_get(&vec, test_size));
+  // The typed vector must stay compatible with the generic functions.
+  ASSERT_EQUAL(*(int *)vector_get(&vec.vec, 42), 42);
+  for (size_t i = test_size; i > 0; --i) {
+    ASSERT_SUCCESS(int_vec_pop(&vec, &value));
+    ASSERT_EQUAL(value, i - 1);
+  }
+  ASSERT_EQUAL(int_vec_size(&vec), 0);
+  ASSERT_EQUAL(vec.vec.total_bytes, vec.vec.init_bytes);
+  ASSERT_EQUAL(int_vec_pop(&vec, &value), FAILURE);
+  int_vec_destroy(&vec);
+}
+
+void vector_test_bulk(void) {
+  size_t test_size = 1000;
+  size_t values[1000];
+  VECTOR vec;
+  VECTOR other;
+
+  for (size_t i = 0; i < test_size; ++i) {
+    values[i] = i;
+  }
+  ASSERT_SUCCESS(vector_init(&vec, sizeof(size_t), VECTOR_DEFAULT_SIZE));
+  ASSERT_SUCCESS(vector_reserve(&vec, test_size));
+  ASSERT_EQUAL(vec.total_bytes, test_size * sizeof(size_t));
+  ASSERT_NULL(vector_push_n(&vec, values, test_size, sizeof(int)));
+  ASSERT_NOT_NULL(vector_push_n(&vec, values, test_size, sizeof(size_t)));
+  ASSERT_EQUAL(vec.used_bytes, test_size * sizeof(size_t));
+  // A full vector has to grow exactly once, straight to the needed size.
+  ASSERT_NOT_NULL(vector_push_n(&vec, values, test_size, sizeof(size_t)));
+  ASSERT_EQUAL(vec.total_bytes, 2 * test_size * sizeof(size_t));
+  ASSERT_NOT_NULL(vector_push_n(&vec, values, 1, sizeof(size_t)));
+  ASSERT_EQUAL(vec.total_bytes, 4 * test_size * sizeof(size_t));
+
+  // Insert two items at the front, the middle and the end.
+  ASSERT_NOT_NULL(vector_insert_n(&vec, 0, values + 10, 2, sizeof(size_t)));
+  ASSERT_NOT_NULL(vector_insert_n(&vec, 5, values + 20, 2, sizeof(size_t)));
+  ASSERT_NOT_NULL(vector_insert_n(&vec, 2 * test_size + 5, values + 30, 2,
+                                  sizeof(size_t)));
+  ASSERT_NULL(vector_insert_n(&vec, 2 * test_size + 8, values, 2,
+                              sizeof(size_t)));
+  size_t expected[] = {10, 11, 0, 1, 2, 20, 21, 3, 4};
+  for (size_t i = 0; i < ARRAYSIZE(expected); ++i) {
+    ASSERT_EQUAL(*(size_t *)vector_get(&vec, i), expected[i]);
+  }
+  ASSERT_EQUAL(*(size_t *)vector_get(&vec, 2 * test_size + 4), 0);
+  ASSERT_EQUAL(*(size_t *)vector_get(&vec, 2 * test_size + 5), 30);
+  ASSERT_EQUAL(*(size_t *)vector_get(&vec, 2 * test_size + 6), 31);
+
+  ASSERT_SUCCESS(vector_init(&other, sizeof(size_t), VECTOR_DEFAULT_SIZE));
+  ASSERT_NOT_NULL(vector_push_n(&other, values, test_size, sizeof(size_t)));
+  ASSERT_SUCCESS(vector_extend(&other, &other));
+  ASSERT_EQUAL(other.used_bytes, 2 * test_size * sizeof(size_t));
+  for (size_t i = 0; i < 2 * test_size; ++i) {
+    ASSERT_EQUAL(*(size_t *)vector_get(&other, i), i % test_size);
+  }
+  ASSERT_SUCCESS(vector_extend(&vec, &other));
+  ASSERT_EQUAL(vec.used_bytes, (4 * test_size + 7) * sizeof(size_t));
+  ASSERT_EQUAL(*(size_t *)vector_get(&vec, 4 * test_size + 6), test_size - 1);
+  vector_destroy(&other);
+  vector_destroy(&vec);
+}
+
+void vector_test_policy(void) {
+  size_t test_capacity = 16;
+  VECTOR vec;
+
+  // Policies which shrink right after growing are rejected.
+  ASSERT_EQUAL(vector_init_policy(&vec, sizeof(size_t), test_capacity,
+      (VECTOR_POLICY){200, 50}), FAILURE);
+  ASSERT_EQUAL(vector_init_policy(&vec, sizeof(size_t), test_capacity,
+      (VECTOR_POLICY){100, 0}), FAILURE);
+  ASSERT_EQUAL(vector_init_policy(&vec, sizeof(size_t), test_capacity,
+      (VECTOR_POLICY){UINT16_MAX, UINT16_MAX}), FAILURE);
+
+  // Pushing and popping right at the boundary must not resize every time.
+  ASSERT_SUCCESS(vector_init(&vec, sizeof(size_t), test_capacity));
+  for (size_t i = 0; i <= test_capacity; ++i) {
+    ASSERT_NOT_NULL(vector_push(&vec, &i, sizeof(i)));
+  }
+  ASSERT_EQUAL(vec.total_bytes, 2 * test_capacity * sizeof(size_t));
+  for (size_t i = 0; i < 100; ++i) {
+    ASSERT_SUCCESS(vector_del(&vec, test_capacity));
+    ASSERT_NOT_NULL(vector_push(&vec, &i, sizeof(i)));
+    ASSERT_EQUAL(vec.total_bytes, 2 * test_capacity * sizeof(size_t));
+  }
+  // It shrinks once a quarter full, but never below the initial capacity.
+  while (vec.used_bytes > test_capacity / 2 * sizeof(size_t)) {
+    ASSERT_SUCCESS(vector_del(&vec, 0));
+  }
+  ASSERT_EQUAL(vec.total_bytes, test_capacity * sizeof(size_t));
+  while (vec.used_bytes) {
+    ASSERT_SUCCESS(vector_del(&vec, 0));
+  }
+  ASSERT_EQUAL(vec.total_bytes, test_capacity * sizeof(size_t));
+  ASSERT_SUCCESS(vector_shrink_to_fit(&vec));
+  ASSERT_EQUAL(vec.total_bytes, sizeof(size_t));
+  vector_destroy(&vec);
+
+  ASSERT_SUCCESS(vector_init_policy(&vec, sizeof(size_t), test_capacity,
+                                    VECTOR_POLICY_COMPACT));
+  for (size_t i = 0; i <= test_capacity; ++i) {
+    ASSERT_NOT_NULL(vector_push(&vec, &i, sizeof(i)));
+  }
+  ASSERT_EQUAL(vec.total_bytes, test_capacity * 3 / 2 * sizeof(size_t));
+  vector_destroy(&vec);
+
+  ASSERT_SUCCESS(vector_init_policy(&vec, sizeof(size_t), test_capacity,
+                                    VECTOR_POLICY_NEVER_SHRINK));
+  for (size_t i = 0; i < 10 * test_capacity; ++i) {
+    ASSERT_NOT_NULL(vector_push(&vec, &i, sizeof(i)));
+  }
+  size_t total_bytes = vec.total_bytes;
+  while (vec.used_bytes) {
+    ASSERT_SUCCESS(vector_del(&vec, 0));
+  }
+  ASSERT_EQUAL(vec.total_bytes, total_bytes);
+  ASSERT_SUCCESS(vector_shrink_to_fit(&vec));
+  ASSERT_EQUAL(vec.total_bytes, sizeof(size_t));
+  vector_destroy(&vec);
+}
+
+bool is_even(const void *element, void *ctx) {
+  (*(size_t *)ctx)++;
+  return *(const size_t *)element % 2 == 0;
+}
+
+void vector_test_remove(void) {
+  size_t test_size = 1000;
+  size_t calls = 0;
+  VECTOR vec;
+
+  ASSERT_SUCCESS(vector_init(&vec, sizeof(size_t), VECTOR_DEFAULT_SIZE));
+  for (size_t i = 0; i < test_size; ++i) {
+    ASSERT_NOT_NULL(vector_push(&vec, &i, sizeof(i)));
+  }
+  // Deleting from the middle keeps the order of the remaining elements.
+  ASSERT_SUCCESS(vector_del(&vec, 10));
+  ASSERT_EQUAL(*(size_t *)vector_get(&vec, 9), 9);
+  ASSERT_EQUAL(*(size_t *)vector_get(&vec, 10), 11);
+  ASSERT_EQUAL(*(size_t *)vector_get(&vec, test_size - 2), test_size - 1);
+  ASSERT_NULL(vector_get(&vec, test_size - 1));
+  ASSERT_EQUAL(vector_del(&vec, test_size - 1), FAILURE);
+
+  // Swap removal moves the last element into the hole.
+  ASSERT_SUCCESS(vector_swap_remove(&vec, 0));
+  ASSERT_EQUAL(*(size_t *)vector_get(&vec, 0), test_size - 1);
+  ASSERT_EQUAL(vec.used_bytes, (test_size - 2) * sizeof(size_t));
+  ASSERT_SUCCESS(vector_swap_remove(&vec, test_size - 3));
+  ASSERT_EQUAL(*(size_t *)vector_get(&vec, test_size - 4), test_size - 3);
+
+  size_t *last = vector_pop_copy(&vec);
+  ASSERT_NOT_NULL(last);
+  ASSERT_EQUAL(*last, test_size - 3);
+  free(last);
+  ASSERT_SUCCESS(vector_pop(&vec));
+  ASSERT_EQUAL(vec.used_bytes, (test_size - 5) * sizeof(size_t));
+
+  // Remaining: 999, 1..9, 11..995
+  size_t removed = vector_remove_if(&vec, is_even, &calls);
+  ASSERT_EQUAL(removed, 496);
+  ASSERT_EQUAL(calls, test_size - 5);
+  ASSERT_EQUAL(vec.used_bytes, (test_size - 5 - 496) * sizeof(size_t));
+  ASSERT_EQUAL(*(size_t *)vector_get(&vec, 0), 999);
+  ASSERT_EQUAL(*(size_t *)vector_get(&vec, 1), 1);
+  ASSERT_EQUAL(*(size_t *)vector_get(&vec, 5), 9);
+  ASSERT_EQUAL(*(size_t *)vector_get(&vec, 6), 11);
+  for (size_t i = 2; i < vec.used_bytes / sizeof(size_t); ++i) {
+    size_t *element = vector_get(&vec, i);
+    ASSERT_EQUAL(*element % 2, 1);
+    ASSERT_GREATER(*element, *(size_t *)vector_get(&vec, i - 1));
+  }
+  ASSERT_EQUAL(vector_remove_if(&vec, is_even, &calls), 0);
+
+  while (vec.used_bytes) {
+    ASSERT_SUCCESS(vector_pop(&vec));
+  }
+  ASSERT_EQUAL(vector_pop(&vec), FAILURE);
+  ASSERT_NULL(vector_pop_copy(&vec));
+  vector_destroy(&vec);
+}
+
+void vector_test_small(void) {
+  size_t test_size = 100;
+  SMALL_VECTOR(size_t, 8) svec;
+
+  ASSERT_SUCCESS(SMALL_VECTOR_INIT(&svec));
+  ASSERT_EQUAL(svec.vec.total_bytes, 8 * sizeof(size_t));
+  for (size_t i = 0; i < 8; ++i) {
+    ASSERT_NOT_NULL(vector_push(&svec.vec, &i, sizeof(i)));
+  }
+  ASSERT_EQUAL_POINTERS(svec.vec.data, svec.items);
+  ASSERT_EQUAL(svec.items[7], 7);
+  // Spill to the heap and keep the contents.
+  for (size_t i = 8; i < test_size; ++i) {
+    ASSERT_NOT_NULL(vector_push(&svec.vec, &i, sizeof(i)));
+  }
+  ASSERT_NOT_EQUAL_POINTERS(svec.vec.data, (uint8_t *)svec.items);
+  for (size_t i = 0; i < test_size; ++i) {
+    ASSERT_EQUAL(*(size_t *)vector_get(&svec.vec, i), i);
+  }
+  ASSERT_SUCCESS(vector_del(&svec.vec, 0));
+  ASSERT_EQUAL(*(size_t *)vector_get(&svec.vec, 0), 1);
+  // Shrinking back to the initial capacity moves back into the struct.
+  while (svec.vec.used_bytes > 2 * sizeof(size_t)) {
+    ASSERT_SUCCESS(vector_pop(&svec.vec));
+  }
+  ASSERT_EQUAL_POINTERS(svec.vec.data, svec.items);
+  ASSERT_EQUAL(svec.vec.total_bytes, 8 * sizeof(size_t));
+  ASSERT_EQUAL(svec.items[0], 1);
+  ASSERT_EQUAL(svec.items[1], 2);
+  vector_destroy(&svec.vec);
+}
+
+void vector_test_mmap(void) {
+  size_t test_size = 1000000;
+  VECTOR vec;
+
+  ASSERT_SUCCESS(vector_init_mmap(&vec, sizeof(size_t), VECTOR_DEFAULT_SIZE,
+                                  false));
+  ASSERT_EQUAL(vec.mapped_bytes, sysconf(_SC_PAGESIZE));
+  ASSERT_EQUAL(vec.total_bytes, vec.mapped_bytes);
+  for (size_t i = 0; i < test_size; ++i) {
+    ASSERT_NOT_NULL(vector_push(&vec, &i, sizeof(i)));
+  }
+  for (size_t i = 0; i < test_size; ++i) {
+    ASSERT_EQUAL(*(size_t *)vector_get(&vec, i), i);
+  }
+  // Shrinking releases pages but keeps the address space.
+  size_t mapped_bytes = vec.mapped_bytes;
+  while (vec.used_bytes > 1000 * sizeof(size_t)) {
+    ASSERT_SUCCESS(vector_pop(&vec));
+  }
+  ASSERT_SMALLER(vec.total_bytes, mapped_bytes / 4);
+  ASSERT_EQUAL(vec.mapped_bytes, mapped_bytes);
+  ASSERT_EQUAL(*(size_t *)vector_get(&vec, 999), 999);
+  uint8_t *data = vec.data;
+  for (size_t i = 1000; i < test_size; ++i) {
+    ASSERT_NOT_NULL(vector_push(&vec, &i, sizeof(i)));
+  }
+  ASSERT_EQUAL_POINTERS(vec.data, data);
+  ASSERT_EQUAL(*(size_t *)vector_get(&vec, test_size - 1), test_size - 1);
+  vector_destroy(&vec);
+
+  data = calloc(test_size, 6);
+  ASSERT_NOT_NULL(data);
+  ASSERT_SUCCESS(vector_init_mmap(&vec, 3, test_size, true));
+  ASSERT_EQUAL(vec.mapped_bytes % (2 * 1024 * 1024), 0);
+  ASSERT_EQUAL(vec.total_bytes % 3, 0);
+  ASSERT_NOT_NULL(vector_push_n(&vec, data, 2 * test_size, 3));
+  ASSERT_EQUAL(vec.used_bytes, 6 * test_size);
+  vector_destroy(&vec);
+  free(data);
+}
+
+int compare_size_t(const void *a, const void *b) {
+  size_t lhs = *(const size_t *)a;
+  size_t rhs = *(const size_t *)b;
+  return (lhs > rhs) - (lhs < rhs);
+}
+
+int compare_first_byte(const void *a, const void *b) {
+  return *(const uint8_t *)a - *(const uint8_t *)b;
+}
+
+void vector_test_view(void) {
+  char path[] = "/tmp/cutil_vector_XXXXXX";
+  size_t test_size = 100000;
+  VECTOR vec;
+  VECTOR view;
+
+  ASSERT_NOT_EQUAL(mkstemp(path), invalid_fileno);
+  ASSERT_SUCCESS(vector_init(&vec, 3 * sizeof(uint32_t), VECTOR_DEFAULT_SIZE));
+  for (uint32_t i = 0; i < test_size; ++i) {
+    uint32_t item[3] = {i, i * 2, i * 3};
+    ASSERT_NOT_NULL(vector_push(&vec, item, sizeof(item)));
+  }
+  ASSERT_SUCCESS(vector_save(&vec, path));
+  vector_destroy(&vec);
+
+  {
+    LOCAL_MMAP MMAP_REGION region;
+    ASSERT_SUCCESS(mmap_file(&region, path, false));
+    ASSERT_EQUAL(region.size,
+                 sizeof(VECTOR_FILE_HEADER) + test_size * 3 * sizeof(uint32_t));
+    ASSERT_SUCCESS(mmap_advise(&region, MMAP_SEQUENTIAL));
+    ASSERT_EQUAL(vector_init_view(&view, sizeof(uint32_t), &region), FAILURE);
+    ASSERT_SUCCESS(vector_init_view(&view, 3 * sizeof(uint32_t), &region));
+    ASSERT_EQUAL(view.used_bytes / view.item_size, test_size);
+    for (uint32_t i = 0; i < test_size; ++i) {
+      uint32_t *item = vector_get(&view, i);
+      ASSERT_EQUAL(item[0], i);
+      ASSERT_EQUAL(item[2], i * 3);
+    }
+    // The view is read only.
+    uint32_t item[3] = {0};
+    ASSERT_NULL(vector_push(&view, item, sizeof(item)));
+    // Even when nothing needs to grow.
+    ASSERT_NULL(vector_push_n(&view, item, 0, sizeof(item)));
+    ASSERT_NULL(vector_insert_n(&view, 0, item, 0, sizeof(item)));
+    ASSERT_EQUAL(vector_extend(&view, &view), FAILURE);
+    ASSERT_EQUAL(vector_pop(&view), FAILURE);
+    ASSERT_EQUAL(vector_swap_remove(&view, 0), FAILURE);
+    ASSERT_EQUAL(vector_radix_sort(&view, 0, 4), FAILURE);
+    ASSERT_EQUAL(view.used_bytes / view.item_size, test_size);
+    vector_destroy(&view);
+
+    // Corrupt files are rejected.
+    region.size = sizeof(VECTOR_FILE_HEADER) + 10;
+    ASSERT_EQUAL(vector_init_view(&view, 3 * sizeof(uint32_t), &region),
+                 FAILURE);
+    region.size = sizeof(VECTOR_FILE_HEADER) + test_size * 3 * sizeof(uint32_t);
+  }
+  ASSERT_ZERO(unlink(path));
+}
+
+void vector_test_find(void) {
+  VECTOR vec;
+  VECTOR indices;
+
+  ASSERT_SUCCESS(vector_init(&indices, sizeof(size_t), VECTOR_DEFAULT_SIZE));
+  // Every vectorized size plus one that falls back to memcmp().
+  for (size_t item_size = 1; item_size <= 8; ++item_size) {
+    if (item_size == 5 || item_size == 6 || item_size == 7) {
+      continue;
+    }
+    uint8_t key[8] = {0};
+    uint8_t item[8] = {0};
+    ASSERT_SUCCESS(vector_init(&vec, item_size, VECTOR_DEFAULT_SIZE));
+    for (size_t i = 0; i < 1000; ++i) {
+      // Only the last byte of the key differs in the near misses.
+      item[item_size - 1] = i % 7 == 3 ? 0x5a : 0x5b;
+      item[0] = item_size > 1 ? 0x11 : item[item_size - 1];
+      ASSERT_NOT_NULL(vector_push(&vec, item, item_size));
+    }
+    key[0] = item_size > 1 ? 0x11 : 0x5a;
+    key[item_size - 1] = 0x5a;
+    ASSERT_EQUAL(vector_find(&vec, key, 0), 3);
+    ASSERT_EQUAL(vector_find(&vec, key, 4), 10);
+    ASSERT_EQUAL(vector_find(&vec, key, 997), 997);
+    ASSERT_EQUAL(vector_find(&vec, key, 998), 1000);
+    ASSERT_EQUAL(vector_count(&vec, key), 143);
+    indices.used_bytes = 0;
+    ASSERT_SUCCESS(vector_find_all(&vec, key, &indices));
+    ASSERT_EQUAL(indices.used_bytes / sizeof(size_t), 143);
+    ASSERT_EQUAL(*(size_t *)vector_get(&indices, 142), 997);
+    vector_destroy(&vec);
+  }
+  ASSERT_SUCCESS(vector_init(&vec, 3, VECTOR_DEFAULT_SIZE));
+  ASSERT_NOT_NULL(vector_push(&vec, "abc", 3));
+  ASSERT_NOT_NULL(vector_push(&vec, "abd", 3));
+  ASSERT_EQUAL(vector_find(&vec, "abd", 0), 1);
+  ASSERT_EQUAL(vector_count(&vec, "abe"), 0);
+  vector_destroy(&vec);
+  vector_destroy(&indices);
+}
+
+void vector_test_sort(void) {
+  size_t test_size = 10000;
+  size_t key = 0;
+  VECTOR vec;
+
+  ASSERT_SUCCESS(vector_init(&vec, sizeof(size_t), VECTOR_DEFAULT_SIZE));
+  for (size_t i = 0; i < test_size; ++i) {
+    // Lots of duplicates in a scrambled order.
+    size_t value = (i * 7919) % (test_size / 4);
+    ASSERT_NOT_NULL(vector_push(&vec, &value, sizeof(value)));
+  }
+  ASSERT_SUCCESS(vector_sort(&vec, compare_size_t));
+  for (size_t i = 1; i < test_size; ++i) {
+    ASSERT_TRUE(*(size_t *)vector_get(&vec, i - 1) <=
+                *(size_t *)vector_get(&vec, i));
+  }
+  key = 42;
+  ASSERT_EQUAL(vector_lower_bound(&vec, &key, compare_size_t), 4 * 42);
+  ASSERT_EQUAL(*(size_t *)vector_bsearch(&vec, &key, compare_size_t), 42);
+  key = test_size;
+  ASSERT_EQUAL(vector_lower_bound(&vec, &key, compare_size_t), test_size);
+  ASSERT_NULL(vector_bsearch(&vec, &key, compare_size_t));
+
+  // Reverse the order and sort by the radix of the whole key.
+  for (size_t i = 0; i < test_size; ++i) {
+    *(size_t *)vector_get(&vec, i) = test_size - i;
+  }
+  ASSERT_EQUAL(vector_radix_sort(&vec, 4, 8), FAILURE);
+  ASSERT_EQUAL(vector_radix_sort(&vec, SIZE_MAX, 2), FAILURE);
+  ASSERT_SUCCESS(vector_radix_sort(&vec, 0, 8));
+  for (size_t i = 0; i < test_size; ++i) {
+    ASSERT_EQUAL(*(size_t *)vector_get(&vec, i), i + 1);
+  }
+  vector_destroy(&vec);
+
+  // Odd sized items go through the pointer sort, radix sort must be stable.
+  uint8_t item[3];
+  ASSERT_SUCCESS(vector_init(&vec, sizeof(item), VECTOR_DEFAULT_SIZE));
+  for (size_t i = 0; i < test_size; ++i) {
+    item[0] = (i * 31) % 251;
+    item[1] = i % 256;
+    item[2] = i / 256;
+    ASSERT_NOT_NULL(vector_push(&vec, item, sizeof(item)));
+  }
+  ASSERT_SUCCESS(vector_radix_sort(&vec, 0, 1));
+  for (size_t i = 1; i < test_size; ++i) {
+    uint8_t *prev = vector_get(&vec, i - 1);
+    uint8_t *next = vector_get(&vec, i);
+    ASSERT_TRUE(prev[0] < next[0] ||
+                (prev[0] == next[0] &&
+                 prev[1] + 256 * prev[2] < next[1] + 256 * next[2]));
+  }
+  ASSERT_SUCCESS(vector_radix_sort(&vec, 1, 2));
+  ASSERT_SUCCESS(vector_sort(&vec, compare_first_byte));
+  for (size_t i = 1; i < test_size; ++i) {
+    ASSERT_TRUE(*(uint8_t *)vector_get(&vec, i - 1) <=
+                *(uint8_t *)vector_get(&vec, i));
+  }
+  vector_destroy(&vec);
+}
+
+void segvector_test(void) {
+  size_t test_size = 10000;
+  size_t *first = NULL;
+  size_t *last = NULL;
+  SEGVECTOR vec;
+
+  ASSERT_EQUAL(segvector_init(&vec, sizeof(size_t), 64), FAILURE);
+  ASSERT_SUCCESS(segvector_init(&vec, sizeof(size_t), 4));
+  ASSERT_NULL(segvector_get(&vec, 0));
+  ASSERT_NULL(segvector_push(&vec, &test_size, sizeof(int)));
+  for (size_t i = 0; i < test_size; ++i) {
+    size_t *element = segvector_push(&vec, &i, sizeof(i));
+    ASSERT_NOT_NULL(element);
+    if (i == 0) {
+      first = element;
+    }
+  }
+  ASSERT_EQUAL(vec.size, test_size);
+  ASSERT_EQUAL(vec.chunks.used_bytes, test_size / 16 * sizeof(uint8_t *));
+  // Growing must not have moved anything.
+  ASSERT_EQUAL_POINTERS(segvector_get(&vec, 0), first);
+  for (size_t i = 0; i < test_size; ++i) {
+    ASSERT_EQUAL(*(size_t *)segvector_get(&vec, i), i);
+  }
+  ASSERT_NULL(segvector_get(&vec, test_size));
+
+  last = segvector_pop_copy(&vec);
+  ASSERT_NOT_NULL(last);
+  ASSERT_EQUAL(*last, test_size - 1);
+  free(last);
+  // Popping keeps one spare chunk around.
+  while (vec.size > 16) {
+    ASSERT_SUCCESS(segvector_pop(&vec));
+  }
+  ASSERT_EQUAL(vec.chunks.used_bytes, 2 * sizeof(uint8_t *));
+  ASSERT_NOT_NULL(segvector_push(&vec, &test_size, sizeof(test_size)));
+  ASSERT_EQUAL(*(size_t *)segvector_get(&vec, 16), test_size);
+  ASSERT_EQUAL_POINTERS(segvector_get(&vec, 0), first);
+  while (vec.size) {
+    ASSERT_SUCCESS(segvector_pop(&vec));
+  }
+  ASSERT_EQUAL(segvector_pop(&vec), FAILURE);
+  ASSERT_EQUAL(vec.chunks.used_bytes, sizeof(uint8_t *));
+  segvector_destroy(&vec);
+}
+
+#define CVECTOR_TEST_THREADS 4
+#define CVECTOR_TEST_ITEMS 100000
+
+void *cvector_test_producer(void *vec) {
+  static size_t next_thread = 0;
+  size_t thread = __atomic_fetch_add(&next_thread, 1, __ATOMIC_RELAXED);
+  for (size_t i = 0; i < CVECTOR_TEST_ITEMS; ++i) {
+    size_t value = thread * CVECTOR_TEST_ITEMS + i;
+    if (!cvector_push(vec, &value, sizeof(value))) {
+      return vec;
+    }
+  }
+  return NULL;
+}
+
+void cvector_test(void) {
+  size_t total = CVECTOR_TEST_THREADS * CVECTOR_TEST_ITEMS;
+  pthread_t threads[CVECTOR_TEST_THREADS];
+  size_t index = 0;
+  void *result = NULL;
+  CVECTOR vec;
+
+  ASSERT_EQUAL(cvector_init(&vec, sizeof(size_t), SIZE_MAX), FAILURE);
+  ASSERT_SUCCESS(cvector_init(&vec, sizeof(size_t), 10));
+  ASSERT_EQUAL(cvector_segment_items(&vec, 0), 16);
+  // A reserved but uncommitted element is invisible to readers.
+  size_t *first = cvector_reserve(&vec, &index);
+  ASSERT_NOT_NULL(first);
+  ASSERT_EQUAL(index, 0);
+  ASSERT_NULL(cvector_get(&vec, 0));
+  *first = total;
+  cvector_commit(&vec, index);
+  ASSERT_EQUAL(*(size_t *)cvector_get(&vec, 0), total);
+  ASSERT_EQUAL(cvector_published(&vec), 1);
+
+  for (size_t i = 0; i < CVECTOR_TEST_THREADS; ++i) {
+    ASSERT_ZERO(pthread_create(&threads[i], NULL, cvector_test_producer,
+                               &vec));
+  }
+  for (size_t i = 0; i < CVECTOR_TEST_THREADS; ++i) {
+    ASSERT_ZERO(pthread_join(threads[i], &result));
+    ASSERT_NULL(result);
+  }
+  ASSERT_EQUAL(cvector_size(&vec), total + 1);
+  ASSERT_EQUAL(cvector_published(&vec), total + 1);
+  ASSERT_EQUAL_POINTERS(cvector_get(&vec, 0), first);
+  // Every value must be stored exactly once.
+  uint8_t *seen = calloc(total, 1);
+  ASSERT_NOT_NULL(seen);
+  for (size_t i = 1; i <= total; ++i) {
+    size_t value = *(size_t *)cvector_ptr(&vec, i);
+    ASSERT_SMALLER(value, total);
+    ASSERT_ZERO(seen[value]);
+    seen[value] = 1;
+  }
+  free(seen);
+  ASSERT_NULL(cvector_get(&vec, total + 1));
+  cvector_destroy(&vec);
+}
+
+#define RING_TEST_ITEMS 1000000
+
+void *spsc_ring_test_consumer(void *ring) {
+  size_t values[7];
+  size_t expected = 0;
+  while (expected < RING_TEST_ITEMS) {
+    size_t count = spsc_ring_pop_n(ring, values, ARRAYSIZE(values));
+    if (count == 0) {
+      sched_yield();
+    }
+    for (size_t i = 0; i < count; ++i) {
+      if (values[i] != expected++) {
+        return ring;
+      }
+    }
+  }
+  return NULL;
+}
+
+void spsc_ring_test(void) {
+  size_t values[5] = {1, 2, 3, 4, 5};
+  size_t value = 0;
+  pthread_t consumer;
+  void *result = NULL;
+  SPSC_RING ring;
+
+  ASSERT_SUCCESS(spsc_ring_init(&ring, sizeof(size_t), 3));
+  ASSERT_EQUAL(ring.mask, 3);
+  ASSERT_EQUAL(spsc_ring_pop(&ring, &value), FAILURE);
+  ASSERT_EQUAL(spsc_ring_push(&ring, &value, sizeof(int)), FAILURE);
+  ASSERT_EQUAL(spsc_ring_push_n(&ring, values, 5, sizeof(size_t)), 4);
+  ASSERT_EQUAL(spsc_ring_push(&ring, &value, sizeof(value)), FAILURE);
+  ASSERT_EQUAL(spsc_ring_size(&ring), 4);
+  ASSERT_SUCCESS(spsc_ring_pop(&ring, &value));
+  ASSERT_EQUAL(value, 1);
+  // Wrap around the end of the ring.
+  ASSERT_EQUAL(spsc_ring_push_n(&ring, values + 4, 1, sizeof(size_t)), 1);
+  ASSERT_EQUAL(spsc_ring_pop_n(&ring, values, 5), 4);
+  ASSERT_EQUAL(values[0], 2);
+  ASSERT_EQUAL(values[3], 5);
+  spsc_ring_destroy(&ring);
+
+  ASSERT_SUCCESS(spsc_ring_init(&ring, sizeof(size_t), 64));
+  ASSERT_ZERO(pthread_create(&consumer, NULL, spsc_ring_test_consumer, &ring));
+  for (size_t i = 0; i < RING_TEST_ITEMS;) {
+    for (size_t j = 0; j < ARRAYSIZE(values); ++j) {
+      values[j] = i + j;
+    }
+    size_t count = RING_TEST_ITEMS - i;
+    if (count > ARRAYSIZE(values)) {
+      count = ARRAYSIZE(values);
+    }
+    count = spsc_ring_push_n(&ring, values, count, sizeof(size_t));
+    if (count == 0) {
+      sched_yield();
+    }
+    i += count;
+  }
+  ASSERT_ZERO(pthread_join(consumer, &result));
+  ASSERT_NULL(result);
+  spsc_ring_destroy(&ring);
+}
+
+#define MPMC_TEST_THREADS 2
+
+void *mpmc_ring_test_producer(void *ring) {
+  for (size_t i = 1; i <= RING_TEST_ITEMS; ++i) {
+    while (mpmc_ring_push(ring, &i, sizeof(i)) != SUCCESS) {
+      sched_yield();
+    }
+  }
+  return NULL;
+}
+
+void *mpmc_ring_test_consumer(void *ring) {
+  size_t values[3];
+  size_t sum = 0;
+  size_t popped = 0;
+  while (popped < RING_TEST_ITEMS) {
+    size_t count = RING_TEST_ITEMS - popped;
+    if (count > ARRAYSIZE(values)) {
+      count = ARRAYSIZE(values);
+    }
+    count = mpmc_ring_pop_n(ring, values, count);
+    if (count == 0) {
+      sched_yield();
+    }
+    for (size_t i = 0; i < count; ++i) {
+      sum += values[i];
+    }
+    popped += count;
+  }
+  return (void *)sum;
+}
+
+void mpmc_ring_test(void) {
+  size_t values[5] = {1, 2, 3, 4, 5};
+  size_t value = 0;
+  size_t sum = 0;
+  pthread_t producers[MPMC_TEST_THREADS];
+  pthread_t consumers[MPMC_TEST_THREADS];
+  void *result = NULL;
+  MPMC_RING ring;
+
+  ASSERT_SUCCESS(mpmc_ring_init(&ring, sizeof(size_t), 4));
+  ASSERT_EQUAL(mpmc_ring_pop(&ring, &value), FAILURE);
+  ASSERT_EQUAL(mpmc_ring_push_n(&ring, values, 5, sizeof(size_t)), 4);
+  ASSERT_EQUAL(mpmc_ring_push(&ring, &value, sizeof(value)), FAILURE);
+  ASSERT_SUCCESS(mpmc_ring_pop(&ring, &value));
+  ASSERT_EQUAL(value, 1);
+  ASSERT_SUCCESS(mpmc_ring_push(&ring, values + 4, sizeof(size_t)));
+  ASSERT_EQUAL(mpmc_ring_pop_n(&ring, values, 5), 4);
+  ASSERT_EQUAL(values[0], 2);
+  ASSERT_EQUAL(values[3], 5);
+  mpmc_ring_destroy(&ring);
+
+  ASSERT_SUCCESS(mpmc_ring_init(&ring, sizeof(size_t), 64));
+  for (size_t i = 0; i < MPMC_TEST_THREADS; ++i) {
+    ASSERT_ZERO(pthread_create(&producers[i], NULL, mpmc_ring_test_producer,
+                               &ring));
+    ASSERT_ZERO(pthread_create(&consumers[i], NULL, mpmc_ring_test_consumer,
+                               &ring));
+  }
+  for (size_t i = 0; i < MPMC_TEST_THREADS; ++i) {
+    ASSERT_ZERO(pthread_join(producers[i], NULL));
+    ASSERT_ZERO(pthread_join(consumers[i], &result));
+    sum += (size_t)result;
+  }
+  ASSERT_EQUAL(sum, (size_t)MPMC_TEST_THREADS * RING_TEST_ITEMS *
+                    (RING_TEST_ITEMS + 1) / 2);
+  ASSERT_EQUAL(mpmc_ring_pop(&ring, &value), FAILURE);
+  mpmc_ring_destroy(&ring);
+}
+
+// Once a vector has the capacity it needs, none of the operations on it
+// call malloc().
+void vector_test_hot_path(void) {
+  size_t test_size = 1000;
+  size_t values[4] = {1, 2, 3, 4};
+  size_t calls = 0;
+  size_t key = 7;
+  int value = 0;
+  VECTOR vec;
+  int_vec typed;
+  SMALL_VECTOR(size_t, 8) small;
+
+  // The two vectors, one shrink and one grow.
+  test_alloc_budget(4, 32 * 1024);
+  ASSERT_SUCCESS(vector_init_policy(&vec, sizeof(size_t), test_size + 16,
+                                    VECTOR_POLICY_NEVER_SHRINK));
+  ASSERT_SUCCESS(int_vec_init_policy(&typed, test_size,
+                                     VECTOR_POLICY_NEVER_SHRINK));
+  for (size_t i = 0; i < test_size; ++i) {
+    ASSERT_NO_ALLOCATIONS(vector_push(&vec, &i, sizeof(i)));
+    ASSERT_NO_ALLOCATIONS(int_vec_push(&typed, (int)i));
+  }
+  ASSERT_NO_ALLOCATIONS(vector_push_new(&vec, sizeof(size_t)));
+  ASSERT_NO_ALLOCATIONS(vector_push_n(&vec, values, 4, sizeof(size_t)));
+  ASSERT_NO_ALLOCATIONS(vector_insert_n(&vec, 0, values, 4, sizeof(size_t)));
+  ASSERT_NO_ALLOCATIONS(vector_get(&vec, 3));
+  ASSERT_NO_ALLOCATIONS(vector_ptr(&vec, 3));
+  ASSERT_NO_ALLOCATIONS(vector_find(&vec, &key, 0));
+  ASSERT_NO_ALLOCATIONS(vector_count(&vec, &key));
+  ASSERT_NO_ALLOCATIONS(vector_lower_bound(&vec, &key, compare_size_t));
+  ASSERT_NO_ALLOCATIONS(vector_del(&vec, 1));
+  ASSERT_NO_ALLOCATIONS(vector_swap_remove(&vec, 0));
+  ASSERT_NO_ALLOCATIONS(vector_remove_if(&vec, is_even, &calls));
+  for (size_t i = 0; i < test_size / 4; ++i) {
+    ASSERT_NO_ALLOCATIONS(vector_pop(&vec));
+    ASSERT_NO_ALLOCATIONS(int_vec_pop(&typed, &value));
+  }
+  ASSERT_NO_ALLOCATIONS(int_vec_get(&typed, 42));
+  ASSERT_NO_ALLOCATIONS(SMALL_VECTOR_INIT(&small));
+  for (size_t i = 0; i < ARRAYSIZE(small.items); ++i) {
+    ASSERT_NO_ALLOCATIONS(vector_push(&small.vec, &i, sizeof(i)));
+  }
+  vector_destroy(&small.vec);
+
+  // Growing a full vector is counted.
+  ALLOC_STATS before, after;
+  ASSERT_SUCCESS(vector_shrink_to_fit(&vec));
+  alloc_track_stats(&before);
+  ASSERT_NOT_NULL(vector_push(&vec, &key, sizeof(key)));
+  alloc_track_stats(&after);
+  ASSERT_EQUAL(after.allocations - before.allocations, 1);
+  vector_destroy(&vec);
+  int_vec_destroy(&typed);
+}
+
+void arena_test(void) {
+  LOCAL_ARENA ARENA arena;
+  ASSERT_SUCCESS(arena_init(&arena, 1024));
+
+  uint8_t *first = arena_alloc(&arena, 3);
+  ASSERT_NOT_NULL(first);
+  uint8_t *second = arena_alloc(&arena, 8);
+  ASSERT_EQUAL((uintptr_t)second % ARENA_ALIGNMENT, 0);
+  ASSERT_EQUAL_POINTERS(second, first + ARENA_ALIGNMENT);
+  uint8_t *page = arena_alloc_aligned(&arena, 1, 512);
+  ASSERT_EQUAL((uintptr_t)page % 512, 0);
+  ASSERT_EQUAL_POINTERS(arena_alloc_aligned(&arena, 1, 3), NULL);
+
+  // The most recent allocation grows in place, others are copied.
+  char *string = arena_strdup(&arena, "arena");
+  ASSERT_EQUAL(strcmp(string, "arena"), 0);
+  ASSERT_EQUAL_POINTERS(arena_realloc(&arena, string, 6, 64), string);
+  second = arena_realloc(&arena, first, 3, 64);
+  ASSERT_NOT_EQUAL_POINTERS(second, first);
+
+  // Allocations larger than a chunk get a chunk of their own.
+  ARENA_CHUNK *chunk = arena.chunk;
+  {
+    LOCAL_ARENA_MARK ARENA_MARK mark = arena_mark(&arena);
+    uint8_t *large = arena_alloc(&arena, 4096);
+    ASSERT_NOT_NULL(large);
+    memset(large, 0xff, 4096);
+    ASSERT_NOT_EQUAL_POINTERS(arena.chunk, chunk);
+  }
+  // Leaving the scope of the mark gave everything back.
+  ASSERT_EQUAL_POINTERS(arena.chunk, chunk);
+  ARENA_MARK mark = arena_mark(&arena);
+  size_t used = arena.chunk->used;
+
+  VECTOR vec;
+  ASSERT_SUCCESS(vector_init_arena(&vec, sizeof(size_t), 4, &arena));
+  for (size_t i = 0; i < 1000; ++i) {
+    ASSERT_NOT_NULL(vector_push(&vec, &i, sizeof(i)));
+  }
+  for (size_t i = 0; i < 1000; ++i) {
+    ASSERT_EQUAL(*(size_t *)vector_get(&vec, i), i);
+  }
+  while (vec.used_bytes) {
+    ASSERT_SUCCESS(vector_pop(&vec));
+  }
+  ASSERT_SUCCESS(vector_shrink_to_fit(&vec));
+  vector_destroy(&vec);
+  arena_rewind(&mark);
+  ASSERT_EQUAL(arena.chunk->used, used);
+}
+
+#define POOL_TEST_OBJECTS 10000
+
+void *pool_test_thread(void *pool) {
+  void **objects = malloc(POOL_TEST_OBJECTS * sizeof(void *));
+  for (size_t round = 0; round < 10; ++round) {
+    for (size_t i = 0; i < POOL_TEST_OBJECTS; ++i) {
+      objects[i] = pool_alloc(pool);
+      memset(objects[i], (uint8_t)i, 24);
+    }
+    for (size_t i = 0; i < POOL_TEST_OBJECTS; ++i) {
+      if (*(uint8_t *)objects[i] != (uint8_t)i) {
+        free(objects);
+        return pool;
+      }
+      pool_free(pool, objects[i]);
+    }
+  }
+  free(objects);
+  return NULL;
+}
+
+void pool_test(void) {
+  POOL pool;
+  pthread_t threads[4];
+  void *result = NULL;
+  void **objects = malloc(POOL_TEST_OBJECTS * sizeof(void *));
+
+  ASSERT_EQUAL(pool_init(&pool, POOL_SLAB_SIZE), FAILURE);
+  ASSERT_SUCCESS(pool_init(&pool, 20));
+  ASSERT_EQUAL(pool.object_size, 24);
+  for (size_t i = 0; i < POOL_TEST_OBJECTS; ++i) {
+    objects[i] = pool_alloc(&pool);
+    ASSERT_NOT_NULL(objects[i]);
+    ASSERT_ZERO((uintptr_t)objects[i] % sizeof(void *));
+    memset(objects[i], 0xff, 20);
+  }
+  // Objects come back through the thread cache in LIFO order.
+  pool_free(&pool, objects[0]);
+  ASSERT_EQUAL_POINTERS(pool_alloc(&pool), objects[0]);
+  {
+    LOCAL_POOLED void *object = objects[0];
+    (void)object;
+  }
+  ASSERT_EQUAL_POINTERS(pool_alloc(&pool), objects[0]);
+  for (size_t i = 0; i < POOL_TEST_OBJECTS; ++i) {
+    pool_free(&pool, objects[i]);
+  }
+
+  // Objects freed by one thread are reused by the others through the depot.
+  for (size_t i = 0; i < ARRAYSIZE(threads); ++i) {
+    ASSERT_ZERO(pthread_create(&threads[i], NULL, pool_test_thread, &pool));
+  }
+  for (size_t i = 0; i < ARRAYSIZE(threads); ++i) {
+    ASSERT_ZERO(pthread_join(threads[i], &result));
+    ASSERT_NULL(result);
+  }
+  pool_destroy(&pool);
+  free(objects);
+}
+
+#define SIZE_T_HASH(key) hashmap_hash_u64(*(key))
+#define SIZE_T_EQUAL(a, b) (*(a) == *(b))
+HASHMAP_DEFINE(size_t_map, size_t, size_t, SIZE_T_HASH, SIZE_T_EQUAL)
+
+// Puts all keys into the last three slots of a map with 128 slots.
+uint64_t collide_hash(const void *key, size_t key_size) {
+  return (uint64_t)(125 + *(const uint32_t *)key % 3) << 7;
+}
+
+void hashmap_test(void) {
+  size_t test_size = 100000;
+  HASHMAP map;
+  size_t_map typed;
+
+  ASSERT_SUCCESS(hashmap_init(&map, 3, sizeof(uint64_t), NULL, NULL));
+  ASSERT_EQUAL(map.value_offset, 8);
+  ASSERT_EQUAL(map.slot_size, 16);
+  hashmap_destroy(&map);
+
+  ASSERT_SUCCESS(hashmap_init(&map, sizeof(uint32_t), sizeof(uint32_t), NULL,
+                              NULL));
+  for (uint32_t i = 0; i < test_size; ++i) {
+    uint32_t value = i * 2;
+    ASSERT_NOT_NULL(hashmap_put(&map, &i, &value));
+  }
+  ASSERT_EQUAL(map.size, test_size);
+  for (uint32_t i = 0; i < test_size; ++i) {
+    uint32_t *value = hashmap_get(&map, &i);
+    ASSERT_NOT_NULL(value);
+    ASSERT_EQUAL(*value, i * 2);
+  }
+  uint32_t missing = test_size;
+  ASSERT_NULL(hashmap_get(&map, &missing));
+  ASSERT_EQUAL(hashmap_del(&map, &missing), FAILURE);
+  // Delete every other key, the rest must stay reachable.
+  for (uint32_t i = 0; i < test_size; i += 2) {
+    ASSERT_SUCCESS(hashmap_del(&map, &i));
+  }
+  ASSERT_EQUAL(map.size, test_size / 2);
+  for (uint32_t i = 0; i < test_size; ++i) {
+    uint32_t *value = hashmap_get(&map, &i);
+    if (i % 2) {
+      ASSERT_NOT_NULL(value);
+      ASSERT_EQUAL(*value, i * 2);
+    } else {
+      ASSERT_NULL(value);
+    }
+  }
+  size_t index = 0;
+  size_t count = 0;
+  uint32_t *key;
+  while ((key = hashmap_next(&map, &index))) {
+    ASSERT_EQUAL(*(uint32_t *)hashmap_value(&map, key), *key * 2);
+    count++;
+  }
+  ASSERT_EQUAL(count, test_size / 2);
+  hashmap_destroy(&map);
+
+  // Colliding keys form long clusters which wrap around the end.
+  ASSERT_SUCCESS(hashmap_init(&map, sizeof(uint32_t), 0, collide_hash, NULL));
+  ASSERT_SUCCESS(hashmap_reserve(&map, 100));
+  ASSERT_EQUAL(map.capacity, 128);
+  for (uint32_t i = 0; i < 100; ++i) {
+    ASSERT_NOT_NULL(hashmap_put_new(&map, &i));
+  }
+  ASSERT_EQUAL(map.capacity, 128);
+  for (uint32_t i = 0; i < 100; i += 3) {
+    ASSERT_SUCCESS(hashmap_del(&map, &i));
+  }
+  for (uint32_t i = 0; i < 100; ++i) {
+    if (i % 3) {
+      ASSERT_NOT_NULL(hashmap_get(&map, &i));
+    } else {
+      ASSERT_NULL(hashmap_get(&map, &i));
+    }
+  }
+  hashmap_destroy(&map);
+
+  ASSERT_SUCCESS(size_t_map_init(&typed));
+  for (size_t i = 0; i < test_size; ++i) {
+    ASSERT_NOT_NULL(size_t_map_put(&typed, i, i + 1));
+  }
+  ASSERT_NOT_NULL(size_t_map_put(&typed, 0, 42));
+  ASSERT_EQUAL(size_t_map_size(&typed), test_size);
+  ASSERT_EQUAL(*size_t_map_get(&typed, 0), 42);
+  ASSERT_EQUAL(*size_t_map_get(&typed, test_size - 1), test_size);
+  ASSERT_SUCCESS(size_t_map_del(&typed, 0));
+  ASSERT_NULL(size_t_map_get(&typed, 0));
+  ASSERT_NOT_NULL(hashmap_get(&typed.map, &(size_t){1}));
+  size_t_map_destroy(&typed);
+}
+
+void bitset_test_ops(void) {
+  size_t test_size = 100003;
+  BITSET bs;
+  BITSET other;
+
+  ASSERT_SUCCESS(bitset_init(&bs, test_size));
+  ASSERT_SUCCESS(bitset_init(&other, test_size));
+  ASSERT_ZERO(bitset_count(&bs));
+  ASSERT_EQUAL(bitset_next_set(&bs, 0), test_size);
+  for (size_t i = 0; i < test_size; i += 3) {
+    ASSERT_SUCCESS(bitset_set(&bs, i));
+  }
+  for (size_t i = 0; i < test_size; i += 2) {
+    ASSERT_SUCCESS(bitset_set(&other, i));
+  }
+  ASSERT_EQUAL(bitset_set(&bs, test_size), FAILURE);
+  ASSERT_TRUE(!bitset_test(&bs, test_size));
+  ASSERT_TRUE(bitset_test(&bs, 3));
+  ASSERT_TRUE(!bitset_test(&bs, 4));
+  ASSERT_EQUAL(bitset_count(&bs), (test_size + 2) / 3);
+  ASSERT_EQUAL(bitset_next_set(&bs, 1), 3);
+  ASSERT_EQUAL(bitset_next_set(&bs, 64 * 3 + 1), 64 * 3 + 3);
+
+  // Rank and select agree with and without the index.
+  for (int pass = 0; pass < 2; ++pass) {
+    ASSERT_EQUAL(bitset_rank(&bs, 0), 0);
+    ASSERT_EQUAL(bitset_rank(&bs, 1), 1);
+    ASSERT_EQUAL(bitset_rank(&bs, 3000), 1000);
+    ASSERT_EQUAL(bitset_rank(&bs, test_size), bitset_count(&bs));
+    ASSERT_EQUAL(bitset_select(&bs, 0), 0);
+    ASSERT_EQUAL(bitset_select(&bs, 1000), 3000);
+    ASSERT_EQUAL(bitset_select(&bs, bitset_count(&bs)), test_size);
+    ASSERT_SUCCESS(bitset_build_index(&bs));
+  }
+  for (size_t i = 0; i < test_size; i += 997) {
+    ASSERT_EQUAL(bitset_rank(&bs, bitset_select(&bs, i / 3)), i / 3);
+  }
+
+  ASSERT_SUCCESS(bitset_and(&other, &bs));
+  ASSERT_EQUAL(bitset_count(&other), (test_size + 5) / 6);
+  ASSERT_SUCCESS(bitset_xor(&other, &bs));
+  ASSERT_TRUE(bitset_test(&other, 3));
+  ASSERT_TRUE(!bitset_test(&other, 6));
+  ASSERT_SUCCESS(bitset_or(&other, &bs));
+  ASSERT_EQUAL(bitset_count(&other), bitset_count(&bs));
+  ASSERT_SUCCESS(bitset_andnot(&other, &bs));
+  ASSERT_ZERO(bitset_count(&other));
+
+  ASSERT_SUCCESS(bitset_set_range(&other, 5, 200));
+  ASSERT_EQUAL(bitset_count(&other), 200);
+  ASSERT_EQUAL(bitset_next_set(&other, 0), 5);
+  ASSERT_SUCCESS(bitset_clear_range(&other, 6, 198));
+  ASSERT_EQUAL(bitset_count(&other), 2);
+  ASSERT_EQUAL(bitset_next_set(&other, 6), 204);
+  ASSERT_EQUAL(bitset_set_range(&other, test_size - 1, 2), FAILURE);
+
+  // Shrinking clears the bits behind the end, growing adds cleared bits.
+  ASSERT_SUCCESS(bitset_set_range(&bs, 0, test_size));
+  ASSERT_SUCCESS(bitset_resize(&bs, 70));
+  ASSERT_SUCCESS(bitset_resize(&bs, 200));
+  ASSERT_EQUAL(bitset_count(&bs), 70);
+  ASSERT_SUCCESS(bitset_push(&bs, true));
+  ASSERT_EQUAL(bs.size, 201);
+  ASSERT_TRUE(bitset_test(&bs, 200));
+  ASSERT_EQUAL(bitset_and(&bs, &other), FAILURE);
+  bitset_destroy(&bs);
+  bitset_destroy(&other);
+}
+
+typedef struct TIMER_ {
+  size_t deadline;
+  size_t id;
+} TIMER;
+
+#define TIMER_LESS(a, b, ctx) ((a)->deadline < (b)->deadline)
+PQUEUE_DEFINE(timer_heap, TIMER, 4, TIMER_LESS)
+
+int compare_timer(const void *a, const void *b) {
+  return compare_size_t(&((TIMER *)a)->deadline, &((TIMER *)b)->deadline);
+}
+
+// Remembers the heap index of every timer by its id.
+void timer_moved(const void *item, size_t index, void *ctx) {
+  ((size_t *)ctx)[((TIMER *)item)->id] = index;
+}
+
+void pqueue_test(void) {
+  size_t test_size = 10000;
+  size_t *positions = calloc(test_size, sizeof(size_t));
+  TIMER timer;
+  VECTOR vec;
+  PQUEUE pq;
+
+  ASSERT_EQUAL(pqueue_init(&pq, sizeof(TIMER), 1, compare_timer), FAILURE);
+  for (size_t arity = 2; arity <= 8; arity *= 2) {
+    ASSERT_SUCCESS(pqueue_init(&pq, sizeof(TIMER), arity, compare_timer));
+    ASSERT_NULL(pqueue_peek(&pq));
+    ASSERT_EQUAL(pqueue_pop(&pq, &timer), FAILURE);
+    pqueue_track(&pq, timer_moved, positions);
+    for (size_t i = 0; i < test_size; ++i) {
+      timer.deadline = (i * 7919) % test_size;
+      timer.id = i;
+      ASSERT_SUCCESS(pqueue_push(&pq, &timer, sizeof(timer)));
+    }
+    ASSERT_EQUAL(((TIMER *)pqueue_peek(&pq))->deadline, 0);
+    // Move timer 5 to the front, push timer 0 to the back and cancel 1.
+    ((TIMER *)pqueue_get(&pq, positions[5]))->deadline = 0;
+    ASSERT_SUCCESS(pqueue_update(&pq, positions[5]));
+    ((TIMER *)pqueue_get(&pq, positions[0]))->deadline = test_size;
+    ASSERT_SUCCESS(pqueue_update(&pq, positions[0]));
+    ASSERT_SUCCESS(pqueue_remove(&pq, positions[1], &timer));
+    ASSERT_EQUAL(timer.id, 1);
+    for (size_t i = 0; i < pqueue_size(&pq); ++i) {
+      ASSERT_EQUAL(positions[((TIMER *)pqueue_get(&pq, i))->id], i);
+    }
+    size_t last = 0;
+    size_t popped = 0;
+    while (pqueue_pop(&pq, &timer) == SUCCESS) {
+      ASSERT_TRUE(timer.deadline >= last);
+      last = timer.deadline;
+      popped++;
+    }
+    ASSERT_EQUAL(popped, test_size - 1);
+    ASSERT_EQUAL(timer.id, 0);
+    pqueue_destroy(&pq);
+  }
+
+  ASSERT_SUCCESS(vector_init(&vec, sizeof(TIMER), VECTOR_DEFAULT_SIZE));
+  for (size_t i = 0; i < test_size; ++i) {
+    timer.deadline = (i * 7919) % test_size;
+    ASSERT_NOT_NULL(vector_push(&vec, &timer, sizeof(timer)));
+  }
+  // A failed heapify leaves the vector to the caller.
+  ASSERT_EQUAL(pqueue_heapify(&pq, &vec, 1, compare_timer), FAILURE);
+  ASSERT_EQUAL(vec.used_bytes / vec.item_size, test_size);
+  ASSERT_SUCCESS(pqueue_heapify(&pq, &vec, 8, compare_timer));
+  for (size_t i = 0; i < test_size; ++i) {
+    ASSERT_SUCCESS(pqueue_pop(&pq, &timer));
+    ASSERT_EQUAL(timer.deadline, i);
+  }
+  pqueue_destroy(&pq);
+
+  ASSERT_SUCCESS(vector_init(&vec, sizeof(TIMER), VECTOR_DEFAULT_SIZE));
+  for (size_t i = 0; i < test_size / 2; ++i) {
+    timer.deadline = (i * 7919) % test_size;
+    ASSERT_NOT_NULL(vector_push(&vec, &timer, sizeof(timer)));
+  }
+  timer_heap_heapify(&vec, NULL);
+  for (size_t i = test_size / 2; i < test_size; ++i) {
+    timer.deadline = (i * 7919) % test_size;
+    ASSERT_SUCCESS(timer_heap_push(&vec, timer, NULL));
+  }
+  for (size_t i = 0; i < test_size; ++i) {
+    ASSERT_SUCCESS(timer_heap_pop(&vec, &timer, NULL));
+    ASSERT_EQUAL(timer.deadline, i);
+  }
+  ASSERT_EQUAL(timer_heap_pop(&vec, &timer, NULL), FAILURE);
+  // There is nothing to sift in an empty heap.
+  timer_heap_heapify(&vec, NULL);
+  ASSERT_EQUAL(vec.used_bytes, 0);
+  vector_destroy(&vec);
+  free(positions);
+}
+
+// Read everything written to a temporary file back into a string.
+char *buffer_test_read_back(FILE *fp, size_t *size) {
+  *size = ftell(fp);
+  char *contents = calloc(1, *size + 1);
+  rewind(fp);
+  if (fread(contents, 1, *size, fp) != *size) {
+    free(contents);
+    return NULL;
+  }
+  return contents;
+}
+
+void buffer_test(void) {
+  BUFFER buf;
+  ASSERT_SUCCESS(buf_init(&buf, 0));
+  ASSERT_EQUAL(buf.capacity, BUFFER_MIN_SIZE);
+  ASSERT_SUCCESS(buf_append_str(&buf, "hello"));
+  ASSERT_SUCCESS(buf_printf(&buf, ", %s %d", "world", 42));
+  ASSERT_EQUAL(strcmp(buf_cstr(&buf), "hello, world 42"), 0);
+
+  // Output larger than the spare capacity is formatted again after growing.
+  char large[1000];
+  memset(large, 'x', sizeof(large) - 1);
+  large[sizeof(large) - 1] = 0;
+  ASSERT_SUCCESS(buf_printf(&buf, "[%s]", large));
+  ASSERT_EQUAL(buf_size(&buf), 15 + sizeof(large) + 1);
+  ASSERT_EQUAL(buf_cstr(&buf)[15], '[');
+  ASSERT_EQUAL(buf_cstr(&buf)[15 + sizeof(large)], ']');
+  ASSERT_TRUE(buf.capacity > buf.write);
+
+  // Consumed bytes at the front are reused instead of growing.
+  buf_clear(&buf);
+  size_t capacity = buf.capacity;
+  for (size_t i = 0; i < 100000; ++i) {
+    uint8_t *room = buf_reserve(&buf, 16);
+    ASSERT_NOT_NULL(room);
+    memcpy(room, &i, sizeof(i));
+    buf_commit(&buf, sizeof(i));
+    size_t value;
+    memcpy(&value, buf_data(&buf), sizeof(value));
+    ASSERT_EQUAL(value, i / 2 * 2);
+    if (i % 2) {
+      buf_consume(&buf, 2 * sizeof(i));
+    }
+  }
+  ASSERT_EQUAL(buf.capacity, capacity);
+  ASSERT_EQUAL(buf_size(&buf), 0);
+
+  FILE *fp = tmpfile();
+  ASSERT_NOT_NULL(fp);
+  ASSERT_SUCCESS(buf_printf(&buf, "%s", large));
+  ASSERT_SUCCESS(buf_write(&buf, fileno(fp)));
+  ASSERT_EQUAL(buf_size(&buf), 0);
+  size_t size;
+  char *contents = buffer_test_read_back(fp, &size);
+  ASSERT_NOT_NULL(contents);
+  ASSERT_EQUAL(strcmp(contents, large), 0);
+  free(contents);
+  fclose(fp);
+  buf_destroy(&buf);
+
+  // A chain with tiny chunks, so pieces spread over many of them.
+  BUFFER_CHAIN chain;
+  ASSERT_SUCCESS(buf_chain_init(&chain, 16));
+  ASSERT_SUCCESS(buf_init(&buf, 0));
+  for (size_t i = 0; i < 10000; ++i) {
+    ASSERT_SUCCESS(buf_chain_printf(&chain, "%zu,", i));
+    ASSERT_SUCCESS(buf_printf(&buf, "%zu,", i));
+    if (i % 100 == 0) {
+      ASSERT_SUCCESS(buf_chain_append_ref(&chain, large, 10));
+      ASSERT_SUCCESS(buf_append(&buf, large, 10));
+    }
+  }
+  ASSERT_SUCCESS(buf_chain_append(&chain, large, sizeof(large) - 1));
+  ASSERT_SUCCESS(buf_append_str(&buf, large));
+  ASSERT_EQUAL(chain.size, buf_size(&buf));
+  // More pieces than a single writev() takes.
+  ASSERT_TRUE(chain.iov.used_bytes / sizeof(struct iovec) > IOV_MAX);
+
+  fp = tmpfile();
+  ASSERT_NOT_NULL(fp);
+  ASSERT_SUCCESS(buf_chain_write(&chain, fileno(fp)));
+  ASSERT_EQUAL(chain.size, 0);
+  ASSERT_EQUAL(chain.iov.used_bytes, 0);
+  contents = buffer_test_read_back(fp, &size);
+  ASSERT_NOT_NULL(contents);
+  ASSERT_EQUAL(size, buf_size(&buf));
+  ASSERT_EQUAL(memcmp(contents, buf_data(&buf), size), 0);
+  free(contents);
+  fclose(fp);
+  buf_chain_destroy(&chain);
+  buf_destroy(&buf);
+}
+
+#define LOG_TEST_THREADS 4
+#define LOG_TEST_MESSAGES 10000
+
+void *log_test_thread(void *arg) {
+  size_t thread = (size_t)arg;
+  for (size_t i = 0; i < LOG_TEST_MESSAGES; ++i) {
+    log_print(LL_LOG, "thread %zu message %zu", thread, i);
+  }
+  return NULL;
+}
+
+// Count the lines written by log_test_thread() in a log file and check
+// that the messages of every thread are in order.
+size_t log_test_count(FILE *fp, size_t *next) {
+  char line[LOG_RECORD_SIZE];
+  size_t count = 0;
+  rewind(fp);
+  memset(next, 0, LOG_TEST_THREADS * sizeof(size_t));
+  while (fgets(line, sizeof(line), fp)) {
+    size_t thread, message;
+    if (sscanf(line, "[+] thread %zu message %zu", &thread, &message) != 2) {
+      continue;
+    }
+    if (thread >= LOG_TEST_THREADS || message < next[thread]) {
+      return 0;
+    }
+    next[thread] = message + 1;
+    count++;
+  }
+  return count;
+}
+
+void log_test_async(void) {
+  FILE *fp = tmpfile();
+  ASSERT_NOT_NULL(fp);
+  pthread_t threads[LOG_TEST_THREADS];
+  size_t next[LOG_TEST_THREADS];
+  char line[LOG_RECORD_SIZE * 2];
+
+  ASSERT_SUCCESS(log_async_start(fileno(fp), 64, LOG_BLOCK));
+  ASSERT_EQUAL(log_async_start(fileno(fp), 64, LOG_BLOCK), FAILURE);
+  for (size_t i = 0; i < LOG_TEST_THREADS; ++i) {
+    ASSERT_EQUAL(pthread_create(&threads[i], NULL, log_test_thread,
+                                (void *)i), 0);
+  }
+  for (size_t i = 0; i < LOG_TEST_THREADS; ++i) {
+    pthread_join(threads[i], NULL);
+  }
+  log_flush();
+  // Blocking on full rings never loses a message.
+  ASSERT_EQUAL(log_test_count(fp, next), LOG_TEST_THREADS * LOG_TEST_MESSAGES);
+  ASSERT_EQUAL(log_dropped(), 0);
+
+  // Errors are written before log_print() returns, long messages are cut
+  // off at the end of a record.
+  fseek(fp, 0, SEEK_END);
+  long end = ftell(fp);
+  memset(line, 'x', sizeof(line) - 1);
+  line[sizeof(line) - 1] = 0;
+  log_print(LL_ERR, "%s", line);
+  ASSERT_EQUAL(ftell(fp), end);
+  fseek(fp, 0, SEEK_END);
+  ASSERT_EQUAL(ftell(fp) - end, LOG_RECORD_SIZE - sizeof(uint32_t));
+  fseek(fp, end, SEEK_SET);
+  ASSERT_NOT_NULL(fgets(line, sizeof(line), fp));
+  ASSERT_EQUAL(strncmp(line, "[-] xxx", 7), 0);
+  ASSERT_EQUAL(line[strlen(line) - 1], '\n');
+  log_async_stop();
+  ASSERT_TRUE(ftruncate(fileno(fp), 0) == 0);
+  rewind(fp);
+
+  // With tiny rings some messages are dropped, but every message is either
+  // written or counted.
+  ASSERT_SUCCESS(log_async_start(fileno(fp), 2, LOG_DROP));
+  for (size_t i = 0; i < LOG_TEST_THREADS; ++i) {
+    ASSERT_EQUAL(pthread_create(&threads[i], NULL, log_test_thread,
+                                (void *)i), 0);
+  }
+  for (size_t i = 0; i < LOG_TEST_THREADS; ++i) {
+    pthread_join(threads[i], NULL);
+  }
+  log_async_stop();
+  ASSERT_EQUAL(log_test_count(fp, next) + log_dropped(),
+               LOG_TEST_THREADS * LOG_TEST_MESSAGES);
+  fclose(fp);
+}
+
+LOG_MODULE_DEFINE(log_test_module, LL_LOG)
+
+// Counts how often the arguments of a log call were evaluated.
+size_t log_test_evaluated = 0;
+
+size_t log_test_argument(void) {
+  return ++log_test_evaluated;
+}
+
+void log_test_levels(void) {
+  static const char * const expected[] = {
+    "[+] log 1\n",
+    "[+] verbose 2\n",
+    "[+] module log 3\n",
+    "[+] module verbose 4\n"
+  };
+  char line[LOG_RECORD_SIZE];
+  FILE *fp = tmpfile();
+  ASSERT_NOT_NULL(fp);
+  ASSERT_SUCCESS(log_async_start(fileno(fp), 0, LOG_BLOCK));
+
+  // Disabled messages don't evaluate their arguments.
+  log_level = LL_LOG;
+  LOG_VER("verbose %zu", log_test_argument());
+  LOG_LOG("log %zu", log_test_argument());
+  ASSERT_EQUAL(log_test_evaluated, 1);
+  log_level = LL_DBG;
+  LOG_VER("verbose %zu", log_test_argument());
+  // This file is built with CUTIL_LOG_MIN_LEVEL at LL_VER.
+  LOG_DBG("debug %zu", log_test_argument());
+  ASSERT_EQUAL(log_test_evaluated, 2);
+
+  // Modules ignore log_level and have a level of their own.
+  LOG_MODULE_VER(log_test_module, "module verbose %zu", log_test_argument());
+  LOG_MODULE_LOG(log_test_module, "module log %zu", log_test_argument());
+  ASSERT_EQUAL(log_test_evaluated, 3);
+  log_level = LL_ERR;
+  ASSERT_SUCCESS(log_module_set_level("log_test_module", LL_DBG));
+  ASSERT_EQUAL(log_module_set_level("no_such_module", LL_DBG), FAILURE);
+  LOG_MODULE_VER(log_test_module, "module verbose %zu", log_test_argument());
+  LOG_MODULE_DBG(log_test_module, "module debug %zu", log_test_argument());
+  LOG_VER("verbose %zu", log_test_argument());
+  ASSERT_EQUAL(log_test_evaluated, 4);
+  log_async_stop();
+  log_level = LL_LOG;
+
+  rewind(fp);
+  for (size_t i = 0; i < ARRAYSIZE(expected); ++i) {
+    ASSERT_NOT_NULL(fgets(line, sizeof(line), fp));
+    ASSERT_EQUAL(strcmp(line, expected[i]), 0);
+  }
+  ASSERT_NULL(fgets(line, sizeof(line), fp));
+  fclose(fp);
+}
+
+#define BINLOG_TEST_MESSAGES 1000
+
+void *binlog_test_thread(void *arg) {
+  (void)arg;
+  for (size_t i = 0; i < BINLOG_TEST_MESSAGES; ++i) {
+    BINLOG(LL_LOG, "thread message %zu", i);
+  }
+  return NULL;
+}
+
+void binlog_test(void) {
+  char path[] = "/tmp/cutil_binlog_XXXXXX";
+  LOCAL_FD int fd = mkstemp(path);
+  ASSERT_GREATER(fd, STDERR_FILENO);
+  int unused;
+  pthread_t thread;
+  BUFFER expected;
+  ASSERT_SUCCESS(buf_init(&expected, 0));
+
+  ASSERT_SUCCESS(binlog_open(path));
+  ASSERT_EQUAL(binlog_open(path), FAILURE);
+  // The buffer of a thread is written when it exits.
+  ASSERT_EQUAL(pthread_create(&thread, NULL, binlog_test_thread, NULL), 0);
+  pthread_join(thread, NULL);
+  for (size_t i = 0; i < BINLOG_TEST_MESSAGES; ++i) {
+    ASSERT_SUCCESS(buf_printf(&expected, "[+] thread message %zu\n", i));
+  }
+  BINLOG(LL_LOG, "ints %d %u %x %ld %zu %c", -1, 2u, 255, -3L, (size_t)4,
+         'z');
+  BINLOG(LL_ERR, "floats %.2f %e %Lg", 1.5, 2.5e10, (long double)3.25);
+  BINLOG(LL_MSG, "strings %s|%-6s|%.3s|%.*s|%*d|%%", "abc", "de",
+         "truncated", 2, "xyz", 5, 42);
+  BINLOG(LL_LOG, "pointer %p", (void *)0x1234);
+  BINLOG(LL_LOG, "unsupported %n", &unused);
+  BINLOG(LL_VER, "filtered by log_level %d", 1);
+  for (size_t i = 0; i < 3; ++i) {
+    BINLOG(LL_NNL, "%zu,", i);
+  }
+  BINLOG(LL_MSG, "end");
+  binlog_close();
+  ASSERT_SUCCESS(buf_append_str(&expected,
+      "[+] ints -1 2 ff -3 4 z\n"
+      "[-] floats 1.50 2.500000e+10 3.25\n"
+      "strings abc|de    |tru|xy|   42|%\n"
+      "[+] pointer 0x1234\n"
+      "[+] 0,[+] 1,[+] 2,end\n"));
+
+  LOCAL_FP FILE *in = fopen(path, "rb");
+  ASSERT_NOT_NULL(in);
+  FILE *out = tmpfile();
+  ASSERT_NOT_NULL(out);
+  ASSERT_SUCCESS(binlog_decode(in, out, false));
+  size_t size;
+  char *decoded = buffer_test_read_back(out, &size);
+  ASSERT_NOT_NULL(decoded);
+  ASSERT_EQUAL_STRINGS(decoded, buf_cstr(&expected));
+  free(decoded);
+
+  // A record cut off at the end is an error, but everything in front of
+  // it is decoded.
+  struct stat info;
+  ASSERT_ZERO(fstat(fd, &info));
+  ASSERT_ZERO(ftruncate(fd, info.st_size - 1));
+  rewind(in);
+  rewind(out);
+  ASSERT_ZERO(ftruncate(fileno(out), 0));
+  ASSERT_EQUAL(binlog_decode(in, out, false), FAILURE);
+  decoded = buffer_test_read_back(out, &size);
+  ASSERT_NOT_NULL(decoded);
+  ASSERT_EQUAL(size, buf_size(&expected) - strlen("end\n"));
+  free(decoded);
+  fclose(out);
+  buf_destroy(&expected);
+  unlink(path);
+}
+
+void ratelimit_test(void) {
+  RATELIMIT limit = { 0 };
+  size_t allowed = 0;
+  for (size_t i = 0; i < 1000; ++i) {
+    allowed += ratelimit_allow(&limit, 10);
+  }
+  // A burst of up to one second worth of calls gets through.
+  ASSERT_EQUAL(allowed, 10);
+  ASSERT_EQUAL(ratelimit_summary(&limit), 990);
+  ASSERT_EQUAL(ratelimit_summary(&limit), 0);
+  // The bucket refills with 10 tokens per second.
+  usleep(250000);
+  allowed = 0;
+  for (size_t i = 0; i < 1000; ++i) {
+    allowed += ratelimit_allow(&limit, 10);
+  }
+  ASSERT_TRUE(allowed >= 1 && allowed <= 3);
+  // The next summary is only due a second after the last one.
+  ASSERT_EQUAL(ratelimit_summary(&limit), 0);
+
+  RATELIMIT sample = { 0 };
+  allowed = 0;
+  for (size_t i = 0; i < 100; ++i) {
+    allowed += ratelimit_sample(&sample, 4);
+  }
+  ASSERT_EQUAL(allowed, 25);
+  ASSERT_EQUAL(ratelimit_summary(&sample), 75);
+  // Sampling every 0th call doesn't divide by zero.
+  ASSERT_TRUE(ratelimit_sample(&sample, 0));
+  ASSERT_TRUE(ratelimit_sample(&sample, 1));
+
+  FILE *fp = tmpfile();
+  ASSERT_NOT_NULL(fp);
+  ASSERT_SUCCESS(log_async_start(fileno(fp), 0, LOG_BLOCK));
+  for (size_t i = 0; i < 100; ++i) {
+    LOG_RATELIMITED(LL_LOG, 5, "flood %zu", i);
+    LOG_SAMPLED(LL_LOG, 10, "sampled %zu", i);
+  }
+  log_async_stop();
+  char line[LOG_RECORD_SIZE];
+  size_t flood = 0;
+  size_t sampled = 0;
+  size_t summaries = 0;
+  rewind(fp);
+  while (fgets(line, sizeof(line), fp)) {
+    flood += strncmp(line, "[+] flood", 9) == 0;
+    sampled += strncmp(line, "[+] sampled", 11) == 0;
+    summaries += strncmp(line, "[+] suppressed 9 messages from", 30) == 0;
+  }
+  ASSERT_EQUAL(flood, 5);
+  ASSERT_EQUAL(sampled, 10);
+  // Only the second sampled message comes with a summary, the next one is
+  // due in a second.
+  ASSERT_EQUAL(summaries, 1);
+  fclose(fp);
+}
+
+// Sleeps while paused, which must not count, and runs an empty loop.
+void bench_test_paused(size_t iterations) {
+  bench_pause();
+  usleep(1000);
+  bench_resume();
+  for (size_t i = 0; i < iterations; ++i) {
+    BENCH_DO_NOT_OPTIMIZE(i);
+  }
+}
+
+void bench_test(void) {
+  double samples[] = {5, 1, 4, 2, 3};
+  BENCH_RESULT result = { 0 };
+  bench_statistics(samples, ARRAYSIZE(samples), &result);
+  ASSERT_TRUE(result.median == 3);
+  ASSERT_TRUE(result.p99 == 5);
+  ASSERT_TRUE(result.mean == 3);
+  ASSERT_TRUE(fabs(result.stddev - sqrt(2.5)) < 1e-9);
+  ASSERT_TRUE(fabs(result.ops_per_second - 1e9 / 3) < 1);
+
+  // Names are escaped in the JSON file and found again.
+  const char *names[] = { "plain", "a \"quoted\"\tname" };
+  BENCH_RESULT results[2] = {{ .median = 1.5 }, { .median = 2.5 }};
+  double median = 0;
+  FILE *fp = tmpfile();
+  ASSERT_NOT_NULL(fp);
+  ASSERT_SUCCESS(bench_write_json(fp, names, results, 2));
+  ASSERT_SUCCESS(bench_read_median(fp, names[1], &median));
+  ASSERT_TRUE(median == 2.5);
+  ASSERT_SUCCESS(bench_read_median(fp, names[0], &median));
+  ASSERT_TRUE(median == 1.5);
+  ASSERT_TRUE(bench_read_median(fp, "a \"quoted\"", &median) == FAILURE);
+  fclose(fp);
+
+  // Without the pause every sample would take at least a millisecond. The
+  // reports go to /dev/null, so the regression below doesn't look like a
+  // failure in the test output.
+  char path[] = "/tmp/cutil_bench_XXXXXX";
+  int path_fd = mkstemp(path);
+  ASSERT_NOT_EQUAL(path_fd, invalid_fileno);
+  close(path_fd);
+  FILE *devnull = fopen("/dev/null", "w");
+  ASSERT_NOT_NULL(devnull);
+  BENCH_OPTIONS options = {
+    .json_path = path,
+    .threshold = BENCH_DEFAULT_THRESHOLD,
+    .output = devnull
+  };
+  ASSERT_SUCCESS(bench_add(bench_test_paused, "paused"));
+  ASSERT_SUCCESS(benches_run(&options));
+  fp = fopen(path, "r");
+  ASSERT_NOT_NULL(fp);
+  ASSERT_SUCCESS(bench_read_median(fp, "paused", &median));
+  ASSERT_TRUE(median < 1000);
+  fclose(fp);
+
+  // A baseline which was a lot faster flags a regression.
+  const char *baseline_names[] = { "paused" };
+  BENCH_RESULT baseline = { .median = 0.01 };
+  fp = fopen(path, "w");
+  ASSERT_NOT_NULL(fp);
+  ASSERT_SUCCESS(bench_write_json(fp, baseline_names, &baseline, 1));
+  fclose(fp);
+  options.json_path = NULL;
+  options.baseline_path = path;
+  ASSERT_TRUE(benches_run(&options) == FAILURE);
+  fclose(devnull);
+  unlink(path);
+}
+
+// Runs tests through tests_run_parallel() in a forked process with a queue
+// of its own, and collects what the runner printed.
+//
+// Args:
+//  output: receives the report of the runner
+//  functions: the tests to run
+//  names: the names of the tests
+//  count: the number of tests, which all run at the same time
+//  timeout: seconds after which a test is killed
+//  status: receives the wait status of the process, which exits with the
+//          result of tests_run_parallel()
+ERROR tests_parallel_run(BUFFER *output, const TEST *functions,
+                         const char * const *names, size_t count,
+                         unsigned int timeout, int *status) {
+  int fds[2];
+  // Don't pass the header of the running test on to the child.
+  fflush(stdout);
+  if (pipe(fds) != 0) {
+    return FAILURE;
+  }
+  pid_t pid = fork();
+  if (pid < 0) {
+    close(fds[0]);
+    close(fds[1]);
+    return FAILURE;
+  }
+  if (pid == 0) {
+    close(fds[0]);
+    dup2(fds[1], STDOUT_FILENO);
+    close(fds[1]);
+    // Reopen stdout without a buffer, like in a program which didn't print
+    // anything before running its tests.
+    if (!freopen(NULL, "w", stdout)) {
+      _exit(FAILURE);
+    }
+    tests_reset();
+    for (size_t i = 0; i < count; ++i) {
+      test_add(functions[i], names[i]);
+    }
+    ERROR result = tests_run_parallel(count, timeout);
+    fflush(stdout);
+    _exit(result);
+  }
+  close(fds[1]);
+  uint8_t *room;
+  ssize_t size;
+  while ((room = buf_reserve(output, 4096)) &&
+         (size = read(fds[0], room, 4096)) > 0) {
+    buf_commit(output, size);
+  }
+  close(fds[0]);
+  return waitpid(pid, status, 0) == pid ? SUCCESS : FAILURE;
+}
+
+void tests_parallel_test_print(void) {
+  printf("printed ");
+}
+
+void tests_parallel_test_fail(void) {
+  ASSERT_TRUE(1 == 2);
+}
+
+void tests_parallel_test_crash(void) {
+  raise(SIGSEGV);
+}
+
+void tests_parallel_test_hang(void) {
+  while (true) {
+    sleep(1);
+  }
+}
+
+void tests_parallel_test(void) {
+  // Printing must not count as a leak, even when the runner didn't print
+  // anything before the first test.
+  TEST functions[] = {
+    tests_parallel_test_print,
+    tests_parallel_test_fail,
+    tests_parallel_test_crash,
+    tests_parallel_test_hang,
+    tests_parallel_test_print
+  };
+  const char *names[] = { "print", "fail", "crash", "hang", "print again" };
+  // Every test is reported in the order it was added, no matter when it
+  // finished, followed by the summary.
+  const char *expected[] = {
+    "[TEST 0] print ", "printed [OK]",
+    "[TEST 1] fail ", "[--]", "1 == 2 not true",
+    "[TEST 2] crash ", "[--]", "killed by signal",
+    "[TEST 3] hang ", "[--]", "timed out after 1 seconds",
+    "[TEST 4] print again ", "printed [OK]",
+    "3 TESTS FAILED"
+  };
+  BUFFER output;
+  int status = 0;
+  ASSERT_SUCCESS(buf_init(&output, 0));
+  ASSERT_SUCCESS(tests_parallel_run(&output, functions, names,
+                                    ARRAYSIZE(functions), 1, &status));
+  ASSERT_TRUE(WIFEXITED(status));
+  ASSERT_EQUAL(WEXITSTATUS(status), FAILURE);
+  const char *report = buf_cstr(&output);
+  for (size_t i = 0; i < ARRAYSIZE(expected); ++i) {
+    report = strstr(report, expected[i]);
+    ASSERT_NOT_NULL(report);
+  }
+  buf_destroy(&output);
 }
 
 int main(int argc, char **argv) {
-  (void)argc;
-  (void)argv;
+  bool parallel = false;
+  size_t workers = 0;
+  unsigned int timeout = 0;
+
+  // -j runs the tests in that many processes, 0 for one per CPU.
+  for (int i = 1; i < argc; ++i) {
+    if (strcmp(argv[i], "-j") == 0 && i + 1 < argc) {
+      parallel = true;
+      workers = strtoul(argv[++i], NULL, 10);
+    } else if (strcmp(argv[i], "-t") == 0 && i + 1 < argc) {
+      timeout = strtoul(argv[++i], NULL, 10);
+    } else {
+      fprintf(stderr, "Usage: %s [-j workers] [-t timeout]\n", argv[0]);
+      return 1;
+    }
+  }
 
   init_tests();
 
   test_add(raii_test, "RAII resource management");
   test_add(vector_test_charp, "basic vector insertion/removal");
   test_add(vector_test_lots_ints, "vector storing/removing many integers");
+  test_add(vector_test_typed, "typed vector push/at/pop");
+  test_add(vector_test_bulk, "vector bulk reserve/append/insert");
+  test_add(vector_test_policy, "vector growth and shrink policies");
+  test_add(vector_test_remove, "vector del/swap_remove/remove_if");
+  test_add(vector_test_small, "small vector with inline storage");
+  test_add(vector_test_mmap, "vector with mmap backing");
+  test_add(vector_test_view, "vector saved to and viewed from a file");
+  test_add(vector_test_find, "vector find/count/find_all");
+  test_add(vector_test_sort, "vector sort/radix sort/binary search");
+  test_add(vector_test_hot_path, "vector operations without allocations");
+  test_add(arena_test, "arena allocation, marks and arena vectors");
+  test_add(binlog_test, "binary log records and decoding");
+  test_add(bitset_test_ops, "bitset bulk operations, rank and select");
+  test_add(buffer_test, "byte buffers, printf and chained writev");
+  test_add(hashmap_test, "hash map put/get/del and typed maps");
+  test_add(log_test_async, "async logging with per thread rings");
+  test_add(log_test_levels, "log level macros and modules");
+  test_add(pool_test, "object pool with per thread caches");
+  test_add(pqueue_test, "d-ary heap priority queues");
+  test_add(ratelimit_test, "log rate limiting and sampling");
+  test_add(bench_test, "benchmark statistics, pausing and baselines");
+  test_add(tests_parallel_test, "tests in forked processes");
+  test_add(segvector_test, "segmented vector push/get/pop");
+  test_add(cvector_test, "concurrent vector push from many threads");
+  test_add(spsc_ring_test, "single producer single consumer ring");
+  test_add(mpmc_ring_test, "multi producer multi consumer ring");
 
-  ERROR status = tests_run();
+  ERROR status = parallel ? tests_run_parallel(workers, timeout) :
+                            tests_run();
   cleanup_tests();
 
   return status;
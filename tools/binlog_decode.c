@@ -0,0 +1,56 @@
+// Renders binary logs written with BINLOG() as text.
+//
+// USAGE: binlog_decode [-t] <file>
+//
+//  -t: prefix every message with the time it was logged at
+//
+// Author: Johannes Stüttgen (johannes.stuettgen@gmail.com)
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <stdio.h>
+#include <string.h>
+
+#include "binlog.h"
+#include "raii.h"
+
+int main(int argc, char **argv) {
+  bool timestamps = false;
+  const char *path = NULL;
+
+  for (int i = 1; i < argc; ++i) {
+    if (strcmp(argv[i], "-t") == 0) {
+      timestamps = true;
+    } else if (!path) {
+      path = argv[i];
+    } else {
+      path = NULL;
+      break;
+    }
+  }
+  if (!path) {
+    fprintf(stderr, "Usage: %s [-t] <file>\n", argv[0]);
+    return 1;
+  }
+
+  LOCAL_FP FILE *in = fopen(path, "rb");
+  if (!in) {
+    log_print(LL_ERR, "Can't open %s", path);
+    return 1;
+  }
+  if (binlog_decode(in, stdout, timestamps) != SUCCESS) {
+    log_print(LL_ERR, "%s is not a binary log or is damaged", path);
+    return 1;
+  }
+  return 0;
+}
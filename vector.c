@@ -1,6 +1,7 @@
 // A dynamically growing array. It will double it's size when it hits it's
-// internal capacity. Note data is actually stored in the array,
-// so when you put() something it will be copied into the internal storage.
+// internal capacity, unless initialized with a different VECTOR_POLICY.
+// Note data is actually stored in the array, so when you put() something
+// it will be copied into the internal storage.
 // This makes it easy to release memory for a group of iteams by calling
 // the cleanup() function, it also avoids many small memory allocations.
 // If you wan't to keep the elements stored somewhere else simply make a
@@ -24,12 +25,16 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#include <errno.h>
 #include <string.h>
 #include <strings.h>
+#include <sys/mman.h>
+#include <unistd.h>
 
 #include "vector.h"
 
-static const uint8_t growth_factor = 2;
+extern inline void *vector_ptr(VECTOR *vec, size_t index);
+extern inline void *vector_get(VECTOR *vec, size_t index);
 
 // Create a new vector and allocate enough memory to hold an initial
 // amount of data members.
@@ -39,10 +44,32 @@ static const uint8_t growth_factor = 2;
 //  item_size: size of an individual item in the vector
 //  capacity: number of items to allocate initially
 ERROR vector_init(VECTOR *vec, size_t item_size, size_t capacity) {
+  return vector_init_policy(vec, item_size, capacity, VECTOR_POLICY_DEFAULT);
+}
+
+// Create a new vector that grows and shrinks according to a custom policy.
+// Fails if the policy would make the vector shrink right after growing.
+//
+// Args:
+//  vec: pointer to the vector to initialize
+//  item_size: size of an individual item in the vector
+//  capacity: number of items to allocate initially
+//  policy: growth and shrink behaviour, see VECTOR_POLICY
+ERROR vector_init_policy(VECTOR *vec, size_t item_size, size_t capacity,
+                         VECTOR_POLICY policy) {
+  if (policy.growth_percent <= 100 ||
+      (uint32_t)policy.shrink_percent * policy.growth_percent >= 100 * 100) {
+    vec->data = NULL;
+    return FAILURE;
+  }
+  vec->policy = policy;
   vec->item_size = item_size;
   vec->used_bytes = 0;
   vec->total_bytes = capacity * item_size;
   vec->init_bytes = vec->total_bytes;
+  vec->backing = VECTOR_HEAP;
+  vec->backing_data = NULL;
+  vec->mapped_bytes = 0;
   vec->data = calloc(capacity, item_size);
   if (vec->data) {
     return SUCCESS;
@@ -50,35 +77,392 @@ ERROR vector_init(VECTOR *vec, size_t item_size, size_t capacity) {
   return FAILURE;
 }
 
+// Create a new vector that stores its first items in a caller provided
+// buffer, usually through SMALL_VECTOR_INIT(). The vector only moves to the
+// heap when it outgrows the buffer, and moves back when it shrinks again.
+//
+// Args:
+//  vec: pointer to the vector to initialize
+//  item_size: size of an individual item in the vector
+//  buffer: storage for the first items, must outlive the vector
+//  capacity: number of items the buffer can hold
+ERROR vector_init_inline(VECTOR *vec, size_t item_size, void *buffer,
+                         size_t capacity) {
+  vec->policy = VECTOR_POLICY_DEFAULT;
+  vec->item_size = item_size;
+  vec->used_bytes = 0;
+  vec->total_bytes = capacity * item_size;
+  vec->init_bytes = vec->total_bytes;
+  vec->backing = VECTOR_INLINE;
+  vec->backing_data = buffer;
+  vec->mapped_bytes = 0;
+  vec->data = buffer;
+  if (vec->data) {
+    return SUCCESS;
+  }
+  return FAILURE;
+}
+
+// Size of the pages backing a VECTOR_MMAP(_HUGE) vector.
+static size_t vector_page_size(const VECTOR *vec) {
+  static const size_t huge_page_size = 2 * 1024 * 1024;
+  if (vec->backing == VECTOR_MMAP_HUGE) {
+    return huge_page_size;
+  }
+  return sysconf(_SC_PAGESIZE);
+}
+
+// Create a new vector for very large data sets, which keeps its items in an
+// anonymous memory mapping instead of the heap. Pages are only touched when
+// items are written, and growing remaps pages with mremap() instead of copying
+// them. When the vector shrinks it releases the pages at its end with
+// MADV_DONTNEED but keeps the address space, so growing again is free.
+// The capacity is rounded up to whole pages.
+//
+// Args:
+//  vec: pointer to the vector to initialize
+//  item_size: size of an individual item in the vector
+//  capacity: number of items to reserve address space for initially
+//  huge_pages: ask the kernel to use transparent huge pages
+ERROR vector_init_mmap(VECTOR *vec, size_t item_size, size_t capacity,
+                       bool huge_pages) {
+  vec->policy = VECTOR_POLICY_DEFAULT;
+  vec->item_size = item_size;
+  vec->used_bytes = 0;
+  vec->backing = huge_pages ? VECTOR_MMAP_HUGE : VECTOR_MMAP;
+  vec->backing_data = NULL;
+  vec->data = NULL;
+
+  size_t page_size = vector_page_size(vec);
+  size_t mapped_bytes;
+  if (item_size == 0 ||
+      __builtin_mul_overflow(capacity ? capacity : 1, item_size,
+                             &mapped_bytes) ||
+      __builtin_add_overflow(mapped_bytes, page_size - 1, &mapped_bytes)) {
+    return FAILURE;
+  }
+  mapped_bytes -= mapped_bytes % page_size;
+  void *data = mmap(NULL, mapped_bytes, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  if (data == MAP_FAILED) {
+    return FAILURE;
+  }
+  if (huge_pages) {
+    madvise(data, mapped_bytes, MADV_HUGEPAGE);
+  }
+  vec->data = data;
+  vec->mapped_bytes = mapped_bytes;
+  vec->total_bytes = mapped_bytes / item_size * item_size;
+  vec->init_bytes = vec->total_bytes;
+  return SUCCESS;
+}
+
+// Create a new vector which takes its storage from an arena. It never
+// shrinks and never frees anything, the memory goes back when the arena is
+// destroyed or rewound past the vector. If the vector is the most recent
+// allocation in the arena it grows in place, so building one vector at a time
+// in an arena rarely copies.
+//
+// Args:
+//  vec: pointer to the vector to initialize
+//  item_size: size of an individual item in the vector
+//  capacity: number of items to allocate memory for initially
+//  arena: the arena to allocate from, must outlive the vector
+ERROR vector_init_arena(VECTOR *vec, size_t item_size, size_t capacity,
+                        ARENA *arena) {
+  vec->policy = VECTOR_POLICY_NEVER_SHRINK;
+  vec->item_size = item_size;
+  vec->used_bytes = 0;
+  vec->total_bytes = 0;
+  vec->init_bytes = 0;
+  vec->backing = VECTOR_ARENA;
+  vec->backing_data = arena;
+  vec->mapped_bytes = 0;
+  vec->data = NULL;
+  size_t total_bytes;
+  if (item_size == 0 ||
+      __builtin_mul_overflow(capacity, item_size, &total_bytes)) {
+    return FAILURE;
+  }
+  vec->data = arena_alloc(arena, total_bytes);
+  if (vec->data) {
+    vec->total_bytes = total_bytes;
+    vec->init_bytes = total_bytes;
+    return SUCCESS;
+  }
+  return FAILURE;
+}
+
+// Create a read only vector over the items of a file written by
+// vector_save() and mapped with mmap_file(). Nothing is copied, items are
+// paged in from the file when they are first read. All functions that would
+// change the vector fail.
+//
+// Args:
+//  vec: pointer to the vector to initialize
+//  item_size: size of an individual item, must match the file
+//  region: the mapped file, must stay mapped as long as the vector is used
+ERROR vector_init_view(VECTOR *vec, size_t item_size,
+                       const MMAP_REGION * const region) {
+  const VECTOR_FILE_HEADER *header = (VECTOR_FILE_HEADER *)region->data;
+  vec->policy = VECTOR_POLICY_NEVER_SHRINK;
+  vec->item_size = item_size;
+  vec->used_bytes = 0;
+  vec->total_bytes = 0;
+  vec->init_bytes = 0;
+  vec->backing = VECTOR_VIEW;
+  vec->backing_data = NULL;
+  vec->mapped_bytes = 0;
+  vec->data = NULL;
+  size_t total_bytes;
+  if (item_size == 0 || region->size < sizeof(*header) ||
+      memcmp(header->magic, VECTOR_FILE_MAGIC, sizeof(header->magic)) ||
+      header->version != VECTOR_FILE_VERSION ||
+      header->item_size != item_size ||
+      __builtin_mul_overflow(header->count, item_size, &total_bytes) ||
+      total_bytes > region->size - sizeof(*header)) {
+    return FAILURE;
+  }
+  vec->data = region->data + sizeof(*header);
+  vec->used_bytes = total_bytes;
+  vec->total_bytes = total_bytes;
+  vec->init_bytes = total_bytes;
+  return SUCCESS;
+}
+
+// Write all of buffer, retrying after partial writes.
+static ERROR vector_write_all(int fd, const uint8_t *buffer, size_t size) {
+  while (size) {
+    ssize_t written = write(fd, buffer, size);
+    if (written < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return FAILURE;
+    }
+    buffer += written;
+    size -= written;
+  }
+  return SUCCESS;
+}
+
+// Write the items of a vector to a file, which can be mapped and used with
+// vector_init_view() later. An existing file is replaced.
+ERROR vector_save(const VECTOR * const vec, const char * const path) {
+  VECTOR_FILE_HEADER header = {
+    .version = VECTOR_FILE_VERSION,
+    .item_size = vec->item_size,
+    .count = vec->used_bytes / vec->item_size
+  };
+  memcpy(header.magic, VECTOR_FILE_MAGIC, sizeof(header.magic));
+  LOCAL_FD int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd == invalid_fileno ||
+      vector_write_all(fd, (uint8_t *)&header, sizeof(header)) != SUCCESS ||
+      vector_write_all(fd, vec->data, vec->used_bytes) != SUCCESS) {
+    return FAILURE;
+  }
+  return SUCCESS;
+}
+
 // release all memory the vector holds.
 void vector_destroy(VECTOR *vec) {
-  free(vec->data);
+  if (vec->backing == VECTOR_ARENA || vec->backing == VECTOR_VIEW) {
+    return;
+  }
+  if (vec->backing == VECTOR_MMAP || vec->backing == VECTOR_MMAP_HUGE) {
+    if (vec->data) {
+      munmap(vec->data, vec->mapped_bytes);
+    }
+    return;
+  }
+  if (vec->data != vec->backing_data) {
+    free(vec->data);
+  }
 }
 
-// try to grow the vector using the growth_factor (2 by default).
-static ERROR vector_grow(VECTOR *vec) {
-  uint8_t *new_data = realloc(vec->data, vec->total_bytes * growth_factor);
+// Grow the mapping in place if possible, otherwise let the kernel move the
+// pages to a new address. Shrinking keeps the mapping and only gives the
+// pages back to the kernel.
+static ERROR vector_resize_mmap(VECTOR *vec, size_t total_bytes) {
+  size_t page_size = vector_page_size(vec);
+  size_t mapped_bytes;
+  if (__builtin_add_overflow(total_bytes, page_size - 1, &mapped_bytes)) {
+    return FAILURE;
+  }
+  mapped_bytes -= mapped_bytes % page_size;
+  if (mapped_bytes == 0) {
+    mapped_bytes = page_size;
+  }
+  if (mapped_bytes > vec->mapped_bytes) {
+    void *new_data = mremap(vec->data, vec->mapped_bytes, mapped_bytes,
+                            MREMAP_MAYMOVE);
+    if (new_data == MAP_FAILED) {
+      return FAILURE;
+    }
+    if (vec->backing == VECTOR_MMAP_HUGE) {
+      madvise(new_data, mapped_bytes, MADV_HUGEPAGE);
+    }
+    vec->data = new_data;
+    vec->mapped_bytes = mapped_bytes;
+  } else if (mapped_bytes < vec->total_bytes) {
+    madvise(vec->data + mapped_bytes, vec->mapped_bytes - mapped_bytes,
+            MADV_DONTNEED);
+  }
+  vec->total_bytes = mapped_bytes / vec->item_size * vec->item_size;
+  return SUCCESS;
+}
+
+// Move inline storage to the heap, or back into its buffer if it fits.
+static ERROR vector_resize_inline(VECTOR *vec, size_t total_bytes) {
+  uint8_t *buffer = vec->backing_data;
+  if (total_bytes <= vec->init_bytes) {
+    if (vec->data != buffer) {
+      memcpy(buffer, vec->data, vec->used_bytes);
+      free(vec->data);
+      vec->data = buffer;
+    }
+    vec->total_bytes = vec->init_bytes;
+    return SUCCESS;
+  }
+  uint8_t *new_data = malloc(total_bytes);
   if (new_data == NULL) {
     return FAILURE;
   }
+  memcpy(new_data, buffer, vec->used_bytes);
   vec->data = new_data;
-  vec->total_bytes *= growth_factor;
+  vec->total_bytes = total_bytes;
   return SUCCESS;
 }
 
-// try to shrink the vector using the growth_factor (2 by default).
-static ERROR vector_shrink(VECTOR *vec) {
-  void *new_data = realloc(vec->data, vec->total_bytes / growth_factor);
+// Move the underlying storage into a block of exactly total_bytes.
+static ERROR vector_resize(VECTOR *vec, size_t total_bytes) {
+  if (vec->backing == VECTOR_VIEW) {
+    return FAILURE;
+  }
+  if (vec->backing == VECTOR_MMAP || vec->backing == VECTOR_MMAP_HUGE) {
+    return vector_resize_mmap(vec, total_bytes);
+  }
+  if (vec->backing == VECTOR_INLINE &&
+      (vec->data == vec->backing_data || total_bytes <= vec->init_bytes)) {
+    return vector_resize_inline(vec, total_bytes);
+  }
+  if (vec->backing == VECTOR_ARENA) {
+    uint8_t *new_data = arena_realloc(vec->backing_data, vec->data,
+                                      vec->total_bytes, total_bytes);
+    if (new_data == NULL) {
+      return FAILURE;
+    }
+    vec->data = new_data;
+    vec->total_bytes = total_bytes;
+    return SUCCESS;
+  }
+  uint8_t *new_data = realloc(vec->data, total_bytes);
   if (new_data == NULL) {
     return FAILURE;
   }
   vec->data = new_data;
-  vec->total_bytes /= growth_factor;
+  vec->total_bytes = total_bytes;
   return SUCCESS;
 }
 
+// Calculates the size of the vector after growing it once by its policy.
+// Returns SIZE_MAX if that doesn't fit into a size_t, which no allocation
+// can satisfy.
+static size_t vector_grown_bytes(const VECTOR *vec) {
+  size_t items = vec->total_bytes / vec->item_size;
+  size_t grown_items;
+  size_t grown_bytes;
+  if (__builtin_mul_overflow(items, vec->policy.growth_percent,
+                             &grown_items)) {
+    return SIZE_MAX;
+  }
+  grown_items /= 100;
+  if (grown_items <= items) {
+    grown_items = items + 1;
+  }
+  if (__builtin_mul_overflow(grown_items, vec->item_size, &grown_bytes)) {
+    return SIZE_MAX;
+  }
+  return grown_bytes;
+}
+
+// Make sure there is room for count more items. The vector grows at most once,
+// either by the growth factor of its policy or straight to the needed size if
+// that is larger.
+static ERROR vector_make_room(VECTOR *vec, size_t count) {
+  size_t needed_bytes;
+  if (__builtin_mul_overflow(count, vec->item_size, &needed_bytes) ||
+      __builtin_add_overflow(needed_bytes, vec->used_bytes, &needed_bytes)) {
+    return FAILURE;
+  }
+  if (needed_bytes <= vec->total_bytes) {
+    return SUCCESS;
+  }
+  size_t grown_bytes = vector_grown_bytes(vec);
+  if (grown_bytes < needed_bytes) {
+    grown_bytes = needed_bytes;
+  }
+  return vector_resize(vec, grown_bytes);
+}
+
+// try to grow the vector using the growth factor of its policy.
+ERROR vector_grow(VECTOR *vec) {
+  return vector_resize(vec, vector_grown_bytes(vec));
+}
+
+// Make sure the vector can hold at least capacity items without growing.
+// Unlike the automatic growth this allocates exactly what you ask for.
+ERROR vector_reserve(VECTOR *vec, size_t capacity) {
+  size_t total_bytes;
+  if (__builtin_mul_overflow(capacity, vec->item_size, &total_bytes)) {
+    return FAILURE;
+  }
+  if (total_bytes <= vec->total_bytes) {
+    return SUCCESS;
+  }
+  return vector_resize(vec, total_bytes);
+}
+
+// try to shrink the vector using the growth factor of its policy. It will
+// never shrink below its initial capacity or the space currently used.
+ERROR vector_shrink(VECTOR *vec) {
+  size_t items = vec->total_bytes / vec->item_size;
+  size_t shrunk_items;
+  // Vectors too large to multiply first lose a fraction of an item.
+  if (__builtin_mul_overflow(items, 100, &shrunk_items)) {
+    shrunk_items = items / vec->policy.growth_percent * 100;
+  } else {
+    shrunk_items /= vec->policy.growth_percent;
+  }
+  size_t total_bytes = shrunk_items * vec->item_size;
+  if (total_bytes < vec->init_bytes) {
+    total_bytes = vec->init_bytes;
+  }
+  if (total_bytes < vec->used_bytes) {
+    total_bytes = vec->used_bytes;
+  }
+  if (total_bytes == 0 || total_bytes >= vec->total_bytes) {
+    return SUCCESS;
+  }
+  return vector_resize(vec, total_bytes);
+}
+
+// Release all memory not needed to hold the current items, regardless of
+// the policy or initial capacity.
+ERROR vector_shrink_to_fit(VECTOR *vec) {
+  size_t total_bytes = vec->used_bytes;
+  // realloc() frees zero sized blocks, so keep at least one item around.
+  if (total_bytes == 0) {
+    total_bytes = vec->item_size;
+  }
+  if (total_bytes >= vec->total_bytes) {
+    return SUCCESS;
+  }
+  return vector_resize(vec, total_bytes);
+}
+
 // Add a new element to the vector by copying it into the next free slot.
-// If the vector is full it will automatically grow by its growth_factor.
+// If the vector is full it will automatically grow according to its policy.
 //
 // NOTE: while we could get the size directly from the vector we prefer
 // you supply it here. The supplied size must equal the vectors item_size.
@@ -109,42 +493,88 @@ void *vector_push_new(VECTOR *vec, const size_t size) {
   return element;
 }
 
-// Calculates a pointer to the desired element in the underlying array.
-inline void *vector_ptr(VECTOR *vec, size_t index) {
-  return (void *)(vec->data + index * vec->item_size);
+// Append count items from a contiguous array with a single copy. Returns a
+// pointer to the first new element in the vector.
+//
+// NOTE: values must not point into the vector itself, as growing the vector
+// can move it. Use vector_extend() to append a vector to itself.
+void *vector_push_n(VECTOR *vec, const void * const values, size_t count,
+                    size_t size) {
+  if (size != vec->item_size || vec->backing == VECTOR_VIEW ||
+      vector_make_room(vec, count) != SUCCESS) {
+    return NULL;
+  }
+  void *element = vec->data + vec->used_bytes;
+  memcpy(element, values, count * vec->item_size);
+  vec->used_bytes += count * vec->item_size;
+  return element;
 }
 
-// Get a pointer to an element in the vector. Implements bounds checking,
-// so the pointer is guaranteed to be valid or NULL in case of an invalid index.
-inline void *vector_get(VECTOR *vec, size_t index) {
-  size_t offset = index * vec->item_size;
-  if (offset >= vec->total_bytes) {
+// Append all items of another vector with the same item_size.
+ERROR vector_extend(VECTOR *vec, const VECTOR * const other) {
+  size_t copy_bytes = other->used_bytes;
+  if (other->item_size != vec->item_size || vec->backing == VECTOR_VIEW ||
+      vector_make_room(vec, copy_bytes / vec->item_size) != SUCCESS) {
+    return FAILURE;
+  }
+  // Read other->data only now, it moved if other is the vector we just grew.
+  memcpy(vec->data + vec->used_bytes, other->data, copy_bytes);
+  vec->used_bytes += copy_bytes;
+  return SUCCESS;
+}
+
+// Insert count items from a contiguous array before the item at index,
+// shifting everything behind it with one memmove. An index equal to the
+// number of items appends. Returns a pointer to the first inserted element.
+//
+// NOTE: values must not point into the vector itself.
+void *vector_insert_n(VECTOR *vec, size_t index, const void * const values,
+                      size_t count, size_t size) {
+  size_t offset;
+  if (size != vec->item_size || vec->backing == VECTOR_VIEW ||
+      __builtin_mul_overflow(index, vec->item_size, &offset) ||
+      offset > vec->used_bytes ||
+      vector_make_room(vec, count) != SUCCESS) {
     return NULL;
   }
-  return (void *)(vec->data + offset);
+  uint8_t *element = vec->data + offset;
+  size_t insert_bytes = count * vec->item_size;
+  memmove(element + insert_bytes, element, vec->used_bytes - offset);
+  memcpy(element, values, insert_bytes);
+  vec->used_bytes += insert_bytes;
+  return element;
 }
 
 // Shortcut to delete the last element.
 inline ERROR vector_pop(VECTOR *vec) {
-  return vector_del(vec, vec->used_bytes / vec->item_size);
+  if (vec->used_bytes == 0) {
+    return FAILURE;
+  }
+  return vector_del(vec, vec->used_bytes / vec->item_size - 1);
 }
 
 // Shortcut to delete the last element and return a copy.
 inline void *vector_pop_copy(VECTOR *vec) {
-  return vector_del_copy(vec, vec->used_bytes / vec->item_size);
+  if (vec->used_bytes == 0) {
+    return NULL;
+  }
+  return vector_del_copy(vec, vec->used_bytes / vec->item_size - 1);
 }
 
-// Remove an element from the vector by deleting its data.
+// Remove an element from the vector, moving all elements behind it one slot
+// to the front with a single memmove, so the order of elements is kept.
 // NOTE: This is O(n) for all elements except the last one which is O(1).
+// If you don't care about the order use vector_swap_remove() instead.
 ERROR vector_del(VECTOR *vec, size_t index) {
-  const void * const element = vector_get(vec, index);
-  if (!element) {
+  uint8_t * const element = vector_get(vec, index);
+  if (!element || vec->backing == VECTOR_VIEW) {
     return FAILURE;
   }
+  uint8_t *next = element + vec->item_size;
+  memmove(element, next, vec->data + vec->used_bytes - next);
   vec->used_bytes -= vec->item_size;
   // Check if we can shrink the vector.
-  if (vec->total_bytes > vec->init_bytes &&
-      vec->used_bytes <= (vec->total_bytes / growth_factor)) {
+  if (vector_should_shrink(vec)) {
     vector_shrink(vec);
   }
   return SUCCESS;
@@ -152,12 +582,69 @@ ERROR vector_del(VECTOR *vec, size_t index) {
 
 // Remove an element from the vector and return a copy.
 void *vector_del_copy(VECTOR *vec, size_t index) {
-  void *copy = malloc(vec->item_size);
   void *element = vector_get(vec, index);
-  if (!(element && copy)) {
+  if (!element || vec->backing == VECTOR_VIEW) {
+    return NULL;
+  }
+  void *copy = malloc(vec->item_size);
+  if (!copy) {
     return NULL;
   }
   memcpy(copy, element, vec->item_size);
   vector_del(vec, index);
   return copy;
 }
+
+// Remove an element in O(1) by moving the last element into its slot.
+// NOTE: This changes the order of the elements.
+ERROR vector_swap_remove(VECTOR *vec, size_t index) {
+  uint8_t * const element = vector_get(vec, index);
+  if (!element || vec->backing == VECTOR_VIEW) {
+    return FAILURE;
+  }
+  vec->used_bytes -= vec->item_size;
+  uint8_t *last = vec->data + vec->used_bytes;
+  if (element != last) {
+    memcpy(element, last, vec->item_size);
+  }
+  if (vector_should_shrink(vec)) {
+    vector_shrink(vec);
+  }
+  return SUCCESS;
+}
+
+// Remove all elements for which predicate(element, ctx) returns true and
+// return how many were removed. The remaining elements keep their order.
+// This compacts the vector in a single pass, moving each run of kept
+// elements at most once, so removing k of n elements is O(n) and not O(k*n).
+size_t vector_remove_if(VECTOR *vec, VECTOR_PREDICATE predicate, void *ctx) {
+  uint8_t * const end = vec->data + vec->used_bytes;
+  uint8_t *write = vec->data;
+  uint8_t *run = vec->data;
+
+  if (vec->backing == VECTOR_VIEW) {
+    return 0;
+  }
+  for (uint8_t *read = vec->data; read < end; read += vec->item_size) {
+    if (!predicate(read, ctx)) {
+      continue;
+    }
+    // Move the run of kept elements in front of the removed one, nothing
+    // has to move until the first element is removed.
+    if (write != run) {
+      memmove(write, run, read - run);
+    }
+    write += read - run;
+    run = read + vec->item_size;
+  }
+  if (write != run) {
+    memmove(write, run, end - run);
+  }
+  write += end - run;
+  size_t removed = (end - write) / vec->item_size;
+  vec->used_bytes = write - vec->data;
+  if (removed && vector_should_shrink(vec)) {
+    vector_shrink(vec);
+  }
+  return removed;
+}
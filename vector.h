@@ -1,6 +1,7 @@
 // A dynamically growing array. It will double it's size when it hits it's
-// internal capacity. Note data is actually stored in the array,
-// so when you put() something it will be copied into the internal storage.
+// internal capacity, unless initialized with a different VECTOR_POLICY.
+// Note data is actually stored in the array, so when you put() something
+// it will be copied into the internal storage.
 // This makes it easy to release memory for a group of iteams by calling
 // the cleanup() function, it also avoids many small memory allocations.
 // If you wan't to keep the elements stored somewhere else simply make a
@@ -29,28 +30,225 @@
 
 #include "stdlib.h"
 
+#include "arena.h"
+#include "raii.h"
 #include "types.h"
 
+// Controls how a vector resizes itself. A full vector multiplies its capacity
+// by growth_percent / 100. Once no more than shrink_percent of the capacity
+// is used, the vector divides its capacity by the same factor again (but
+// never below the initial capacity). Keep shrink_percent well below
+// 10000 / growth_percent, so a vector sitting right at a resize boundary
+// doesn't realloc on every push and pop. A shrink_percent of 0 means the
+// vector never shrinks on its own, use vector_shrink_to_fit() instead.
+typedef struct VECTOR_POLICY_ {
+  uint16_t growth_percent;
+  uint16_t shrink_percent;
+} VECTOR_POLICY;
+
+// Double when full, halve when a quarter full.
+static const VECTOR_POLICY VECTOR_POLICY_DEFAULT = {200, 25};
+// Grow by 1.5x when full, which wastes less memory but reallocs more often.
+static const VECTOR_POLICY VECTOR_POLICY_COMPACT = {150, 25};
+// Double when full and keep the memory until the vector is destroyed.
+static const VECTOR_POLICY VECTOR_POLICY_NEVER_SHRINK = {200, 0};
+
+// Where a vector gets its storage from.
+typedef enum VECTOR_BACKING_ {
+  VECTOR_HEAP = 0,  // calloc() and realloc()
+  VECTOR_INLINE,    // A caller provided buffer, spills to the heap when full
+  VECTOR_MMAP,      // Anonymous mappings, grown with mremap()
+  VECTOR_MMAP_HUGE, // Same as VECTOR_MMAP, using transparent huge pages
+  VECTOR_ARENA,     // Allocated from an ARENA, released with the arena
+  VECTOR_VIEW       // Read only items in a file saved with vector_save()
+} VECTOR_BACKING;
+
 typedef struct VECTOR_ {
   uint8_t *data;
   size_t used_bytes;
   size_t item_size;
   size_t total_bytes;
   size_t init_bytes;
+  VECTOR_POLICY policy;
+  VECTOR_BACKING backing;
+  void *backing_data;
+  size_t mapped_bytes;  // Length of the mapping for VECTOR_MMAP(_HUGE)
 } VECTOR;
 
 static const size_t VECTOR_DEFAULT_SIZE = 16;
 
+#define VECTOR_FILE_MAGIC "CUTILVEC"
+
+// Files written by vector_save() start with this header, followed directly
+// by the items. All fields are in native byte order. The header is 64 bytes
+// so items in a mapped file are aligned to anything up to a cache line.
+typedef struct VECTOR_FILE_HEADER_ {
+  char magic[8];
+  uint64_t version;
+  uint64_t item_size;
+  uint64_t count;
+  uint8_t reserved[32];
+} VECTOR_FILE_HEADER;
+
+static const uint64_t VECTOR_FILE_VERSION = 1;
+
+// Declares a vector with inline storage for the first n items, e.g.
+//
+//   SMALL_VECTOR(size_t, 8) scratch;
+//   SMALL_VECTOR_INIT(&scratch);
+//   vector_push(&scratch.vec, &value, sizeof(value));
+//
+// Only once it holds more than n items the vector moves to the heap, so small
+// vectors never call malloc(). Use it like any other vector through its 'vec'
+// member.
+//
+// NOTE: The vector points into its own struct, never copy or move it.
+#define SMALL_VECTOR(type, n) struct { \
+  VECTOR vec; \
+  type items[n]; \
+}
+
+#define SMALL_VECTOR_INIT(svec) \
+  vector_init_inline(&(svec)->vec, sizeof(*(svec)->items), (svec)->items, \
+                     ARRAYSIZE((svec)->items))
+
 ERROR vector_init(VECTOR *vec, size_t item_size, size_t capacity);
+ERROR vector_init_policy(VECTOR *vec, size_t item_size, size_t capacity,
+                         VECTOR_POLICY policy);
+ERROR vector_init_inline(VECTOR *vec, size_t item_size, void *buffer,
+                         size_t capacity);
+ERROR vector_init_mmap(VECTOR *vec, size_t item_size, size_t capacity,
+                       bool huge_pages);
+ERROR vector_init_arena(VECTOR *vec, size_t item_size, size_t capacity,
+                        ARENA *arena);
+ERROR vector_init_view(VECTOR *vec, size_t item_size,
+                       const MMAP_REGION * const region);
+ERROR vector_save(const VECTOR * const vec, const char * const path);
 void vector_destroy(VECTOR *vec);
 void *vector_push(VECTOR *vec, const void * const value, size_t size);
 void *vector_push_new(VECTOR *vec, size_t size);
-void *vector_ptr(VECTOR *vec, size_t index);
-void *vector_get(VECTOR *vec, size_t index);
+ERROR vector_reserve(VECTOR *vec, size_t capacity);
+void *vector_push_n(VECTOR *vec, const void * const values, size_t count,
+                    size_t size);
+ERROR vector_extend(VECTOR *vec, const VECTOR * const other);
+void *vector_insert_n(VECTOR *vec, size_t index, const void * const values,
+                      size_t count, size_t size);
 ERROR vector_pop(VECTOR *vec);
 void *vector_pop_copy(VECTOR *vec);
 
 ERROR vector_del(VECTOR *vec, size_t index);
 void *vector_del_copy(VECTOR *vec, size_t index);
+ERROR vector_swap_remove(VECTOR *vec, size_t index);
+
+// Predicates get a pointer to an element and the context pointer passed to
+// vector_remove_if() and return true for elements that should be removed.
+typedef bool (*VECTOR_PREDICATE)(const void *element, void *ctx);
+
+size_t vector_remove_if(VECTOR *vec, VECTOR_PREDICATE predicate, void *ctx);
+
+ERROR vector_shrink_to_fit(VECTOR *vec);
+
+// Slow paths of the typed vectors below, which inline everything else.
+// Grow or shrink the storage by the growth factor of the vectors policy.
+ERROR vector_grow(VECTOR *vec);
+ERROR vector_shrink(VECTOR *vec);
+
+// Checks if the vector policy wants to give back memory after removing items.
+static inline bool vector_should_shrink(const VECTOR *vec) {
+  return vec->policy.shrink_percent &&
+         vec->total_bytes > vec->init_bytes &&
+         vec->used_bytes * 100 <=
+         vec->total_bytes * vec->policy.shrink_percent;
+}
+
+// Calculates a pointer to the desired element in the underlying array.
+// These are defined here so they can be inlined into other translation units,
+// vector.c provides the external definitions.
+inline void *vector_ptr(VECTOR *vec, size_t index) {
+  return (void *)(vec->data + index * vec->item_size);
+}
+
+// Get a pointer to an element in the vector. Implements bounds checking,
+// so the pointer is guaranteed to be valid or NULL in case of an invalid index.
+inline void *vector_get(VECTOR *vec, size_t index) {
+  size_t offset = index * vec->item_size;
+  if (offset >= vec->used_bytes) {
+    return NULL;
+  }
+  return (void *)(vec->data + offset);
+}
+
+// Generates a vector specialized for a single item type, e.g.
+//
+//   VECTOR_DEFINE(int_vec, int)
+//
+// declares the type 'int_vec' and the functions int_vec_init(),
+// int_vec_init_policy(), int_vec_destroy(), int_vec_size(), int_vec_push(),
+// int_vec_at(), int_vec_get() and int_vec_pop(). All of them are inlined,
+// use the constant sizeof(type) for address calculations and copy items by
+// assignment instead of memcpy, only growing and shrinking call into
+// vector.c.
+//
+// The typed vector wraps a regular VECTOR, so you can always pass '&v->vec'
+// to any of the generic vector_* functions above.
+//
+// NOTE: _at() does no bounds checking, use _get() if you need it.
+#define VECTOR_DEFINE(name, type) \
+typedef struct name##_ { \
+  VECTOR vec; \
+} name; \
+\
+static inline ERROR name##_init(name *v, size_t capacity) { \
+  return vector_init(&v->vec, sizeof(type), capacity); \
+} \
+\
+static inline ERROR name##_init_policy(name *v, size_t capacity, \
+                                       VECTOR_POLICY policy) { \
+  return vector_init_policy(&v->vec, sizeof(type), capacity, policy); \
+} \
+\
+static inline void name##_destroy(name *v) { \
+  vector_destroy(&v->vec); \
+} \
+\
+static inline size_t name##_size(const name *v) { \
+  return v->vec.used_bytes / sizeof(type); \
+} \
+\
+static inline type *name##_push(name *v, type value) { \
+  if (__builtin_expect(v->vec.used_bytes >= v->vec.total_bytes, 0) && \
+      vector_grow(&v->vec) != SUCCESS) { \
+    return NULL; \
+  } \
+  type *element = (type *)(v->vec.data + v->vec.used_bytes); \
+  *element = value; \
+  v->vec.used_bytes += sizeof(type); \
+  return element; \
+} \
+\
+static inline type *name##_at(name *v, size_t index) { \
+  return (type *)v->vec.data + index; \
+} \
+\
+static inline type *name##_get(name *v, size_t index) { \
+  if (index >= name##_size(v)) { \
+    return NULL; \
+  } \
+  return name##_at(v, index); \
+} \
+\
+static inline ERROR name##_pop(name *v, type *value) { \
+  if (v->vec.used_bytes == 0 || v->vec.backing == VECTOR_VIEW) { \
+    return FAILURE; \
+  } \
+  v->vec.used_bytes -= sizeof(type); \
+  if (value) { \
+    *value = *(type *)(v->vec.data + v->vec.used_bytes); \
+  } \
+  if (vector_should_shrink(&v->vec)) { \
+    vector_shrink(&v->vec); \
+  } \
+  return SUCCESS; \
+}
 
 #endif  // CUTIL_VECTOR_H
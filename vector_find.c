@@ -0,0 +1,224 @@
+// Linear search for items equal to a key in unsorted vectors.
+//
+// The vectorized scans compare a block of bytes against the key repeated
+// over a whole register, which works the same for every item size. An item
+// matches if all of its bytes do, which the movemask bits reveal after
+// and-ing each bit with its neighbours (vector_find_items()).
+//
+// Author: Johannes Stüttgen (johannes.stuettgen@gmail.com)
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <string.h>
+
+#include "cpu.h"
+#include "vector_find.h"
+
+#define FIND_INLINE static inline __attribute__((always_inline))
+
+// Largest register used by the scans, the key is repeated to fill it.
+#define FIND_PATTERN_SIZE 32
+
+// Turn a mask with one bit per equal byte into a mask with one bit at the
+// first byte of each equal item.
+FIND_INLINE uint32_t vector_find_items(uint32_t bytes, size_t item_size) {
+  static const uint32_t item_starts[9] = {
+    0, 0xffffffff, 0x55555555, 0, 0x11111111, 0, 0, 0, 0x01010101
+  };
+  for (size_t shift = 1; shift < item_size; shift <<= 1) {
+    bytes &= bytes >> shift;
+  }
+  return bytes & item_starts[item_size];
+}
+
+// Compare items one at a time, for the tail of the vectorized scans and for
+// item sizes they don't handle. With a constant item_size the compiler turns
+// the memcmp() into a single compare.
+FIND_INLINE bool vector_find_equal(const uint8_t *item, const uint8_t *key,
+                                   size_t item_size) {
+  return memcmp(item, key, item_size) == 0;
+}
+
+FIND_INLINE size_t vector_find_scalar(const uint8_t *data, size_t count,
+                                      size_t item_size, const uint8_t *key,
+                                      size_t start) {
+  for (size_t i = start; i < count; ++i) {
+    if (vector_find_equal(data + i * item_size, key, item_size)) {
+      return i;
+    }
+  }
+  return count;
+}
+
+FIND_INLINE size_t vector_count_scalar(const uint8_t *data, size_t count,
+                                       size_t item_size, const uint8_t *key,
+                                       size_t start) {
+  size_t matches = 0;
+  for (size_t i = start; i < count; ++i) {
+    matches += vector_find_equal(data + i * item_size, key, item_size);
+  }
+  return matches;
+}
+
+// Generates the find and count scans for one instruction set. 'load' loads
+// a block of 'width' bytes and 'match' compares two blocks and returns the
+// movemask of equal bytes.
+#define VECTOR_FIND_DEFINE(isa, target, width, block, load, match) \
+target FIND_INLINE size_t vector_find_##isa(const uint8_t *data, \
+                                            size_t count, size_t item_size, \
+                                            const uint8_t *key, \
+                                            const uint8_t *pattern, \
+                                            size_t start) { \
+  size_t end = count * item_size; \
+  size_t offset = start * item_size; \
+  block needle = load(pattern); \
+  for (; offset + width <= end; offset += width) { \
+    uint32_t items = vector_find_items(match(load(data + offset), needle), \
+                                       item_size); \
+    if (items) { \
+      return (offset + __builtin_ctz(items)) / item_size; \
+    } \
+  } \
+  return vector_find_scalar(data, count, item_size, key, offset / item_size); \
+} \
+\
+target FIND_INLINE size_t vector_count_##isa(const uint8_t *data, \
+                                             size_t count, size_t item_size, \
+                                             const uint8_t *key, \
+                                             const uint8_t *pattern) { \
+  size_t end = count * item_size; \
+  size_t offset = 0; \
+  size_t matches = 0; \
+  block needle = load(pattern); \
+  for (; offset + width <= end; offset += width) { \
+    matches += __builtin_popcount(vector_find_items( \
+        match(load(data + offset), needle), item_size)); \
+  } \
+  return matches + vector_count_scalar(data, count, item_size, key, \
+                                       offset / item_size); \
+} \
+\
+target static size_t vector_find_##isa##_sized(const uint8_t *data, \
+                                               size_t count, \
+                                               size_t item_size, \
+                                               const uint8_t *key, \
+                                               const uint8_t *pattern, \
+                                               size_t start) { \
+  switch (item_size) { \
+    case 1: \
+      return vector_find_##isa(data, count, 1, key, pattern, start); \
+    case 2: \
+      return vector_find_##isa(data, count, 2, key, pattern, start); \
+    case 4: \
+      return vector_find_##isa(data, count, 4, key, pattern, start); \
+    default: \
+      return vector_find_##isa(data, count, 8, key, pattern, start); \
+  } \
+} \
+\
+target static size_t vector_count_##isa##_sized(const uint8_t *data, \
+                                                size_t count, \
+                                                size_t item_size, \
+                                                const uint8_t *key, \
+                                                const uint8_t *pattern) { \
+  switch (item_size) { \
+    case 1: \
+      return vector_count_##isa(data, count, 1, key, pattern); \
+    case 2: \
+      return vector_count_##isa(data, count, 2, key, pattern); \
+    case 4: \
+      return vector_count_##isa(data, count, 4, key, pattern); \
+    default: \
+      return vector_count_##isa(data, count, 8, key, pattern); \
+  } \
+}
+
+#ifdef CUTIL_X86
+#define FIND_LOAD_SSE2(p) _mm_loadu_si128((const __m128i *)(p))
+#define FIND_MATCH_SSE2(a, b) (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(a, b))
+#define FIND_LOAD_AVX2(p) _mm256_loadu_si256((const __m256i *)(p))
+#define FIND_MATCH_AVX2(a, b) \
+  (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(a, b))
+
+VECTOR_FIND_DEFINE(sse2, , 16, __m128i, FIND_LOAD_SSE2, FIND_MATCH_SSE2)
+VECTOR_FIND_DEFINE(avx2, CUTIL_TARGET_AVX2, 32, __m256i, FIND_LOAD_AVX2,
+                   FIND_MATCH_AVX2)
+
+// Can the item size be searched with the vectorized scans.
+static bool vector_find_vectorized(size_t item_size) {
+  return item_size == 1 || item_size == 2 || item_size == 4 || item_size == 8;
+}
+
+// Repeat the key over a whole register.
+static void vector_find_pattern(uint8_t *pattern, const void * const key,
+                                size_t item_size) {
+  for (size_t i = 0; i < FIND_PATTERN_SIZE; i += item_size) {
+    memcpy(pattern + i, key, item_size);
+  }
+}
+#endif
+
+// Find the index of the first item equal to key, starting at index start.
+// Returns the number of items if there is none.
+size_t vector_find(VECTOR *vec, const void * const key, size_t start) {
+  size_t count = vec->used_bytes / vec->item_size;
+  if (start >= count) {
+    return count;
+  }
+#ifdef CUTIL_X86
+  if (vector_find_vectorized(vec->item_size)) {
+    uint8_t pattern[FIND_PATTERN_SIZE];
+    vector_find_pattern(pattern, key, vec->item_size);
+    if (cpu_has_avx2()) {
+      return vector_find_avx2_sized(vec->data, count, vec->item_size, key,
+                                    pattern, start);
+    }
+    return vector_find_sse2_sized(vec->data, count, vec->item_size, key,
+                                  pattern, start);
+  }
+#endif
+  return vector_find_scalar(vec->data, count, vec->item_size, key, start);
+}
+
+// Count the items equal to key.
+size_t vector_count(VECTOR *vec, const void * const key) {
+  size_t count = vec->used_bytes / vec->item_size;
+#ifdef CUTIL_X86
+  if (vector_find_vectorized(vec->item_size)) {
+    uint8_t pattern[FIND_PATTERN_SIZE];
+    vector_find_pattern(pattern, key, vec->item_size);
+    if (cpu_has_avx2()) {
+      return vector_count_avx2_sized(vec->data, count, vec->item_size, key,
+                                     pattern);
+    }
+    return vector_count_sse2_sized(vec->data, count, vec->item_size, key,
+                                   pattern);
+  }
+#endif
+  return vector_count_scalar(vec->data, count, vec->item_size, key, 0);
+}
+
+// Append the indices of all items equal to key to a vector of size_t.
+ERROR vector_find_all(VECTOR *vec, const void * const key, VECTOR *indices) {
+  size_t count = vec->used_bytes / vec->item_size;
+  if (indices->item_size != sizeof(size_t)) {
+    return FAILURE;
+  }
+  for (size_t i = vector_find(vec, key, 0); i < count;
+       i = vector_find(vec, key, i + 1)) {
+    if (!vector_push(indices, &i, sizeof(i))) {
+      return FAILURE;
+    }
+  }
+  return SUCCESS;
+}
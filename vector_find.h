@@ -0,0 +1,30 @@
+// Linear search for items equal to a key in unsorted vectors. Items of 1, 2,
+// 4 and 8 bytes are compared 16 or 32 bytes at a time with SSE2 or AVX2,
+// whichever the CPU supports. Other sizes fall back to memcmp() per item.
+// Items are compared bytewise, so don't search for structs with padding.
+//
+// Author: Johannes Stüttgen (johannes.stuettgen@gmail.com)
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef CUTIL_VECTOR_FIND_H
+#define CUTIL_VECTOR_FIND_H
+
+#include "types.h"
+#include "vector.h"
+
+size_t vector_find(VECTOR *vec, const void * const key, size_t start);
+size_t vector_count(VECTOR *vec, const void * const key);
+ERROR vector_find_all(VECTOR *vec, const void * const key, VECTOR *indices);
+
+#endif  // CUTIL_VECTOR_FIND_H
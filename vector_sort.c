@@ -0,0 +1,184 @@
+// Sorting and binary search for vectors.
+//
+// vector_sort() is an introsort: quicksort with a median of three pivot,
+// which falls back to heapsort if the recursion gets too deep and leaves
+// small partitions to a final insertion sort. Items of 4, 8 and 16 bytes
+// are moved with plain assignments, all other sizes sort an array of
+// pointers and permute the items once at the end.
+// vector_radix_sort() sorts by an unsigned integer key at a fixed offset
+// in linear time and without calling a comparator at all.
+//
+// Author: Johannes Stüttgen (johannes.stuettgen@gmail.com)
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <string.h>
+
+#include "vector_sort.h"
+
+typedef struct ITEM16_ {
+  uint64_t words[2];
+} ITEM16;
+
+// The ctx of the specialized sorts is the user comparator.
+typedef struct SORT_CTX_ {
+  VECTOR_COMPARATOR cmp;
+} SORT_CTX;
+
+#define CMP_LESS(a, b, ctx) (((SORT_CTX *)(ctx))->cmp((a), (b)) < 0)
+#define CMP_PTR_LESS(a, b, ctx) (((SORT_CTX *)(ctx))->cmp(*(a), *(b)) < 0)
+
+VECTOR_SORT_DEFINE(sort_4, uint32_t, CMP_LESS)
+VECTOR_SORT_DEFINE(sort_8, uint64_t, CMP_LESS)
+VECTOR_SORT_DEFINE(sort_16, ITEM16, CMP_LESS)
+VECTOR_SORT_DEFINE(sort_ptr, uint8_t *, CMP_PTR_LESS)
+
+// Sort items of any size by sorting pointers to them, then copy the items
+// into their final order with one pass over a temporary buffer.
+static ERROR vector_sort_indirect(VECTOR *vec, SORT_CTX *ctx) {
+  size_t count = vec->used_bytes / vec->item_size;
+  uint8_t **pointers = calloc(count, sizeof(*pointers));
+  uint8_t *sorted = malloc(vec->used_bytes);
+  if (!(pointers && sorted)) {
+    free(pointers);
+    free(sorted);
+    return FAILURE;
+  }
+  for (size_t i = 0; i < count; ++i) {
+    pointers[i] = vec->data + i * vec->item_size;
+  }
+  sort_ptr_items(pointers, count, ctx);
+  for (size_t i = 0; i < count; ++i) {
+    memcpy(sorted + i * vec->item_size, pointers[i], vec->item_size);
+  }
+  memcpy(vec->data, sorted, vec->used_bytes);
+  free(pointers);
+  free(sorted);
+  return SUCCESS;
+}
+
+// Sort the vector in place with an introsort, the order of equal items is
+// unspecified. Only items that aren't 4, 8 or 16 bytes big need temporary
+// memory.
+ERROR vector_sort(VECTOR *vec, VECTOR_COMPARATOR cmp) {
+  SORT_CTX ctx = {cmp};
+  if (vec->backing == VECTOR_VIEW) {
+    return FAILURE;
+  }
+  switch (vec->item_size) {
+    case sizeof(uint32_t):
+      sort_4(vec, &ctx);
+      return SUCCESS;
+
+    case sizeof(uint64_t):
+      sort_8(vec, &ctx);
+      return SUCCESS;
+
+    case sizeof(ITEM16):
+      sort_16(vec, &ctx);
+      return SUCCESS;
+
+    default:
+      return vector_sort_indirect(vec, &ctx);
+  }
+}
+
+// Stable sort by a little endian unsigned integer key of key_width (1 to 8)
+// bytes stored at key_offset in each item. This does one counting pass per
+// key byte, skipping bytes which are equal in all keys, and needs a temporary
+// buffer as large as the vector.
+ERROR vector_radix_sort(VECTOR *vec, size_t key_offset, size_t key_width) {
+  size_t count = vec->used_bytes / vec->item_size;
+  size_t item_size = vec->item_size;
+  if (key_width == 0 || key_width > sizeof(uint64_t) ||
+      key_width > item_size || key_offset > item_size - key_width ||
+      vec->backing == VECTOR_VIEW) {
+    return FAILURE;
+  }
+  if (count < 2) {
+    return SUCCESS;
+  }
+  size_t (*histograms)[256] = calloc(key_width, sizeof(*histograms));
+  uint8_t *buffer = malloc(vec->used_bytes);
+  if (!(histograms && buffer)) {
+    free(histograms);
+    free(buffer);
+    return FAILURE;
+  }
+  // Count all key bytes in a single pass.
+  for (size_t i = 0; i < count; ++i) {
+    const uint8_t *key = vec->data + i * item_size + key_offset;
+    for (size_t byte = 0; byte < key_width; ++byte) {
+      histograms[byte][key[byte]]++;
+    }
+  }
+  uint8_t *src = vec->data;
+  uint8_t *dst = buffer;
+  for (size_t byte = 0; byte < key_width; ++byte) {
+    size_t *histogram = histograms[byte];
+    size_t offset = 0;
+    bool skip = false;
+    for (size_t bucket = 0; bucket < 256; ++bucket) {
+      size_t bucket_count = histogram[bucket];
+      skip |= bucket_count == count;
+      histogram[bucket] = offset;
+      offset += bucket_count;
+    }
+    if (skip) {
+      continue;
+    }
+    for (size_t i = 0; i < count; ++i) {
+      const uint8_t *item = src + i * item_size;
+      uint8_t bucket = item[key_offset + byte];
+      memcpy(dst + histogram[bucket]++ * item_size, item, item_size);
+    }
+    uint8_t *swap = src;
+    src = dst;
+    dst = swap;
+  }
+  if (src != vec->data) {
+    memcpy(vec->data, src, vec->used_bytes);
+  }
+  free(histograms);
+  free(buffer);
+  return SUCCESS;
+}
+
+// Find the index of the first item in a sorted vector that isn't smaller than
+// key, or the number of items if there is none.
+size_t vector_lower_bound(VECTOR *vec, const void * const key,
+                          VECTOR_COMPARATOR cmp) {
+  size_t first = 0;
+  size_t count = vec->used_bytes / vec->item_size;
+  while (count > 0) {
+    size_t half = count / 2;
+    if (cmp(vec->data + (first + half) * vec->item_size, key) < 0) {
+      first += half + 1;
+      count -= half + 1;
+    } else {
+      count = half;
+    }
+  }
+  return first;
+}
+
+// Find an item equal to key in a sorted vector, returns NULL if there is none.
+void *vector_bsearch(VECTOR *vec, const void * const key,
+                     VECTOR_COMPARATOR cmp) {
+  size_t index = vector_lower_bound(vec, key, cmp);
+  void *item = vector_get(vec, index);
+  if (item && cmp(item, key) == 0) {
+    return item;
+  }
+  return NULL;
+}
@@ -0,0 +1,160 @@
+// Sorting and binary search for vectors.
+//
+// vector_sort() is an introsort: quicksort with a median of three pivot,
+// which falls back to heapsort if the recursion gets too deep and leaves
+// small partitions to a final insertion sort. Items of 4, 8 and 16 bytes
+// are moved with plain assignments, all other sizes sort an array of
+// pointers and permute the items once at the end.
+// vector_radix_sort() sorts by an unsigned integer key at a fixed offset
+// in linear time and without calling a comparator at all.
+//
+// If the comparator call shows up in your profiles, use VECTOR_SORT_DEFINE
+// to generate a sort function with an inlined comparison.
+//
+// Author: Johannes Stüttgen (johannes.stuettgen@gmail.com)
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef CUTIL_VECTOR_SORT_H
+#define CUTIL_VECTOR_SORT_H
+
+#include "types.h"
+#include "vector.h"
+
+// Comparators work just like the ones for qsort() and bsearch().
+typedef int (*VECTOR_COMPARATOR)(const void *a, const void *b);
+
+ERROR vector_sort(VECTOR *vec, VECTOR_COMPARATOR cmp);
+ERROR vector_radix_sort(VECTOR *vec, size_t key_offset, size_t key_width);
+size_t vector_lower_bound(VECTOR *vec, const void * const key,
+                          VECTOR_COMPARATOR cmp);
+void *vector_bsearch(VECTOR *vec, const void * const key,
+                     VECTOR_COMPARATOR cmp);
+
+// Partitions smaller than this are left to the final insertion sort.
+#define VECTOR_SORT_CUTOFF 16
+
+// Generates an introsort for vectors of a single item type, e.g.
+//
+//   #define EVENT_LESS(a, b, ctx) ((a)->timestamp < (b)->timestamp)
+//   VECTOR_SORT_DEFINE(sort_events, EVENT, EVENT_LESS)
+//
+// declares sort_events(VECTOR *vec, void *ctx) and
+// sort_events_items(EVENT *items, size_t count, void *ctx). 'less' gets
+// pointers to two items and the ctx pointer and must return true if the
+// first item belongs in front of the second. As the comparison is inlined
+// this avoids the indirect call per comparison of vector_sort().
+#define VECTOR_SORT_DEFINE(name, type, less) \
+static inline void name##_insertion(type *items, size_t count, void *ctx) { \
+  (void)ctx; \
+  for (size_t i = 1; i < count; ++i) { \
+    type item = items[i]; \
+    size_t j = i; \
+    for (; j > 0 && less(&item, &items[j - 1], ctx); --j) { \
+      items[j] = items[j - 1]; \
+    } \
+    items[j] = item; \
+  } \
+} \
+\
+static inline void name##_sift_down(type *items, size_t root, size_t count, \
+                                    void *ctx) { \
+  (void)ctx; \
+  type item = items[root]; \
+  size_t child; \
+  while ((child = 2 * root + 1) < count) { \
+    if (child + 1 < count && less(&items[child], &items[child + 1], ctx)) { \
+      child++; \
+    } \
+    if (!less(&item, &items[child], ctx)) { \
+      break; \
+    } \
+    items[root] = items[child]; \
+    root = child; \
+  } \
+  items[root] = item; \
+} \
+\
+static inline void name##_heapsort(type *items, size_t count, void *ctx) { \
+  for (size_t i = count / 2; i-- > 0;) { \
+    name##_sift_down(items, i, count, ctx); \
+  } \
+  for (size_t i = count; i-- > 1;) { \
+    type item = items[0]; \
+    items[0] = items[i]; \
+    items[i] = item; \
+    name##_sift_down(items, 0, i, ctx); \
+  } \
+} \
+\
+static inline void name##_order(type *a, type *b, void *ctx) { \
+  (void)ctx; \
+  if (less(b, a, ctx)) { \
+    type item = *a; \
+    *a = *b; \
+    *b = item; \
+  } \
+} \
+\
+static void name##_introsort(type *items, size_t count, size_t depth, \
+                             void *ctx) { \
+  while (count > VECTOR_SORT_CUTOFF) { \
+    if (depth-- == 0) { \
+      name##_heapsort(items, count, ctx); \
+      return; \
+    } \
+    /* The median of three also acts as a sentinel for both scans. */ \
+    type *last = items + count - 1; \
+    name##_order(items, items + count / 2, ctx); \
+    name##_order(items + count / 2, last, ctx); \
+    name##_order(items, items + count / 2, ctx); \
+    type pivot = items[count / 2]; \
+    size_t i = 0; \
+    size_t j = count - 1; \
+    for (;;) { \
+      while (less(&items[++i], &pivot, ctx)) {} \
+      while (less(&pivot, &items[--j], ctx)) {} \
+      if (i >= j) { \
+        break; \
+      } \
+      type item = items[i]; \
+      items[i] = items[j]; \
+      items[j] = item; \
+    } \
+    /* Recurse into the smaller half to bound the stack depth. */ \
+    size_t left = j + 1; \
+    if (left < count - left) { \
+      name##_introsort(items, left, depth, ctx); \
+      items += left; \
+      count -= left; \
+    } else { \
+      name##_introsort(items + left, count - left, depth, ctx); \
+      count = left; \
+    } \
+  } \
+} \
+\
+static inline void name##_items(type *items, size_t count, void *ctx) { \
+  size_t depth = 0; \
+  for (size_t n = count; n > 1; n >>= 1) { \
+    depth += 2; \
+  } \
+  name##_introsort(items, count, depth, ctx); \
+  name##_insertion(items, count, ctx); \
+} \
+\
+static inline void name(VECTOR *vec, void *ctx) { \
+  name##_items((type *)vec->data, vec->used_bytes / sizeof(type), ctx); \
+}
+
+#endif  // CUTIL_VECTOR_SORT_H